@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Flash, static RAM and peak heap for each OpenEVSEClass feature group.
+
+Builds every env in platformio.ini and reports what each one saves against
+"all". With -p the envs are flashed one at a time and the peak heap is read
+from the sketch's "footprint heap_used=" line, the charger needs to be
+connected for that to mean anything.
+
+usage: footprint_report.py [-p port] [-e envs] [-o footprint.json]
+"""
+
+import argparse
+import configparser
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+PROJECT = os.path.dirname(os.path.abspath(__file__))
+BASELINE = "all"
+HEAP_TIMEOUT = 90
+
+SIZE_RE = re.compile(r"^(RAM|Flash):.*\(used (\d+) bytes from (\d+) bytes\)", re.M)
+HEAP_RE = re.compile(r"footprint heap_used=(\d+)")
+
+
+def envs():
+    config = configparser.ConfigParser(interpolation=None)
+    config.read(os.path.join(PROJECT, "platformio.ini"))
+    return [s[4:] for s in config.sections() if s.startswith("env:")]
+
+
+def build(env):
+    result = subprocess.run(["pio", "run", "-d", PROJECT, "-e", env],
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            universal_newlines=True)
+    if result.returncode != 0:
+        sys.stderr.write(result.stdout)
+        raise SystemExit("%s: build failed" % env)
+
+    sizes = {}
+    for kind, used, _total in SIZE_RE.findall(result.stdout):
+        sizes["flash" if kind == "Flash" else "ram"] = int(used)
+    return sizes
+
+
+def peak_heap(env, port):
+    import serial
+
+    subprocess.run(["pio", "run", "-d", PROJECT, "-e", env, "-t", "upload",
+                    "--upload-port", port], check=True,
+                   stdout=subprocess.DEVNULL)
+
+    # The sketch reports every 30s, take the second so the first polls are in
+    heap = None
+    seen = 0
+    with serial.Serial(port, 115200, timeout=1) as link:
+        end = time.time() + HEAP_TIMEOUT
+        while time.time() < end and seen < 2:
+            match = HEAP_RE.search(link.readline().decode("ascii", "replace"))
+            if match:
+                heap = int(match.group(1))
+                seen += 1
+    return heap
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-p", "--port", help="flash each env and read its peak heap")
+    parser.add_argument("-e", "--envs", help="comma separated, default all in platformio.ini")
+    parser.add_argument("-o", "--output", help="write the results as JSON")
+    args = parser.parse_args()
+
+    names = args.envs.split(",") if args.envs else envs()
+    if BASELINE not in names:
+        names.insert(0, BASELINE)
+
+    results = {}
+    for env in names:
+        results[env] = build(env)
+        if args.port:
+            results[env]["heap"] = peak_heap(env, args.port)
+
+    base = results[BASELINE]
+    columns = ["flash", "ram"] + (["heap"] if args.port else [])
+    print("%-14s" % "env" + "".join("%10s %8s" % (c, "saved") for c in columns))
+    for env, sizes in results.items():
+        line = "%-14s" % env
+        for c in columns:
+            value = sizes.get(c)
+            if value is None or base.get(c) is None:
+                line += "%10s %8s" % ("-", "-")
+            else:
+                line += "%10d %8d" % (value, base[c] - value)
+        print(line)
+
+    if args.output:
+        with open(args.output, "w") as out:
+            json.dump({"baseline": BASELINE, "results": results}, out, indent=2)
+
+
+if __name__ == "__main__":
+    main()
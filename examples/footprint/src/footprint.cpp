@@ -0,0 +1,149 @@
+// get_charger_state with a call to everything in each feature group that is
+// built, so the linker keeps it, and peak heap tracking. Only meaningful
+// compared between the envs in platformio.ini.
+
+#include <Arduino.h>
+#include <openevse.h>
+
+#ifndef DEBUG_PORT
+#define DEBUG_PORT Serial
+#endif
+
+#ifndef RAPI_PORT
+#define RAPI_PORT Serial1
+#endif
+
+#define POLL_TIME   (5 * 1000)
+#define REPORT_TIME (30 * 1000)
+
+RapiSender rapiSender(&RAPI_PORT);
+
+RapiTimer pollTimer;
+RapiTimer reportTimer;
+
+#if OPENEVSE_ENABLE_ASYNC_EVENTS
+OpenEVSESubscriber faultEvents([](const OpenEVSEEvent &event) {
+  DEBUG_PORT.printf("Fault %02x\n", event.evse_state);
+});
+#endif
+
+uint32_t heapStart;
+uint32_t heapLow;
+
+void trackHeap()
+{
+  uint32_t free = ESP.getFreeHeap();
+  if(free < heapLow) {
+    heapLow = free;
+  }
+}
+
+void exercise()
+{
+  OpenEVSE.getStatus([](int ret, uint8_t evse_state, uint32_t session_time, uint8_t pilot_state, uint32_t vflags) {
+    DEBUG_PORT.printf("evse_state = %02x, session_time = %d, pilot_state = %02x, vflags = %08x\n", evse_state, session_time, pilot_state, vflags);
+  });
+
+#if OPENEVSE_ENABLE_D9
+  if(OpenEVSE.isD9Supported())
+  {
+    OpenEVSE.getFrequency([](int ret, uint32_t frequency) { });
+    OpenEVSE.getRelayStatus([](int ret, bool dc1, bool dc2, bool ac) { });
+    OpenEVSE.setRelayEnable(OPENEVSE_RELAYF_AC_DISABLED, true, [](int ret) { });
+    OpenEVSE.resetFaultCounters([](int ret) { });
+    OpenEVSE.setPanicTemperature(80, [](int ret) { });
+  }
+#endif
+
+#if OPENEVSE_ENABLE_LCD
+  OpenEVSE.lcdEnable(true, [](int ret) { });
+  OpenEVSE.lcdSetColour(OPENEVSE_LCD_GREEN, [](int ret) { });
+  OpenEVSE.lcdDisplayText(0, 0, "Footprint", [](int ret) { });
+#endif
+
+#if OPENEVSE_ENABLE_HEARTBEAT
+  OpenEVSE.heartbeatEnable(60, 6, [](int ret, int interval, int current, int triggered) { });
+  OpenEVSE.heartbeatPulse([](int ret) { });
+#endif
+
+#if OPENEVSE_ENABLE_TIME
+  OpenEVSE.getTime([](int ret, time_t time) {
+    if(RAPI_RESPONSE_OK == ret) {
+      OpenEVSE.setTime(time, [](int ret) { });
+    }
+  });
+#endif
+
+#if OPENEVSE_ENABLE_TELEMETRY
+  OpenEVSE.getTelemetry([](int ret, const OpenEVSETelemetry &telemetry) {
+    DEBUG_PORT.printf("telemetry ret = %d, failed = %02x, took = %ums\n", ret, telemetry.failed, telemetry.took);
+  });
+#endif
+
+#if OPENEVSE_ENABLE_CACHE
+  OpenEVSE.setCacheTtl(OPENEVSE_CACHE_ALL, 60000);
+#endif
+}
+
+void poll()
+{
+  trackHeap();
+
+  if(OpenEVSE.isConnected())
+  {
+    exercise();
+  }
+  else
+  {
+    OpenEVSE.begin(rapiSender, [](bool connected)
+    {
+      if(connected)
+      {
+        DEBUG_PORT.printf("Connected to OpenEVSE\n");
+      } else {
+        DEBUG_PORT.println("OpenEVSE not responding or not connected");
+      }
+    });
+  }
+}
+
+// footprint_report.py looks for this line
+void report()
+{
+  DEBUG_PORT.printf("footprint heap_used=%u heap_free=%u\n", heapStart - heapLow, heapLow);
+}
+
+void setup()
+{
+  heapStart = ESP.getFreeHeap();
+  heapLow = heapStart;
+
+  RAPI_PORT.begin(115200);
+  DEBUG_PORT.begin(115200);
+
+  DEBUG_PORT.println("");
+  DEBUG_PORT.println("OpenEVSE footprint");
+  DEBUG_PORT.println("");
+
+#if OPENEVSE_ENABLE_ASYNC_EVENTS
+  OpenEVSE.onState([](uint8_t evse_state, uint8_t pilot_state, uint32_t current_capacity, uint32_t vflags) {
+    DEBUG_PORT.printf("State %02x\n", evse_state);
+  });
+  OpenEVSE.onBoot([](uint8_t post_code, const char *firmware) { });
+  OpenEVSE.onWiFi([](uint8_t event) { });
+  OpenEVSE.onButton([](uint8_t long_press) { });
+  OpenEVSE.subscribe(faultEvents, OPENEVSE_EVENT_STATE,
+    OPENEVSE_STATE_BIT(OPENEVSE_STATE_GFI_FAULT) | OPENEVSE_STATE_BIT(OPENEVSE_STATE_STUCK_RELAY));
+#endif
+
+  pollTimer.setHandler(poll);
+  rapiSender.getTimerWheel()->schedule(pollTimer, 0, POLL_TIME);
+  reportTimer.setHandler(report);
+  rapiSender.getTimerWheel()->schedule(reportTimer, REPORT_TIME, REPORT_TIME);
+}
+
+void loop()
+{
+  rapiSender.loop();
+  trackHeap();
+}
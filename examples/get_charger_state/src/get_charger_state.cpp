@@ -13,7 +13,7 @@
 
 RapiSender rapiSender(&RAPI_PORT);
 
-uint32_t next_status = 0;
+RapiTimer pollTimer;
 
 const char *get_state_name(uint8_t state)
 {
@@ -70,6 +70,34 @@ const char *get_state_name(uint8_t state)
   return estate;
 }
 
+void poll()
+{
+  if(OpenEVSE.isConnected())
+  {
+    OpenEVSE.getStatus([](int ret, uint8_t evse_state, uint32_t session_time, uint8_t pilot_state, uint32_t vflags)
+    {
+      if(RAPI_RESPONSE_OK == ret)
+      {
+        DEBUG_PORT.printf("evse_state = %02x, session_time = %d, pilot_state = %02x, vflags = %08x\n", evse_state, session_time, pilot_state, vflags);
+        DEBUG_PORT.printf("EVSE state: %s\n", get_state_name(evse_state));
+        DEBUG_PORT.printf("Pilot state: %s\n", get_state_name(pilot_state));
+      }
+    });
+  }
+  else
+  {
+    OpenEVSE.begin(rapiSender, [](bool connected)
+    {
+      if(connected)
+      {
+        DEBUG_PORT.printf("Connected to OpenEVSE\n");
+      } else {
+        DEBUG_PORT.println("OpenEVSE not responding or not connected");
+      }
+    });
+  }
+}
+
 void setup()
 {
   RAPI_PORT.begin(115200);
@@ -78,38 +106,12 @@ void setup()
   DEBUG_PORT.println("");
   DEBUG_PORT.println("OpenEVSE");
   DEBUG_PORT.println("");
+
+  pollTimer.setHandler(poll);
+  rapiSender.getTimerWheel()->schedule(pollTimer, 0, POLL_TIME);
 }
 
 void loop()
 {
   rapiSender.loop();
-
-  if(millis() > next_status)
-  {
-    next_status = millis() + POLL_TIME;
-    if(OpenEVSE.isConnected())
-    {
-      OpenEVSE.getStatus([](int ret, uint8_t evse_state, uint32_t session_time, uint8_t pilot_state, uint32_t vflags)
-      {
-        if(RAPI_RESPONSE_OK == ret)
-        {
-          DEBUG_PORT.printf("evse_state = %02x, session_time = %d, pilot_state = %02x, vflags = %08x\n", evse_state, session_time, pilot_state, vflags);
-          DEBUG_PORT.printf("EVSE state: %s\n", get_state_name(evse_state));
-          DEBUG_PORT.printf("Pilot state: %s\n", get_state_name(pilot_state));
-        }
-      });
-    }
-    else
-    {
-      OpenEVSE.begin(rapiSender, [](bool connected)
-      {
-        if(connected)
-        {
-          DEBUG_PORT.printf("Connected to OpenEVSE\n");
-        } else {
-          DEBUG_PORT.println("OpenEVSE not responding or not connected");
-        }
-      });
-    }
-  }
 }
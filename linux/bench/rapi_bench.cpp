@@ -0,0 +1,342 @@
+// Single link throughput and latency benchmark, RapiSender and
+// OpenEVSEClass against an in-process RapiSimulator
+//
+// usage: rapi_bench [-t ms] [-b bauds] [-d delays_us] [-q depths] [-r read_timeouts_ms]
+//                   [-m mixes] [-o file]
+//   lists are comma separated, e.g. -b 9600,115200,0 (0 = no line delay)
+//   read timeouts are RapiSender::setReadTimeout(), 0 is non-blocking
+//   mixes: raw     $GS straight through RapiSender
+//          poll    OpenEVSEClass getters
+//          control OpenEVSEClass setters
+//          mixed   3 polls to 1 control
+//          telemetry the poll getters as one getTelemetry() batch, one
+//                  batch at a time, so only run at depth 1
+//
+// Latency is sendCmd() to the completion callback, so includes queue wait,
+// for telemetry it is per batch. Goodput counts the response bytes of
+// successful commands, not measured (null) for telemetry.
+
+#include <Arduino.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <openevse.h>
+
+#include "RapiSimulator.h"
+
+#define BENCH_DEFAULT_DURATION 200
+#define BENCH_DRAIN_TIMEOUT    5000
+
+struct BenchMode
+{
+  uint32_t baud;
+  uint32_t delay;
+  int depth;
+  uint32_t readTimeout;
+  std::string mix;
+};
+
+struct BenchResult
+{
+  uint32_t commands;
+  uint32_t errors;
+  uint64_t goodput;
+  uint64_t wire;
+  uint32_t elapsed;
+  std::vector<uint32_t> latency;
+};
+
+class Bench
+{
+  private:
+    RapiSimulator _sim;
+    RapiSender _rapi;
+    OpenEVSEClass _evse;
+    const BenchMode &_mode;
+    BenchResult &_result;
+    bool _running;
+    int _outstanding;
+    uint32_t _issued;
+
+    void _done(uint32_t start, int ret)
+    {
+      _outstanding--;
+      if(RAPI_RESPONSE_OK == ret) {
+        _result.commands++;
+        _result.goodput += strlen(_rapi.getResponse());
+      } else {
+        _result.errors++;
+      }
+      _result.latency.push_back(micros() - start);
+
+      if(_running) {
+        _issue();
+      }
+    }
+
+    void _batch(uint32_t start, const OpenEVSETelemetry &telemetry)
+    {
+      _outstanding--;
+      for(uint8_t item = 1; item & OPENEVSE_TELEMETRY_ALL; item <<= 1)
+      {
+        if(telemetry.requested & item) {
+          if(telemetry.failed & item) {
+            _result.errors++;
+          } else {
+            _result.commands++;
+          }
+        }
+      }
+      _result.latency.push_back(micros() - start);
+
+      if(_running) {
+        _issue();
+      }
+    }
+
+    void _poll(uint32_t start, uint32_t n)
+    {
+      switch(n % 4)
+      {
+        case 0:
+          _evse.getStatus([this, start](int ret, uint8_t, uint32_t, uint8_t, uint32_t) { _done(start, ret); });
+          break;
+        case 1:
+          _evse.getChargeCurrentAndVoltage([this, start](int ret, double, double) { _done(start, ret); });
+          break;
+        case 2:
+          _evse.getEnergy([this, start](int ret, double, double) { _done(start, ret); });
+          break;
+        case 3:
+          _evse.getTemperature([this, start](int ret, double, bool, double, bool, double, bool) { _done(start, ret); });
+          break;
+      }
+    }
+
+    void _control(uint32_t start, uint32_t n)
+    {
+      switch(n % 3)
+      {
+        case 0:
+          _evse.setCurrentCapacity((n & 1) ? 16 : 24, false, [this, start](int ret, long) { _done(start, ret); });
+          break;
+        case 1:
+          _evse.heartbeatPulse([this, start](int ret) { _done(start, ret); });
+          break;
+        case 2:
+          _evse.lcdDisplayText(0, 1, "Charging 7.2kW", [this, start](int ret) { _done(start, ret); });
+          break;
+      }
+    }
+
+    void _issue()
+    {
+      uint32_t start = micros();
+      uint32_t n = _issued++;
+      _outstanding++;
+
+      if("raw" == _mode.mix) {
+        _rapi.sendCmd("$GS", [this, start](int ret) { _done(start, ret); });
+      } else if("poll" == _mode.mix) {
+        _poll(start, n);
+      } else if("control" == _mode.mix) {
+        _control(start, n);
+      } else if("telemetry" == _mode.mix) {
+        _evse.getTelemetry([this, start](int ret, const OpenEVSETelemetry &telemetry) { _batch(start, telemetry); });
+      } else if(n % 4 < 3) {
+        _poll(start, n - n / 4);
+      } else {
+        _control(start, n / 4);
+      }
+    }
+
+  public:
+    Bench(const BenchMode &mode, BenchResult &result) :
+      _sim(),
+      _rapi(&_sim),
+      _evse(),
+      _mode(mode),
+      _result(result),
+      _running(false),
+      _outstanding(0),
+      _issued(0)
+    {
+      _sim.setBaud(mode.baud);
+      _sim.setLatency(mode.delay);
+      _rapi.setReadTimeout(mode.readTimeout);
+    }
+
+    bool run(uint32_t duration)
+    {
+      bool connected = false;
+      bool done = false;
+      _evse.begin(_rapi, [&](bool ok) {
+        connected = ok;
+        done = true;
+      });
+      while(!done) {
+        _rapi.loop();
+      }
+      if(!connected) {
+        return false;
+      }
+
+      uint32_t wire = _rapi.getStats().bytes_in + _rapi.getStats().bytes_out;
+      uint32_t start = millis();
+
+      _running = true;
+      for(int i = 0; i < _mode.depth; i++) {
+        _issue();
+      }
+      while(millis() - start < duration) {
+        _rapi.loop();
+      }
+
+      _running = false;
+      while(_outstanding > 0 && millis() - start < duration + BENCH_DRAIN_TIMEOUT) {
+        _rapi.loop();
+      }
+
+      _result.elapsed = millis() - start;
+      _result.wire = _rapi.getStats().bytes_in + _rapi.getStats().bytes_out - wire;
+      return true;
+    }
+};
+
+static uint32_t percentile(std::vector<uint32_t> &values, double p)
+{
+  if(values.empty()) {
+    return 0;
+  }
+  size_t n = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+
+static std::vector<std::string> split(const char *list)
+{
+  std::vector<std::string> items;
+  std::string item;
+  for(const char *s = list; ; s++)
+  {
+    if(',' == *s || '\0' == *s) {
+      if(!item.empty()) {
+        items.push_back(item);
+      }
+      item.clear();
+      if('\0' == *s) {
+        break;
+      }
+    } else {
+      item.push_back(*s);
+    }
+  }
+  return items;
+}
+
+static std::vector<uint32_t> splitNumbers(const char *list)
+{
+  std::vector<uint32_t> numbers;
+  for(const std::string &item : split(list)) {
+    numbers.push_back(strtoul(item.c_str(), NULL, 10));
+  }
+  return numbers;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t duration = BENCH_DEFAULT_DURATION;
+  std::vector<uint32_t> bauds = { 9600, 115200, 0 };
+  std::vector<uint32_t> delays = { 0, 2000 };
+  std::vector<uint32_t> depths = { 1, 4 };
+  std::vector<uint32_t> readTimeouts = { RAPI_READ_TIMEOUT_MS, 0 };
+  std::vector<std::string> mixes = { "raw", "poll", "control", "mixed", "telemetry" };
+  const char *output = NULL;
+
+  int opt;
+  while(-1 != (opt = getopt(argc, argv, "t:b:d:q:r:m:o:")))
+  {
+    switch(opt)
+    {
+      case 't': duration = strtoul(optarg, NULL, 10); break;
+      case 'b': bauds = splitNumbers(optarg); break;
+      case 'd': delays = splitNumbers(optarg); break;
+      case 'q': depths = splitNumbers(optarg); break;
+      case 'r': readTimeouts = splitNumbers(optarg); break;
+      case 'm': mixes = split(optarg); break;
+      case 'o': output = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-t ms] [-b bauds] [-d delays_us] [-q depths] [-r read_timeouts_ms] [-m mixes] [-o file]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  FILE *out = stdout;
+  if(output && NULL == (out = fopen(output, "w"))) {
+    perror(output);
+    return 1;
+  }
+
+  fprintf(out, "{\n  \"benchmark\": \"rapi_link\",\n  \"duration_ms\": %u,\n  \"results\": [", (unsigned)duration);
+
+  std::vector<BenchMode> modes;
+  for(uint32_t baud : bauds) {
+    for(uint32_t delay : delays) {
+      for(uint32_t depth : depths) {
+        for(uint32_t readTimeout : readTimeouts) {
+          for(const std::string &mix : mixes)
+          {
+            if("telemetry" == mix && 1 != depth) {
+              fprintf(stderr, "telemetry: skipping depth %u, batches are one at a time\n", (unsigned)depth);
+              continue;
+            }
+            modes.push_back({ baud, delay, (int)std::min<uint32_t>(depth, RAPI_MAX_COMMANDS), readTimeout, mix });
+          }
+        }
+      }
+    }
+  }
+
+  bool first = true;
+  for(const BenchMode &mode : modes)
+  {
+    BenchResult result = {};
+
+    Bench bench(mode, result);
+    if(!bench.run(duration)) {
+      fprintf(stderr, "baud %u delay %u: simulator did not connect\n", (unsigned)mode.baud, (unsigned)mode.delay);
+      return 1;
+    }
+
+    double seconds = result.elapsed / 1000.0;
+    char goodput[32] = "null";
+    if("telemetry" != mode.mix) {
+      snprintf(goodput, sizeof(goodput), "%.1f", result.goodput / seconds);
+    }
+    fprintf(out, "%s\n    { \"baud\": %u, \"delay_us\": %u, \"depth\": %d, \"read_timeout_ms\": %u, \"mix\": \"%s\", "
+      "\"commands\": %u, \"errors\": %u, \"cmds_per_sec\": %.1f, "
+      "\"goodput_bytes_per_sec\": %s, \"wire_bytes_per_sec\": %.1f, "
+      "\"latency_us\": { \"p50\": %u, \"p99\": %u, \"max\": %u } }",
+      first ? "" : ",",
+      (unsigned)mode.baud, (unsigned)mode.delay, mode.depth, (unsigned)mode.readTimeout, mode.mix.c_str(),
+      (unsigned)result.commands, (unsigned)result.errors,
+      result.commands / seconds, goodput, result.wire / seconds,
+      (unsigned)percentile(result.latency, 50), (unsigned)percentile(result.latency, 99),
+      result.latency.empty() ? 0U : (unsigned)*std::max_element(result.latency.begin(), result.latency.end()));
+    fflush(out);
+    first = false;
+  }
+
+  fprintf(out, "\n  ]\n}\n");
+  if(out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,353 @@
+// A day at a charging site on the virtual clock: N simulated chargers,
+// vehicles arriving and leaving, an OpenEVSEClass client per charger
+// polling it and a site controller sharing out a current limit. 24 hours
+// run in seconds and the same seed gives the same day.
+//
+// usage: rapi_day [-n chargers] [-H hours] [-s seed] [-p poll_s] [-c control_s]
+//                 [-L site_amps] [-a age_s] [-b baud] [-o file]
+//   -L  site limit shared between the charging vehicles, 0 for none
+//   -a  poll with refreshStatus(), only sending $GS when the state model
+//       is older than this, 0 for a $GS every poll
+//
+// "fingerprint" hashes the results, two runs with the same options and
+// seed should match.
+
+#include <Arduino.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <openevse.h>
+
+#include "RapiSimulation.h"
+#include "RapiSimulator.h"
+
+#define DAY_MAX_CURRENT      32
+#define DAY_MIN_CURRENT      6
+#define DAY_MIN_GAP          (20 * 60)       // s between one vehicle leaving and the next arriving
+#define DAY_MAX_GAP          (4 * 60 * 60)
+#define DAY_MIN_DWELL        (30 * 60)       // s a vehicle stays plugged in
+#define DAY_MAX_DWELL        (9 * 60 * 60)
+#define DAY_CONNECT_RETRY    5000            // ms
+
+static const uint64_t US_PER_S = 1000000ULL;
+
+struct DayOptions
+{
+  uint32_t chargers;
+  uint32_t hours;
+  uint32_t seed;
+  uint32_t poll;
+  uint32_t control;
+  uint32_t siteLimit;
+  uint32_t maxAge;
+  uint32_t baud;
+};
+
+struct ChargerResult
+{
+  uint32_t sessions;
+  uint32_t polls;
+  uint32_t failed;
+  uint32_t events;
+  uint32_t setCurrent;
+  double energy;
+};
+
+class Charger
+{
+  private:
+    RapiSimulator _sim;
+    RapiSender _rapi;
+    OpenEVSEClass _evse;
+    RapiTimer _poll;
+    RapiTimer _vehicle;
+    uint32_t _random;
+    uint32_t _pilot;
+    uint32_t _maxAge;
+    ChargerResult _result;
+
+    uint32_t _nextRandom()
+    {
+      // xorshift32
+      _random ^= _random << 13;
+      _random ^= _random >> 17;
+      _random ^= _random << 5;
+      return _random;
+    }
+
+    uint32_t _between(uint32_t low, uint32_t high) {
+      return low + _nextRandom() % (high - low + 1);
+    }
+
+    void _onPoll()
+    {
+      if(!_evse.isConnected())
+      {
+        _evse.begin(_rapi, [this](bool connected) {
+          if(!connected) {
+            _result.failed++;
+          }
+        });
+        return;
+      }
+
+      if(_maxAge > 0)
+      {
+        _evse.refreshStatus(_maxAge * 1000UL, [this](int ret, const OpenEVSEStatus &) {
+          if(RAPI_RESPONSE_OK == ret) {
+            _result.polls++;
+          } else {
+            _result.failed++;
+          }
+        });
+        return;
+      }
+
+      _evse.getStatus([this](int ret, uint8_t, uint32_t, uint8_t, uint32_t) {
+        if(RAPI_RESPONSE_OK == ret) {
+          _result.polls++;
+        } else {
+          _result.failed++;
+        }
+      });
+    }
+
+    // Vehicles come and go, plugged in when the timer fires with nothing
+    // connected, unplugged when it fires again
+    void _onVehicle()
+    {
+      if(OPENEVSE_STATE_NOT_CONNECTED == _sim.getState())
+      {
+        _sim.plugIn();
+        _result.sessions++;
+        _rapi.getTimerWheel()->schedule(_vehicle, _between(DAY_MIN_DWELL, DAY_MAX_DWELL) * 1000UL);
+      }
+      else
+      {
+        _sim.unplug();
+        _rapi.getTimerWheel()->schedule(_vehicle, _between(DAY_MIN_GAP, DAY_MAX_GAP) * 1000UL);
+      }
+    }
+
+  public:
+    Charger(uint32_t id, const DayOptions &options) :
+      _sim(),
+      _rapi(&_sim),
+      _evse(),
+      _poll([this]() { _onPoll(); }),
+      _vehicle([this]() { _onVehicle(); }),
+      _random(options.seed * 2654435761UL + id + 1),
+      _pilot(DAY_MAX_CURRENT),
+      _maxAge(options.maxAge),
+      _result()
+    {
+      if(0 == _random) {
+        _random = 1;
+      }
+      _sim.setSeed(_nextRandom());
+      _sim.setBaud(options.baud);
+      _sim.setLatency(2000, 1000);
+      _evse.onState([this](uint8_t, uint8_t, uint32_t, uint32_t) {
+        _result.events++;
+      });
+    }
+
+    void begin(RapiSimulation &simulation, const DayOptions &options)
+    {
+      simulation.add(_rapi, _sim);
+
+      // Spread the polls so the chargers are not in lock step
+      RapiTimerWheel &timers = *_rapi.getTimerWheel();
+      timers.schedule(_poll, _nextRandom() % (options.poll * 1000), options.poll * 1000);
+      timers.schedule(_vehicle, _between(0, DAY_MAX_GAP) * 1000UL);
+    }
+
+    bool isCharging() {
+      return OPENEVSE_STATE_CHARGING == _evse.getLastStatus().evse_state;
+    }
+
+    // What the vehicle is really drawing, from the simulator
+    uint32_t getDraw() {
+      return OPENEVSE_STATE_CHARGING == _sim.getState() ? _sim.getPilot() : 0;
+    }
+
+    void setCurrent(uint32_t amps)
+    {
+      if(amps == _pilot || !_evse.isConnected()) {
+        return;
+      }
+      _pilot = amps;
+      _evse.setCurrentCapacity(amps, false, [this](int ret, long) {
+        if(RAPI_RESPONSE_OK == ret) {
+          _result.setCurrent++;
+        } else {
+          _result.failed++;
+        }
+      });
+    }
+
+    void readEnergy()
+    {
+      _poll.cancel();
+      _vehicle.cancel();
+      _evse.getEnergy([this](int ret, double, double total) {
+        if(RAPI_RESPONSE_OK == ret) {
+          _result.energy = total;
+        }
+      });
+    }
+
+    const ChargerResult &getResult() {
+      return _result;
+    }
+    const RapiLinkStats &getStats() {
+      return _rapi.getStats();
+    }
+};
+
+static uint64_t cpuMicros()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+static uint32_t fnv(uint32_t hash, const void *data, size_t size)
+{
+  const uint8_t *bytes = (const uint8_t *)data;
+  for(size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 16777619UL;
+  }
+  return hash;
+}
+
+int main(int argc, char **argv)
+{
+  DayOptions options = { 20, 24, 1, 10, 60, 0, 0, 115200 };
+  const char *output = NULL;
+
+  int opt;
+  while(-1 != (opt = getopt(argc, argv, "n:H:s:p:c:L:a:b:o:")))
+  {
+    switch(opt)
+    {
+      case 'n': options.chargers = strtoul(optarg, NULL, 10); break;
+      case 'H': options.hours = strtoul(optarg, NULL, 10); break;
+      case 's': options.seed = strtoul(optarg, NULL, 10); break;
+      case 'p': options.poll = std::max(1UL, strtoul(optarg, NULL, 10)); break;
+      case 'c': options.control = std::max(1UL, strtoul(optarg, NULL, 10)); break;
+      case 'L': options.siteLimit = strtoul(optarg, NULL, 10); break;
+      case 'a': options.maxAge = strtoul(optarg, NULL, 10); break;
+      case 'b': options.baud = strtoul(optarg, NULL, 10); break;
+      case 'o': output = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-n chargers] [-H hours] [-s seed] [-p poll_s] [-c control_s] [-L site_amps] [-a age_s] [-b baud] [-o file]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  FILE *out = stdout;
+  if(output && NULL == (out = fopen(output, "w"))) {
+    perror(output);
+    return 1;
+  }
+
+  uint64_t cpuStart = cpuMicros();
+
+  RapiSimulation simulation;
+  simulation.begin();
+
+  std::vector<std::unique_ptr<Charger>> chargers;
+  for(uint32_t i = 0; i < options.chargers; i++)
+  {
+    chargers.emplace_back(new Charger(i, options));
+    chargers.back()->begin(simulation, options);
+  }
+
+  // Site controller: share the limit between the vehicles it sees charging
+  uint32_t peakDraw = 0;
+  uint64_t ampSeconds = 0;
+  RapiTimer control([&]() {
+    uint32_t charging = 0;
+    uint32_t draw = 0;
+    for(auto &charger : chargers) {
+      charging += charger->isCharging() ? 1 : 0;
+      draw += charger->getDraw();
+    }
+    peakDraw = std::max(peakDraw, draw);
+    ampSeconds += (uint64_t)draw * options.control;
+
+    uint32_t share = DAY_MAX_CURRENT;
+    if(options.siteLimit > 0 && charging > 0) {
+      share = std::min<uint32_t>(DAY_MAX_CURRENT, std::max<uint32_t>(DAY_MIN_CURRENT, options.siteLimit / charging));
+    }
+    for(auto &charger : chargers) {
+      charger->setCurrent(share);
+    }
+  });
+  simulation.timers().schedule(control, options.control * 1000, options.control * 1000);
+
+  simulation.runFor(options.hours * 3600ULL * US_PER_S);
+
+  control.cancel();
+  for(auto &charger : chargers) {
+    charger->readEnergy();
+  }
+  simulation.runFor(5 * US_PER_S);
+
+  uint64_t simulated = simulation.now();
+  simulation.end();
+  uint64_t cpu = cpuMicros() - cpuStart;
+
+  ChargerResult total = {};
+  RapiLinkStats link = {};
+  uint32_t fingerprint = 2166136261UL;
+  for(auto &charger : chargers)
+  {
+    const ChargerResult &result = charger->getResult();
+    total.sessions += result.sessions;
+    total.polls += result.polls;
+    total.failed += result.failed;
+    total.events += result.events;
+    total.setCurrent += result.setCurrent;
+    total.energy += result.energy;
+    fingerprint = fnv(fingerprint, &result, sizeof(result));
+
+    const RapiLinkStats &stats = charger->getStats();
+    link.sent += stats.sent;
+    link.timeouts += stats.timeouts;
+    link.bytes_in += stats.bytes_in;
+    link.bytes_out += stats.bytes_out;
+  }
+  fingerprint = fnv(fingerprint, &simulated, sizeof(simulated));
+
+  fprintf(out, "{\n  \"benchmark\": \"rapi_day\",\n  \"chargers\": %u,\n  \"hours\": %u,\n  \"seed\": %u,\n"
+    "  \"poll_s\": %u,\n  \"control_s\": %u,\n  \"site_limit_a\": %u,\n  \"max_age_s\": %u,\n  \"baud\": %u,\n",
+    (unsigned)options.chargers, (unsigned)options.hours, (unsigned)options.seed,
+    (unsigned)options.poll, (unsigned)options.control, (unsigned)options.siteLimit,
+    (unsigned)options.maxAge, (unsigned)options.baud);
+  fprintf(out, "  \"sessions\": %u,\n  \"energy_kwh\": %.3f,\n  \"peak_site_a\": %u,\n  \"average_site_a\": %.2f,\n",
+    (unsigned)total.sessions, total.energy, (unsigned)peakDraw,
+    (double)ampSeconds / (options.hours * 3600.0));
+  fprintf(out, "  \"polls\": %u,\n  \"set_current\": %u,\n  \"state_events\": %u,\n  \"failed\": %u,\n"
+    "  \"commands\": %u,\n  \"timeouts\": %u,\n  \"wire_bytes\": %llu,\n",
+    (unsigned)total.polls, (unsigned)total.setCurrent, (unsigned)total.events, (unsigned)total.failed,
+    (unsigned)link.sent, (unsigned)link.timeouts,
+    (unsigned long long)link.bytes_in + link.bytes_out);
+  fprintf(out, "  \"clock_steps\": %llu,\n  \"cpu_s\": %.3f,\n  \"speedup\": %.0f,\n  \"fingerprint\": \"%08x\"\n}\n",
+    (unsigned long long)simulation.getSteps(), cpu / 1e6, cpu > 0 ? (double)simulated / cpu : 0.0,
+    (unsigned)fingerprint);
+
+  if(out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,299 @@
+// Fault to callback latency benchmark: the simulator raises controller
+// faults at chosen moments while OpenEVSEClass is polling it, and the time
+// from the first byte of the $AT on the wire to the onState() callback is
+// measured
+//
+// usage: rapi_fault_bench [-n faults] [-b bauds] [-r read_timeouts_ms] [-s scenarios] [-o file]
+//   lists are comma separated, e.g. -b 9600,115200,0 (0 = no line delay)
+//   scenarios: idle          nothing else on the link
+//              mid_response  half way through reading a poll response
+//              backlog       the sender's command queue kept full of polls
+//              burst         behind a burst of $WF events
+//
+// The maximum is the worst case seen, a bound only as good as the number
+// of faults injected.
+
+#include <Arduino.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <openevse.h>
+
+#include "RapiSimulator.h"
+
+#define FAULT_BENCH_DEFAULT_FAULTS 50
+#define FAULT_BENCH_TIMEOUT        250 // ms before a fault counts as missed
+#define FAULT_BENCH_BURST          4
+#define FAULT_BENCH_MAX_GAP        5 // ms of load between faults, randomised
+
+static const uint8_t faults[] = {
+  OPENEVSE_STATE_GFI_FAULT,
+  OPENEVSE_STATE_OVER_TEMPERATURE,
+  OPENEVSE_STATE_STUCK_RELAY
+};
+
+struct FaultMode
+{
+  uint32_t baud;
+  uint32_t readTimeout;
+  std::string scenario;
+};
+
+struct FaultResult
+{
+  uint32_t missed;
+  uint32_t polls;
+  std::vector<uint32_t> latency;
+};
+
+class FaultBench
+{
+  private:
+    RapiSimulator _sim;
+    RapiSender _rapi;
+    OpenEVSEClass _evse;
+    const FaultMode &_mode;
+    FaultResult &_result;
+    bool _running;
+    int _outstanding;
+    int _expected;
+    bool _seen;
+    uint32_t _seenAt;
+
+    void _poll()
+    {
+      _outstanding++;
+      _evse.getStatus([this](int ret, uint8_t, uint32_t, uint8_t, uint32_t) {
+        _outstanding--;
+        if(RAPI_RESPONSE_OK == ret) {
+          _result.polls++;
+        }
+        // A full queue answers straight away, asking again would recurse
+        if(_running && RAPI_RESPONSE_QUEUE_FULL != ret) {
+          _poll();
+        }
+      });
+    }
+
+    int _depth()
+    {
+      if("idle" == _mode.scenario) {
+        return 0;
+      }
+      return "backlog" == _mode.scenario ? RAPI_MAX_COMMANDS : 1;
+    }
+
+    // Run the link until onState() reports the expected state
+    bool _wait(int state)
+    {
+      _expected = state;
+      _seen = false;
+      uint32_t start = millis();
+      while(!_seen && millis() - start < FAULT_BENCH_TIMEOUT) {
+        _rapi.loop();
+      }
+      return _seen;
+    }
+
+    void _inject(uint8_t state)
+    {
+      if("mid_response" == _mode.scenario) {
+        _sim.armFault(state, RAPI_SIMULATOR_FAULT_MID_RESPONSE);
+        return;
+      }
+      if("burst" == _mode.scenario) {
+        for(int i = 0; i < FAULT_BENCH_BURST; i++) {
+          _sim.sendEvent(i & 1 ? "$WF 2" : "$WF 3");
+        }
+      }
+      _sim.fault(state);
+    }
+
+  public:
+    FaultBench(const FaultMode &mode, FaultResult &result) :
+      _sim(),
+      _rapi(&_sim),
+      _evse(),
+      _mode(mode),
+      _result(result),
+      _running(false),
+      _outstanding(0),
+      _expected(OPENEVSE_STATE_INVALID),
+      _seen(false),
+      _seenAt(0)
+    {
+      _sim.setBaud(mode.baud);
+      _sim.setLatency(1000, 500);
+      _rapi.setReadTimeout(mode.readTimeout);
+    }
+
+    bool run(uint32_t count)
+    {
+      bool connected = false;
+      bool done = false;
+      _evse.begin(_rapi, [&](bool ok) {
+        connected = ok;
+        done = true;
+      });
+      while(!done) {
+        _rapi.loop();
+      }
+      if(!connected) {
+        return false;
+      }
+
+      _evse.onState([this](uint8_t evse_state, uint8_t, uint32_t, uint32_t) {
+        if(!_seen && evse_state == _expected) {
+          _seenAt = micros();
+          _seen = true;
+        }
+      });
+
+      _running = true;
+      for(int i = 0; i < _depth(); i++) {
+        _poll();
+      }
+
+      for(uint32_t i = 0; i < count; i++)
+      {
+        // Let the load settle into a random phase
+        uint32_t gap = millis();
+        uint32_t wait = 1 + random() % FAULT_BENCH_MAX_GAP;
+        while(millis() - gap < wait) {
+          _rapi.loop();
+        }
+
+        uint8_t state = faults[i % sizeof(faults)];
+        _inject(state);
+        if(_wait(state)) {
+          _result.latency.push_back(_seenAt - _sim.getEventAt());
+        } else {
+          _result.missed++;
+        }
+
+        _sim.setState(OPENEVSE_STATE_NOT_CONNECTED, OPENEVSE_STATE_NOT_CONNECTED);
+        _wait(OPENEVSE_STATE_NOT_CONNECTED);
+      }
+
+      _running = false;
+      uint32_t start = millis();
+      while(_outstanding > 0 && millis() - start < FAULT_BENCH_TIMEOUT) {
+        _rapi.loop();
+      }
+      return true;
+    }
+};
+
+static uint32_t percentile(std::vector<uint32_t> &values, double p)
+{
+  if(values.empty()) {
+    return 0;
+  }
+  size_t n = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+
+static std::vector<std::string> split(const char *list)
+{
+  std::vector<std::string> items;
+  std::string item;
+  for(const char *s = list; ; s++)
+  {
+    if(',' == *s || '\0' == *s) {
+      if(!item.empty()) {
+        items.push_back(item);
+      }
+      item.clear();
+      if('\0' == *s) {
+        break;
+      }
+    } else {
+      item.push_back(*s);
+    }
+  }
+  return items;
+}
+
+static std::vector<uint32_t> splitNumbers(const char *list)
+{
+  std::vector<uint32_t> numbers;
+  for(const std::string &item : split(list)) {
+    numbers.push_back(strtoul(item.c_str(), NULL, 10));
+  }
+  return numbers;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t count = FAULT_BENCH_DEFAULT_FAULTS;
+  std::vector<uint32_t> bauds = { 9600, 115200, 0 };
+  std::vector<uint32_t> readTimeouts = { RAPI_READ_TIMEOUT_MS, 0 };
+  std::vector<std::string> scenarios = { "idle", "mid_response", "backlog", "burst" };
+  const char *output = NULL;
+
+  int opt;
+  while(-1 != (opt = getopt(argc, argv, "n:b:r:s:o:")))
+  {
+    switch(opt)
+    {
+      case 'n': count = strtoul(optarg, NULL, 10); break;
+      case 'b': bauds = splitNumbers(optarg); break;
+      case 'r': readTimeouts = splitNumbers(optarg); break;
+      case 's': scenarios = split(optarg); break;
+      case 'o': output = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-n faults] [-b bauds] [-r read_timeouts_ms] [-s scenarios] [-o file]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  FILE *out = stdout;
+  if(output && NULL == (out = fopen(output, "w"))) {
+    perror(output);
+    return 1;
+  }
+
+  fprintf(out, "{\n  \"benchmark\": \"rapi_fault\",\n  \"faults\": %u,\n  \"results\": [", (unsigned)count);
+
+  bool first = true;
+  for(uint32_t baud : bauds) {
+    for(uint32_t readTimeout : readTimeouts) {
+      for(const std::string &scenario : scenarios)
+      {
+        FaultMode mode = { baud, readTimeout, scenario };
+        FaultResult result = {};
+
+        FaultBench bench(mode, result);
+        if(!bench.run(count)) {
+          fprintf(stderr, "baud %u: simulator did not connect\n", (unsigned)baud);
+          return 1;
+        }
+
+        fprintf(out, "%s\n    { \"baud\": %u, \"read_timeout_ms\": %u, \"scenario\": \"%s\", "
+          "\"faults\": %u, \"missed\": %u, \"polls\": %u, "
+          "\"latency_us\": { \"p50\": %u, \"p99\": %u, \"max\": %u } }",
+          first ? "" : ",",
+          (unsigned)baud, (unsigned)readTimeout, scenario.c_str(),
+          (unsigned)result.latency.size(), (unsigned)result.missed, (unsigned)result.polls,
+          (unsigned)percentile(result.latency, 50), (unsigned)percentile(result.latency, 99),
+          result.latency.empty() ? 0U : (unsigned)*std::max_element(result.latency.begin(), result.latency.end()));
+        fflush(out);
+        first = false;
+      }
+    }
+  }
+
+  fprintf(out, "\n  ]\n}\n");
+  if(out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,404 @@
+// Fleet scale load test, N simulated chargers each with their own
+// RapiSender and OpenEVSEClass driven from one thread
+//
+// usage: rapi_fleet [-n counts] [-t ms] [-p poll_ms] [-e event_ms] [-b baud]
+//                   [-l latency_us] [-m pty|mem] [-o file]
+//   -n  comma separated fleet sizes, e.g. -n 10,100,250
+//   -m  pty: simulators on ptys served by their own thread, the links on a
+//            RapiReactor, CPU is measured for the link thread only
+//       mem: simulators are in-process Streams on the same thread, CPU
+//            includes the simulators
+//
+// Each charger polls $GS every poll interval, plus $GG, $GU, a heartbeat
+// and a current change at lower rates. Every event interval (staggered)
+// the vehicle is plugged in or unplugged, the time from the simulator
+// raising the event to the onState() callback is the event latency. A
+// poll whose $GS has not completed by the next poll is a missed deadline.
+
+#include <Arduino.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <malloc.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <openevse.h>
+
+#include "RapiReactor.h"
+#include "RapiSimulator.h"
+
+#define FLEET_CONNECT_TIMEOUT 10000
+
+struct FleetStats
+{
+  uint32_t commands;
+  uint32_t errors;
+  uint32_t polls;
+  uint32_t missed;
+  std::vector<uint32_t> eventLatency;
+};
+
+struct Charger
+{
+  // Simulator side
+  RapiSimulatorPty *pty;
+  RapiSimulator *sim;
+  RapiTimer eventTimer;
+  std::atomic<uint32_t> eventAt;
+  std::atomic<uint8_t> eventState;
+
+  // Link side
+  PosixSerialStream *port;
+  RapiSender *rapi;
+  OpenEVSEClass *evse;
+  RapiTimer pollTimer;
+  uint32_t ticks;
+  bool statusPending;
+  bool connected;
+
+  Charger() :
+    pty(nullptr), sim(nullptr), eventTimer(), eventAt(0), eventState(0),
+    port(nullptr), rapi(nullptr), evse(nullptr), pollTimer(),
+    ticks(0), statusPending(false), connected(false)
+  {
+  }
+};
+
+static uint32_t percentile(std::vector<uint32_t> &values, double p)
+{
+  if(values.empty()) {
+    return 0;
+  }
+  size_t n = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+
+static uint64_t threadCpuMicros()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void poll(Charger &c, FleetStats &stats)
+{
+  uint32_t tick = c.ticks++;
+  auto done = [&stats](int ret) {
+    if(RAPI_RESPONSE_OK == ret) {
+      stats.commands++;
+    } else {
+      stats.errors++;
+    }
+  };
+
+  stats.polls++;
+  if(c.statusPending) {
+    stats.missed++;
+  } else {
+    c.statusPending = true;
+    c.evse->getStatus([&c, &stats, done](int ret, uint8_t, uint32_t, uint8_t, uint32_t) {
+      c.statusPending = false;
+      if(RAPI_RESPONSE_OK != ret) {
+        stats.missed++;
+      }
+      done(ret);
+    });
+  }
+
+  if(0 == tick % 2) {
+    c.evse->getChargeCurrentAndVoltage([done](int ret, double, double) { done(ret); });
+  }
+  if(0 == tick % 5) {
+    c.evse->getEnergy([done](int ret, double, double) { done(ret); });
+  }
+  if(0 == tick % 10) {
+    c.evse->heartbeatPulse([done](int ret) { done(ret); });
+  }
+  if(0 == tick % 30) {
+    c.evse->setCurrentCapacity((tick / 30) % 2 ? 16 : 32, false, [done](int ret, long) { done(ret); });
+  }
+}
+
+static void toggleVehicle(Charger &c)
+{
+  RapiSimulator &sim = *c.sim;
+  bool plug = OPENEVSE_STATE_NOT_CONNECTED == sim.getState();
+  c.eventState = plug ? OPENEVSE_STATE_CHARGING : OPENEVSE_STATE_NOT_CONNECTED;
+  c.eventAt = micros() | 1;
+  if(plug) {
+    sim.plugIn();
+  } else {
+    sim.unplug();
+  }
+  if(c.pty) {
+    c.pty->kick();
+  }
+}
+
+static bool runFleet(int count, bool pty, uint32_t duration, uint32_t pollInterval,
+                     uint32_t eventInterval, uint32_t baud, uint32_t latency, FILE *out, bool first)
+{
+  std::vector<Charger> chargers(count);
+  FleetStats stats = {};
+
+  RapiReactor simReactor;
+  RapiReactor reactor;
+  RapiTimerWheel memWheel;
+  RapiTimerWheel &simWheel = pty ? simReactor.timers() : memWheel;
+  RapiTimerWheel &wheel = pty ? reactor.timers() : memWheel;
+
+  for(int i = 0; i < count; i++)
+  {
+    Charger &c = chargers[i];
+    if(pty) {
+      c.pty = new RapiSimulatorPty();
+      c.sim = &c.pty->sim();
+    } else {
+      c.sim = new RapiSimulator();
+    }
+    c.sim->setBaud(baud);
+    c.sim->setLatency(latency, latency / 2);
+    c.sim->setSeed(i + 1);
+    if(pty && !c.pty->begin(simReactor)) {
+      perror("pty");
+      return false;
+    }
+
+    c.eventTimer.setHandler([&c]() { toggleVehicle(c); });
+  }
+
+  // Link side heap use, the simulator thread allocates from its own arena
+  size_t heap = mallinfo2().uordblks;
+  for(int i = 0; i < count; i++)
+  {
+    Charger &c = chargers[i];
+    Stream *stream = c.sim;
+    if(pty) {
+      c.port = new PosixSerialStream();
+      if(!c.port->begin(c.pty->slaveName(), baud)) {
+        perror(c.pty->slaveName());
+        return false;
+      }
+      stream = c.port;
+    }
+    c.rapi = new RapiSender(stream, &wheel);
+    c.rapi->setReadTimeout(0);
+    c.evse = new OpenEVSEClass();
+    if(pty) {
+      reactor.add(*c.rapi, *c.port);
+    }
+  }
+  size_t heapPerCharger = (mallinfo2().uordblks - heap) / count;
+
+  // Staggered plug in / unplug events, started once everything connected
+  auto startEvents = [&]() {
+    for(int i = 0; i < count; i++) {
+      simWheel.schedule(chargers[i].eventTimer, (uint32_t)((uint64_t)eventInterval * (i + 1) / count), eventInterval);
+    }
+  };
+
+  // The simulator wheel belongs to the simulator thread, so that starts the
+  // events in pty mode
+  std::atomic<bool> quit(false);
+  std::atomic<bool> events(false);
+  std::thread simThread;
+  if(pty) {
+    simThread = std::thread([&]() {
+      bool started = false;
+      while(!quit) {
+        if(events && !started) {
+          startEvents();
+          started = true;
+        }
+        simReactor.runOnce(50);
+      }
+      for(Charger &c : chargers) {
+        c.eventTimer.cancel();
+      }
+    });
+  }
+
+  // Service everything until the next timer or simulator byte is due
+  auto runFor = [&](uint32_t ms, std::function<bool()> done)
+  {
+    uint32_t start = millis();
+    while(millis() - start < ms && !(done && done()))
+    {
+      if(pty) {
+        reactor.runOnce(50);
+        continue;
+      }
+
+      int32_t wait = 50000;
+      uint32_t when;
+      for(Charger &c : chargers)
+      {
+        if(c.sim->available()) {
+          c.rapi->loop();
+        }
+        if(c.sim->nextByteAt(when)) {
+          wait = std::min(wait, (int32_t)(when - micros()));
+        }
+      }
+      memWheel.loop();
+      if(memWheel.nextExpiry(when)) {
+        wait = std::min(wait, (int32_t)(when - millis()) * 1000);
+      }
+      if(wait > 0) {
+        usleep(wait);
+      }
+    }
+  };
+
+  int connected = 0;
+  for(Charger &c : chargers)
+  {
+    c.evse->onState([&c, &stats](uint8_t evse_state, uint8_t, uint32_t, uint32_t) {
+      uint32_t at = c.eventAt;
+      if(at && evse_state == c.eventState) {
+        stats.eventLatency.push_back(micros() - at);
+        c.eventAt = 0;
+      }
+    });
+    c.evse->begin(*c.rapi, [&c, &connected](bool ok) {
+      c.connected = ok;
+      connected += ok ? 1 : 0;
+    });
+  }
+  runFor(FLEET_CONNECT_TIMEOUT, [&]() { return connected == count; });
+
+  bool ok = connected == count;
+  if(ok)
+  {
+    for(int i = 0; i < count; i++)
+    {
+      Charger &c = chargers[i];
+      c.pollTimer.setHandler([&c, &stats]() { poll(c, stats); });
+      wheel.schedule(c.pollTimer, (uint32_t)((uint64_t)pollInterval * i / count), pollInterval);
+    }
+    if(pty) {
+      events = true;
+    } else {
+      startEvents();
+    }
+
+    uint64_t cpu = threadCpuMicros();
+    uint32_t start = millis();
+    runFor(duration, nullptr);
+    double seconds = (millis() - start) / 1000.0;
+    cpu = threadCpuMicros() - cpu;
+
+    for(Charger &c : chargers) {
+      c.pollTimer.cancel();
+    }
+
+    fprintf(out, "%s\n    { \"chargers\": %d, \"mode\": \"%s\", \"cpu_includes_simulator\": %s, "
+      "\"cpu_percent\": %.2f, \"cpu_us_per_sec_per_charger\": %.1f, "
+      "\"heap_bytes_per_charger\": %u, \"sizeof_sender\": %u, \"sizeof_openevse\": %u, "
+      "\"polls\": %u, \"commands\": %u, \"errors\": %u, \"missed_deadlines\": %u, "
+      "\"events\": %u, \"event_latency_us\": { \"p50\": %u, \"p99\": %u, \"max\": %u } }",
+      first ? "" : ",",
+      count, pty ? "pty" : "mem", pty ? "false" : "true",
+      cpu / seconds / 10000.0, cpu / seconds / count,
+      (unsigned)heapPerCharger, (unsigned)sizeof(RapiSender), (unsigned)sizeof(OpenEVSEClass),
+      (unsigned)stats.polls, (unsigned)stats.commands, (unsigned)stats.errors, (unsigned)stats.missed,
+      (unsigned)stats.eventLatency.size(),
+      (unsigned)percentile(stats.eventLatency, 50), (unsigned)percentile(stats.eventLatency, 99),
+      stats.eventLatency.empty() ? 0U : (unsigned)*std::max_element(stats.eventLatency.begin(), stats.eventLatency.end()));
+    fflush(out);
+  } else {
+    fprintf(stderr, "%d chargers: only %d connected\n", count, connected);
+  }
+
+  quit = true;
+  if(simThread.joinable()) {
+    simThread.join();
+  }
+
+  for(Charger &c : chargers)
+  {
+    c.eventTimer.cancel();
+    if(pty) {
+      reactor.remove(*c.rapi);
+    }
+    delete c.evse;
+    delete c.rapi;
+    delete c.port;
+    if(c.pty) {
+      delete c.pty;
+    } else {
+      delete c.sim;
+    }
+  }
+
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<int> counts = { 10, 50, 100, 250 };
+  uint32_t duration = 5000;
+  uint32_t pollInterval = 1000;
+  uint32_t eventInterval = 5000;
+  uint32_t baud = 115200;
+  uint32_t latency = 2000;
+  bool pty = true;
+  const char *output = NULL;
+
+  int opt;
+  while(-1 != (opt = getopt(argc, argv, "n:t:p:e:b:l:m:o:")))
+  {
+    switch(opt)
+    {
+      case 'n':
+        counts.clear();
+        for(char *s = strtok(optarg, ","); s; s = strtok(NULL, ",")) {
+          counts.push_back(atoi(s));
+        }
+        break;
+      case 't': duration = strtoul(optarg, NULL, 10); break;
+      case 'p': pollInterval = strtoul(optarg, NULL, 10); break;
+      case 'e': eventInterval = strtoul(optarg, NULL, 10); break;
+      case 'b': baud = strtoul(optarg, NULL, 10); break;
+      case 'l': latency = strtoul(optarg, NULL, 10); break;
+      case 'm': pty = 0 != strcmp(optarg, "mem"); break;
+      case 'o': output = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-n counts] [-t ms] [-p poll_ms] [-e event_ms] [-b baud] [-l latency_us] [-m pty|mem] [-o file]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  FILE *out = stdout;
+  if(output && NULL == (out = fopen(output, "w"))) {
+    perror(output);
+    return 1;
+  }
+
+  fprintf(out, "{\n  \"benchmark\": \"rapi_fleet\",\n  \"duration_ms\": %u, \"poll_ms\": %u, \"event_ms\": %u, "
+    "\"baud\": %u, \"latency_us\": %u,\n  \"results\": [",
+    (unsigned)duration, (unsigned)pollInterval, (unsigned)eventInterval, (unsigned)baud, (unsigned)latency);
+
+  bool first = true;
+  for(int count : counts)
+  {
+    if(count > 0 && runFleet(count, pty, duration, pollInterval, eventInterval, baud, latency, out, first)) {
+      first = false;
+    }
+  }
+
+  fprintf(out, "\n  ]\n}\n");
+  if(out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
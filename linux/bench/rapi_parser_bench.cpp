@@ -0,0 +1,172 @@
+// Microbenchmarks of the RAPI receive path: frame assembly in
+// RapiSender::_waitForResult(), _tokenize() and htou8(), in ns per frame
+//
+// usage: rapi_parser_bench [--benchmark_filter=regex] [Google Benchmark options]
+//
+// Frames are fed through RapiSender::loop() from a memory Stream with a
+// 0 read timeout, so each iteration is one complete pass of the receive
+// path as an event loop would drive it.
+
+#include <Arduino.h>
+
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include <RapiSender.h>
+
+// Not in the header, the parser's hex helper
+uint8_t htou8(const char *s);
+
+class FrameStream : public Stream
+{
+  private:
+    std::string _data;
+    size_t _pos;
+
+  public:
+    FrameStream(const std::string &data) : _data(data), _pos(data.size()) { }
+
+    // Make the frame available to read again
+    void rewind() {
+      _pos = 0;
+    }
+    size_t size() {
+      return _data.size();
+    }
+
+    int available() {
+      return _data.size() - _pos;
+    }
+    int read() {
+      return _pos < _data.size() ? (uint8_t)_data[_pos++] : -1;
+    }
+    int peek() {
+      return _pos < _data.size() ? (uint8_t)_data[_pos] : -1;
+    }
+    size_t write(uint8_t) {
+      return 1;
+    }
+    size_t write(const uint8_t *, size_t size) {
+      return size;
+    }
+    using Print::write;
+};
+
+// "$OK 01" -> "$OK 01^2F\r"
+static std::string frame(const char *body)
+{
+  uint8_t chk = 0;
+  for(const char *s = body; *s; s++) {
+    chk ^= *s;
+  }
+  char tail[8];
+  snprintf(tail, sizeof(tail), "^%02X\r", chk);
+  return std::string(body) + tail;
+}
+
+static void runFrames(benchmark::State &state, const std::string &data)
+{
+  FrameStream stream(data);
+  RapiSender rapi(&stream);
+  rapi.setReadTimeout(0);
+  rapi.setOnEvent([]() { });
+
+  for(auto _ : state)
+  {
+    stream.rewind();
+    rapi.loop();
+    benchmark::DoNotOptimize(rapi.getTokenCnt());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+static void BM_FrameOkShort(benchmark::State &state)
+{
+  runFrames(state, frame("$OK"));
+}
+BENCHMARK(BM_FrameOkShort);
+
+// $GS response
+static void BM_FrameOkStatus(benchmark::State &state)
+{
+  runFrames(state, frame("$OK 03 1234 03 0200"));
+}
+BENCHMARK(BM_FrameOkStatus);
+
+// $GV response with a sequence ID, the longest common response
+static void BM_FrameOkVersion(benchmark::State &state)
+{
+  runFrames(state, frame("$OK 7.1.3 5.1.0 :1A"));
+}
+BENCHMARK(BM_FrameOkVersion);
+
+static void BM_FrameAsyncState(benchmark::State &state)
+{
+  runFrames(state, frame("$AT 03 03 32 0200"));
+}
+BENCHMARK(BM_FrameAsyncState);
+
+static void BM_FrameBadChecksum(benchmark::State &state)
+{
+  std::string data = frame("$OK 03 1234 03 0200");
+  data[data.size() - 2] ^= 1;
+  runFrames(state, data);
+}
+BENCHMARK(BM_FrameBadChecksum);
+
+// Frame restarted by a second '$', e.g. after a dropped byte
+static void BM_FrameTruncated(benchmark::State &state)
+{
+  runFrames(state, "$OK 03 12" + frame("$OK 03 1234 03 0200"));
+}
+BENCHMARK(BM_FrameTruncated);
+
+// Line noise with no start of frame, all skipped
+static void BM_FrameNoise(benchmark::State &state)
+{
+  runFrames(state, std::string(32, '\xA5'));
+}
+BENCHMARK(BM_FrameNoise);
+
+// Longer than RAPI_BUFLEN
+static void BM_FrameOverflow(benchmark::State &state)
+{
+  runFrames(state, "$OK " + std::string(RAPI_BUFLEN, '0') + "\r");
+}
+BENCHMARK(BM_FrameOverflow);
+
+// sendCmd() to completion, with the response already waiting
+static void BM_CommandRoundTrip(benchmark::State &state)
+{
+  FrameStream stream(frame("$OK 03 1234 03 0200"));
+  RapiSender rapi(&stream);
+  rapi.setReadTimeout(0);
+
+  int result = RAPI_RESPONSE_TIMEOUT;
+  for(auto _ : state)
+  {
+    rapi.sendCmd("$GS", [&result](int ret) { result = ret; });
+    stream.rewind();
+    rapi.loop();
+    benchmark::DoNotOptimize(result);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CommandRoundTrip);
+
+static void BM_Htou8(benchmark::State &state)
+{
+  static const char *values[] = { "00", "1A", "7F", "FF", "9C", "E3", "42", "B0" };
+  size_t i = 0;
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(htou8(values[i++ & 7]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Htou8);
+
+BENCHMARK_MAIN();
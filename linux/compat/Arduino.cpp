@@ -0,0 +1,85 @@
+#include <sched.h>
+#include <errno.h>
+
+#include "Arduino.h"
+
+static uint64_t monotonicMicros()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+static const uint64_t startMicros = monotonicMicros();
+
+static bool virtualClock = false;
+static uint64_t virtualMicros = 0;
+
+static uint64_t nowMicros()
+{
+  return virtualClock ? virtualMicros : monotonicMicros() - startMicros;
+}
+
+uint32_t millis()
+{
+  return (uint32_t)(nowMicros() / 1000);
+}
+
+uint32_t micros()
+{
+  return (uint32_t)nowMicros();
+}
+
+void virtualClockBegin(uint64_t start)
+{
+  virtualMicros = start;
+  virtualClock = true;
+}
+
+void virtualClockEnd()
+{
+  virtualClock = false;
+}
+
+bool virtualClockRunning()
+{
+  return virtualClock;
+}
+
+void virtualClockAdvance(uint64_t us)
+{
+  virtualMicros += us;
+}
+
+uint64_t virtualClockMicros()
+{
+  return virtualMicros;
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  if(virtualClock) {
+    virtualMicros += us;
+    return;
+  }
+
+  struct timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+  while(-1 == nanosleep(&ts, &ts) && EINTR == errno) {
+  }
+}
+
+void delay(uint32_t ms)
+{
+  // In steps, ms * 1000 would wrap after ~71 minutes
+  while(ms > 0)
+  {
+    uint32_t step = ms < 1000000 ? ms : 1000000;
+    delayMicroseconds(step * 1000);
+    ms -= step;
+  }
+}
+
+void yield()
+{
+  sched_yield();
+}
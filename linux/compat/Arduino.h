@@ -0,0 +1,41 @@
+#ifndef __ARDUINO_COMPAT_H
+#define __ARDUINO_COMPAT_H
+
+// Minimal Arduino core for building the library natively on Linux. Only
+// the parts of the Arduino API used by the library are provided.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+// Monotonic clock, starts at 0 when the process starts and wraps like the
+// Arduino functions
+uint32_t millis();
+uint32_t micros();
+
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+// Virtual clock for discrete event simulation. While it is running
+// millis() and micros() only move when it is advanced, delay() advances it
+// rather than sleeping. Not thread safe, the whole simulation runs on one
+// thread.
+void virtualClockBegin(uint64_t start = 0);
+void virtualClockEnd();
+bool virtualClockRunning();
+void virtualClockAdvance(uint64_t us);
+uint64_t virtualClockMicros();
+
+#endif // __ARDUINO_COMPAT_H
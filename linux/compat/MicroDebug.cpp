@@ -0,0 +1,4 @@
+#define ENABLE_DEBUG
+#include "MicroDebug.h"
+
+MicroDebugPrint MicroDebug;
@@ -0,0 +1,35 @@
+#ifndef __ARDUINO_COMPAT_MICRO_DEBUG_H
+#define __ARDUINO_COMPAT_MICRO_DEBUG_H
+
+// Stand-in for the MicroDebug library, debug goes to stderr
+
+#include <stdio.h>
+
+#ifdef ENABLE_DEBUG
+
+#include "Print.h"
+
+class MicroDebugPrint : public Print
+{
+  public:
+    size_t write(uint8_t c) { return fputc(c, stderr) == EOF ? 0 : 1; }
+    size_t write(const uint8_t *buffer, size_t size) { return fwrite(buffer, 1, size, stderr); }
+};
+
+extern MicroDebugPrint MicroDebug;
+
+#define DBUG(...)       MicroDebug.print(__VA_ARGS__)
+#define DBUGLN(...)     MicroDebug.println(__VA_ARGS__)
+#define DBUGF(format, ...) MicroDebug.printf(format "\n", ##__VA_ARGS__)
+#define DBUGVAR(x, ...) do { MicroDebug.print(#x " = "); MicroDebug.println(x, ##__VA_ARGS__); } while(false)
+
+#else
+
+#define DBUG(...)
+#define DBUGLN(...)
+#define DBUGF(...)
+#define DBUGVAR(...)
+
+#endif
+
+#endif // __ARDUINO_COMPAT_MICRO_DEBUG_H
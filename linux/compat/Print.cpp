@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "Print.h"
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while(size--) {
+    if(0 == write(*buffer++)) {
+      break;
+    }
+    n++;
+  }
+  return n;
+}
+
+size_t Print::print(long value, int base)
+{
+  return print(String(value, (unsigned char)base));
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+  return print(String(value, (unsigned char)base));
+}
+
+size_t Print::print(double value, int digits)
+{
+  return print(String(value, (unsigned char)digits));
+}
+
+size_t Print::printf(const char *format, ...)
+{
+  char buffer[128];
+  va_list args;
+
+  va_start(args, format);
+  int len = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if(len < 0) {
+    return 0;
+  }
+  if((size_t)len < sizeof(buffer)) {
+    return write((const uint8_t *)buffer, len);
+  }
+
+  char *large = new char[len + 1];
+  va_start(args, format);
+  vsnprintf(large, len + 1, format, args);
+  va_end(args);
+  size_t n = write((const uint8_t *)large, len);
+  delete[] large;
+  return n;
+}
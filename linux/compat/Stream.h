@@ -0,0 +1,30 @@
+#ifndef __ARDUINO_COMPAT_STREAM_H
+#define __ARDUINO_COMPAT_STREAM_H
+
+#include "Print.h"
+
+class Stream : public Print
+{
+  protected:
+    unsigned long _timeout;
+
+    int timedRead();
+
+  public:
+    Stream() : _timeout(1000) { }
+
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    unsigned long getTimeout() { return _timeout; }
+
+    virtual size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+    size_t readBytesUntil(char terminator, char *buffer, size_t length);
+    String readString();
+    String readStringUntil(char terminator);
+};
+
+#endif // __ARDUINO_COMPAT_STREAM_H
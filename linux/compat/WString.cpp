@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <ctype.h>
+#include <algorithm>
+
+#include "WString.h"
+
+static std::string toString(unsigned long value, bool negative, unsigned char base)
+{
+  if(base < 2 || base > 36) {
+    base = 10;
+  }
+
+  char buffer[sizeof(unsigned long) * 8 + 2];
+  char *end = buffer + sizeof(buffer);
+  char *pos = end;
+  do {
+    int digit = value % base;
+    *(--pos) = digit < 10 ? '0' + digit : 'a' + digit - 10;
+    value /= base;
+  } while(value);
+
+  if(negative) {
+    *(--pos) = '-';
+  }
+
+  return std::string(pos, end - pos);
+}
+
+String::String(int value, unsigned char base) :
+  String((long)value, base)
+{
+}
+
+String::String(unsigned int value, unsigned char base) :
+  String((unsigned long)value, base)
+{
+}
+
+String::String(long value, unsigned char base) :
+  _buffer(10 == base && value < 0 ?
+            toString(-(unsigned long)value, true, base) :
+            toString((unsigned long)value, false, base))
+{
+}
+
+String::String(unsigned long value, unsigned char base) :
+  _buffer(toString(value, false, base))
+{
+}
+
+String::String(double value, unsigned char decimalPlaces)
+{
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimalPlaces, value);
+  _buffer = buffer;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+  return length() >= suffix.length() &&
+    0 == _buffer.compare(length() - suffix.length(), suffix.length(), suffix._buffer);
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+  size_t pos = _buffer.find(c, from);
+  return std::string::npos == pos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String &str, unsigned int from) const
+{
+  size_t pos = _buffer.find(str._buffer, from);
+  return std::string::npos == pos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+  if(from > to) {
+    std::swap(from, to);
+  }
+  if(from >= length()) {
+    return String();
+  }
+  return String(_buffer.substr(from, to - from));
+}
+
+void String::trim()
+{
+  size_t start = 0;
+  size_t end = _buffer.length();
+  while(start < end && isspace((unsigned char)_buffer[start])) {
+    start++;
+  }
+  while(end > start && isspace((unsigned char)_buffer[end - 1])) {
+    end--;
+  }
+  _buffer = _buffer.substr(start, end - start);
+}
+
+void String::toLowerCase()
+{
+  for(char &c : _buffer) {
+    c = tolower((unsigned char)c);
+  }
+}
+
+void String::toUpperCase()
+{
+  for(char &c : _buffer) {
+    c = toupper((unsigned char)c);
+  }
+}
+
+String operator+(const String &lhs, const String &rhs)
+{
+  String result = lhs;
+  result += rhs;
+  return result;
+}
+
+String operator+(const String &lhs, const char *rhs)
+{
+  String result = lhs;
+  result += rhs;
+  return result;
+}
+
+String operator+(const char *lhs, const String &rhs)
+{
+  String result = lhs;
+  result += rhs;
+  return result;
+}
@@ -0,0 +1,73 @@
+#ifndef __ARDUINO_COMPAT_WSTRING_H
+#define __ARDUINO_COMPAT_WSTRING_H
+
+#include <stddef.h>
+#include <string>
+
+// There is no separate flash address space, F() strings are just const char *
+class __FlashStringHelper;
+#define FPSTR(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define F(s) FPSTR(s)
+
+class String
+{
+  private:
+    std::string _buffer;
+
+  public:
+    String() { }
+    String(const char *cstr) : _buffer(cstr ? cstr : "") { }
+    String(const char *cstr, size_t length) : _buffer(cstr, length) { }
+    String(const __FlashStringHelper *str) : String(reinterpret_cast<const char *>(str)) { }
+    String(const std::string &str) : _buffer(str) { }
+    explicit String(char c) : _buffer(1, c) { }
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(double value, unsigned char decimalPlaces = 2);
+
+    const char *c_str() const { return _buffer.c_str(); }
+    unsigned int length() const { return _buffer.length(); }
+    bool reserve(unsigned int size) { _buffer.reserve(size); return true; }
+    bool isEmpty() const { return _buffer.empty(); }
+    const std::string &str() const { return _buffer; }
+
+    String &operator=(const char *cstr) { _buffer = cstr ? cstr : ""; return *this; }
+    String &operator=(const __FlashStringHelper *str) { return *this = reinterpret_cast<const char *>(str); }
+
+    bool concat(const String &str) { _buffer += str._buffer; return true; }
+    bool concat(const char *cstr) { if(cstr) { _buffer += cstr; } return true; }
+    bool concat(char c) { _buffer += c; return true; }
+    String &operator+=(const String &str) { concat(str); return *this; }
+    String &operator+=(const char *cstr) { concat(cstr); return *this; }
+    String &operator+=(char c) { concat(c); return *this; }
+
+    bool equals(const String &str) const { return _buffer == str._buffer; }
+    bool equals(const char *cstr) const { return _buffer == (cstr ? cstr : ""); }
+    bool operator==(const String &str) const { return equals(str); }
+    bool operator==(const char *cstr) const { return equals(cstr); }
+    bool operator!=(const String &str) const { return !equals(str); }
+    bool operator!=(const char *cstr) const { return !equals(cstr); }
+    bool startsWith(const String &prefix) const { return 0 == _buffer.compare(0, prefix.length(), prefix._buffer); }
+    bool endsWith(const String &suffix) const;
+
+    char charAt(unsigned int index) const { return index < length() ? _buffer[index] : '\0'; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const String &str, unsigned int from = 0) const;
+    String substring(unsigned int from) const { return substring(from, length()); }
+    String substring(unsigned int from, unsigned int to) const;
+
+    void trim();
+    void toLowerCase();
+    void toUpperCase();
+    long toInt() const { return strtol(c_str(), NULL, 10); }
+    double toFloat() const { return strtod(c_str(), NULL); }
+};
+
+String operator+(const String &lhs, const String &rhs);
+String operator+(const String &lhs, const char *rhs);
+String operator+(const char *lhs, const String &rhs);
+
+#endif // __ARDUINO_COMPAT_WSTRING_H
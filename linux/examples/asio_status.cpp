@@ -0,0 +1,86 @@
+// Poll the status of one or more chargers from a single asio io_context
+//
+// usage: asio_status device[@baud] ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <openevse.h>
+
+#include "RapiAsio.h"
+
+#define POLL_TIME (5 * 1000)
+
+struct Charger
+{
+  std::string name;
+  std::unique_ptr<RapiAsioLink> link;
+  OpenEVSEClass evse;
+  RapiTimer poll;
+};
+
+int main(int argc, char **argv)
+{
+  if(argc < 2) {
+    fprintf(stderr, "usage: %s device[@baud] ...\n", argv[0]);
+    return 1;
+  }
+
+  rapi_asio::io_context io;
+  std::vector<std::unique_ptr<Charger>> chargers;
+
+  for(int i = 1; i < argc; i++)
+  {
+    std::string device = argv[i];
+    uint32_t baud = 115200;
+    size_t at = device.find('@');
+    if(std::string::npos != at) {
+      baud = strtoul(device.c_str() + at + 1, NULL, 10);
+      device.resize(at);
+    }
+
+    Charger *charger = new Charger();
+    chargers.emplace_back(charger);
+    charger->name = device;
+    charger->link.reset(new RapiAsioLink(rapi_asio::make_strand(io)));
+    if(!charger->link->begin(device.c_str(), baud)) {
+      perror(device.c_str());
+      return 1;
+    }
+
+    charger->link->setOnError([charger](const RapiAsioErrorCode &ec) {
+      printf("%s: %s\n", charger->name.c_str(), ec.message().c_str());
+    });
+
+    charger->link->dispatch([charger]()
+    {
+      charger->evse.onState([charger](uint8_t evse_state, uint8_t pilot_state, uint32_t current_capacity, uint32_t vflags) {
+        printf("%s: state %u pilot %u capacity %uA\n", charger->name.c_str(),
+          evse_state, pilot_state, (unsigned)current_capacity);
+      });
+
+      charger->evse.begin(charger->link->sender(), [charger](bool connected, const char *firmware, const char *protocol)
+      {
+        if(!connected) {
+          printf("%s: not connected\n", charger->name.c_str());
+          return;
+        }
+        printf("%s: firmware %s protocol %s\n", charger->name.c_str(), firmware, protocol);
+
+        charger->poll.setHandler([charger]() {
+          charger->evse.getStatus([](int ret, uint8_t evse_state, uint32_t session_time, uint8_t pilot_state, uint32_t vflags) {
+          });
+        });
+        charger->link->timers().schedule(charger->poll, 0, POLL_TIME);
+      });
+    });
+  }
+
+  io.run();
+  return 0;
+}
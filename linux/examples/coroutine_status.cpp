@@ -0,0 +1,112 @@
+// Connect, set the current and poll the status as one coroutine, with the
+// coroutine frame from a static pool. Talks to the in-process simulator
+// unless given a device.
+//
+// usage: coroutine_status [-d device] [-b baud] [-n polls]
+
+#include <Arduino.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <openevse.h>
+
+#include "PosixSerialStream.h"
+#include "RapiSimulator.h"
+
+#if !OPENEVSE_ENABLE_COROUTINES
+#error "coroutine_status needs C++20 coroutines"
+#endif
+
+#define POLL_TIME   1000
+#define FRAME_BLOCK 1024
+
+alignas(max_align_t) static uint8_t frames[2 * FRAME_BLOCK];
+
+static bool finished = false;
+
+static OpenEVSETask poll(OpenEVSEFramePool &pool, OpenEVSEClass &evse, RapiSender &rapi, int count)
+{
+  OpenEVSEVersionResult version = co_await evse.connect(rapi);
+  if(RAPI_RESPONSE_OK != version.ret) {
+    printf("Not connected (%d)\n", version.ret);
+    finished = true;
+    co_return;
+  }
+  printf("Connected to %s, protocol %s\n", version.firmware, version.protocol);
+
+  OpenEVSEPilotResult pilot = co_await evse.setCurrentCapacity(16, false);
+  printf("Pilot %ldA\n", pilot.pilot);
+
+  for(int i = 0; i < count; i++)
+  {
+    OpenEVSEStatusResult status = co_await evse.status();
+    OpenEVSEEnergyResult energy = co_await evse.energy();
+    if(RAPI_RESPONSE_OK == status.ret && RAPI_RESPONSE_OK == energy.ret) {
+      printf("state %02x, session %us, %.1fWh\n", status.evse_state, (unsigned)status.session_time, energy.session_wh);
+    } else {
+      printf("Poll failed (%d/%d)\n", status.ret, energy.ret);
+    }
+
+#if OPENEVSE_ENABLE_HEARTBEAT
+    co_await evse.heartbeat();
+#endif
+    co_await evse.wait(POLL_TIME);
+  }
+
+  finished = true;
+}
+
+int main(int argc, char **argv)
+{
+  const char *device = NULL;
+  uint32_t baud = 115200;
+  int count = 5;
+
+  int opt;
+  while(-1 != (opt = getopt(argc, argv, "d:b:n:")))
+  {
+    switch(opt)
+    {
+      case 'd': device = optarg; break;
+      case 'b': baud = strtoul(optarg, NULL, 10); break;
+      case 'n': count = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-d device] [-b baud] [-n polls]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  RapiSimulator sim;
+  PosixSerialStream serial;
+  Stream *stream = &sim;
+  if(device)
+  {
+    if(!serial.begin(device, baud)) {
+      perror(device);
+      return 1;
+    }
+    stream = &serial;
+  }
+  else
+  {
+    sim.setBaud(baud);
+    sim.setLatency(2000, 1000);
+    sim.plugIn();
+  }
+
+  RapiSender rapi(stream);
+  OpenEVSEClass evse;
+  OpenEVSEFramePool pool(frames, sizeof(frames), FRAME_BLOCK);
+
+  poll(pool, evse, rapi, count);
+  while(!finished) {
+    rapi.loop();
+  }
+
+  printf("Frames: %u from the pool, %u from the heap\n",
+    (unsigned)pool.getHighWater(), (unsigned)pool.getFallbacks());
+  return 0;
+}
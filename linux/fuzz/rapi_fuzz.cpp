@@ -0,0 +1,114 @@
+// Fuzz target for the RAPI receive path: frame assembly, _tokenize() and
+// htou8(). Built as a libFuzzer target with clang, or with
+// rapi_fuzz_main.cpp as a standalone driver with gcc.
+//
+// Input: one flags byte followed by the bytes received
+//   bit 0    sequence IDs enabled, the command is sent as ID 1A
+//   bit 1    a $GS command is waiting for its reply
+//   bit 4-7  bytes delivered per loop() call - 1, 0 delivers it all
+
+#include <Arduino.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <RapiSender.h>
+
+uint8_t htou8(const char *s);
+
+#define FUZZ_SEQUENCE_ID 0x1a
+
+class FuzzStream : public Stream
+{
+  private:
+    const uint8_t *_data;
+    size_t _size;
+    size_t _pos;
+    size_t _limit;
+
+  public:
+    FuzzStream(const uint8_t *data, size_t size) :
+      _data(data), _size(size), _pos(0), _limit(0) { }
+
+    // Let up to count more bytes be read
+    void release(size_t count) {
+      _limit = count && _size - _limit > count ? _limit + count : _size;
+    }
+    bool done() {
+      return _pos >= _size;
+    }
+
+    int available() {
+      return _limit - _pos;
+    }
+    int read() {
+      return _pos < _limit ? _data[_pos++] : -1;
+    }
+    int peek() {
+      return _pos < _limit ? _data[_pos] : -1;
+    }
+    size_t write(uint8_t) {
+      return 1;
+    }
+    size_t write(const uint8_t *, size_t size) {
+      return size;
+    }
+    using Print::write;
+};
+
+static void check(RapiSender &rapi)
+{
+  if(strnlen(rapi.getResponse(), RAPI_BUFLEN) >= RAPI_BUFLEN) {
+    abort();
+  }
+
+  int count = rapi.getTokenCnt();
+  if(count < 0 || count > RAPI_MAX_TOKENS) {
+    abort();
+  }
+  for(int i = 0; i < count; i++)
+  {
+    const char *token = rapi.getToken(i);
+    if(NULL == token || strnlen(token, RAPI_BUFLEN) >= RAPI_BUFLEN) {
+      abort();
+    }
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  if(size < 1) {
+    return 0;
+  }
+
+  uint8_t flags = data[0];
+  FuzzStream stream(data + 1, size - 1);
+  RapiSender rapi(&stream);
+  rapi.setReadTimeout(0);
+  rapi.setOnEvent([&rapi]() { check(rapi); });
+
+  if(flags & 0x01) {
+    rapi.enableSequenceId(1);
+    rapi.setSequenceId(FUZZ_SEQUENCE_ID - 1);
+  }
+  if(flags & 0x02) {
+    rapi.sendCmd("$GS", [&rapi](int) { check(rapi); });
+  }
+
+  size_t chunk = flags >> 4;
+  while(!stream.done())
+  {
+    stream.release(chunk ? chunk + 1 : 0);
+    rapi.loop();
+    check(rapi);
+  }
+
+  // The hex helper on its own, it reads at most two characters
+  for(size_t i = 1; i + 1 < size; i += 2)
+  {
+    char hex[3] = { (char)data[i], (char)data[i + 1], '\0' };
+    htou8(hex);
+  }
+
+  return 0;
+}
@@ -0,0 +1,212 @@
+// Standalone driver for rapi_fuzz.cpp when libFuzzer is not available
+// (gcc). Runs every input given, files or directories of files, then
+// optionally random mutations of them.
+//
+// usage: rapi_fuzz [-runs=N] [-seed=N] [-max_len=N] corpus...
+//
+// If an input crashes it is written to crash-input to reproduce with.
+//
+// There is no coverage feedback, build with clang for real fuzzing. It is
+// still useful under ASan/UBSan to re-run a corpus or a crash reproducer.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+// Bytes the RAPI parser cares about, mutations favour them
+static const char interesting[] = "$\r^: 0123456789ABCDEFabcdef";
+
+static uint32_t seed = 1;
+static const std::string *current = NULL;
+
+static void saveCrash()
+{
+  if(current)
+  {
+    int fd = open("crash-input", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd >= 0) {
+      if(write(fd, current->data(), current->size()) < 0) { }
+      close(fd);
+    }
+    current = NULL;
+  }
+}
+
+static void onSignal(int sig)
+{
+  saveCrash();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+static void run(const std::string &input)
+{
+  current = &input;
+  LLVMFuzzerTestOneInput((const uint8_t *)input.data(), input.size());
+  current = NULL;
+}
+
+static uint32_t nextRandom()
+{
+  // xorshift32
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static bool readFile(const std::string &name, std::vector<std::string> &corpus)
+{
+  FILE *in = fopen(name.c_str(), "rb");
+  if(NULL == in) {
+    perror(name.c_str());
+    return false;
+  }
+
+  std::string data;
+  char buffer[4096];
+  size_t n;
+  while((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    data.append(buffer, n);
+  }
+  fclose(in);
+
+  corpus.push_back(data);
+  return true;
+}
+
+static bool load(const char *path, std::vector<std::string> &corpus)
+{
+  struct stat st;
+  if(stat(path, &st) < 0) {
+    perror(path);
+    return false;
+  }
+  if(!S_ISDIR(st.st_mode)) {
+    return readFile(path, corpus);
+  }
+
+  DIR *dir = opendir(path);
+  if(NULL == dir) {
+    perror(path);
+    return false;
+  }
+  for(struct dirent *entry; NULL != (entry = readdir(dir)); )
+  {
+    if('.' != entry->d_name[0]) {
+      readFile(std::string(path) + "/" + entry->d_name, corpus);
+    }
+  }
+  closedir(dir);
+  return true;
+}
+
+static void mutate(std::string &data, size_t maxLength)
+{
+  int count = 1 + nextRandom() % 4;
+  for(int i = 0; i < count; i++)
+  {
+    size_t pos = data.empty() ? 0 : nextRandom() % data.size();
+    switch(nextRandom() % 5)
+    {
+      case 0: // flip a bit
+        if(!data.empty()) {
+          data[pos] ^= 1 << (nextRandom() % 8);
+        }
+        break;
+      case 1: // random byte
+        if(!data.empty()) {
+          data[pos] = (char)nextRandom();
+        }
+        break;
+      case 2: // insert a byte the parser looks for
+        data.insert(pos, 1, interesting[nextRandom() % (sizeof(interesting) - 1)]);
+        break;
+      case 3: // delete a run
+        if(!data.empty()) {
+          data.erase(pos, 1 + nextRandom() % 8);
+        }
+        break;
+      case 4: // duplicate a run
+        if(!data.empty()) {
+          data.insert(pos, data.substr(nextRandom() % data.size(), 1 + nextRandom() % 32));
+        }
+        break;
+    }
+  }
+  if(data.size() > maxLength) {
+    data.resize(maxLength);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long runs = 0;
+  uint32_t firstSeed;
+  size_t maxLength = 4096;
+  std::vector<std::string> corpus;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if(0 == strncmp(argv[i], "-runs=", 6)) {
+      runs = strtoul(argv[i] + 6, NULL, 10);
+    } else if(0 == strncmp(argv[i], "-seed=", 6)) {
+      seed = strtoul(argv[i] + 6, NULL, 10);
+      if(0 == seed) {
+        seed = 1;
+      }
+    } else if(0 == strncmp(argv[i], "-max_len=", 9)) {
+      maxLength = strtoul(argv[i] + 9, NULL, 10);
+    } else if('-' == argv[i][0]) {
+      fprintf(stderr, "usage: %s [-runs=N] [-seed=N] [-max_len=N] corpus...\n", argv[0]);
+      return 1;
+    } else if(!load(argv[i], corpus)) {
+      return 1;
+    }
+  }
+
+  firstSeed = seed;
+  signal(SIGABRT, onSignal);
+  signal(SIGSEGV, onSignal);
+  signal(SIGBUS, onSignal);
+  signal(SIGFPE, onSignal);
+#ifdef __SANITIZE_ADDRESS__
+  __sanitizer_set_death_callback(saveCrash);
+#endif
+
+  for(const std::string &input : corpus) {
+    run(input);
+  }
+  printf("Ran %u inputs\n", (unsigned)corpus.size());
+
+  if(runs > 0)
+  {
+    if(corpus.empty()) {
+      corpus.push_back(std::string());
+    }
+    for(unsigned long i = 0; i < runs; i++)
+    {
+      std::string input = corpus[nextRandom() % corpus.size()];
+      mutate(input, maxLength);
+      run(input);
+    }
+    printf("Ran %lu mutations, seed %u\n", runs, (unsigned)firstSeed);
+  }
+
+  return 0;
+}
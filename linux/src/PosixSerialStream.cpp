@@ -0,0 +1,219 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>   // struct termios2, BOTHER
+
+#include "PosixSerialStream.h"
+
+PosixSerialStream::PosixSerialStream() :
+  _fd(-1),
+  _owner(false),
+  _rx{},
+  _head(0),
+  _count(0),
+  _error(false)
+{
+}
+
+PosixSerialStream::~PosixSerialStream()
+{
+  end();
+}
+
+bool PosixSerialStream::begin(const char *device, uint32_t baud)
+{
+  end();
+
+  int fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if(fd < 0) {
+    return false;
+  }
+
+  if(!begin(fd, true)) {
+    return false;
+  }
+
+  struct termios2 tio;
+  if(0 != ioctl(_fd, TCGETS2, &tio)) {
+    end();
+    return false;
+  }
+
+  // Raw 8N1, no flow control
+  tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF | IXANY);
+  tio.c_oflag &= ~OPOST;
+  tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+  tio.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS);
+  tio.c_cflag |= CS8 | CREAD | CLOCAL;
+  // With VMIN 0 an empty non-blocking read returns 0 rather than EAGAIN,
+  // which would look like EOF
+  tio.c_cc[VMIN] = 1;
+  tio.c_cc[VTIME] = 0;
+
+  if(0 != ioctl(_fd, TCSETS2, &tio) || !setBaud(baud)) {
+    end();
+    return false;
+  }
+
+  ioctl(_fd, TCFLSH, TCIOFLUSH);
+  return true;
+}
+
+bool PosixSerialStream::begin(int fd, bool owner)
+{
+  end();
+
+  int flags = fcntl(fd, F_GETFL);
+  if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    if(owner) {
+      close(fd);
+    }
+    return false;
+  }
+
+  _fd = fd;
+  _owner = owner;
+  _head = 0;
+  _count = 0;
+  _error = false;
+  return true;
+}
+
+void PosixSerialStream::end()
+{
+  if(_fd >= 0 && _owner) {
+    close(_fd);
+  }
+  _fd = -1;
+  _owner = false;
+  _count = 0;
+}
+
+bool PosixSerialStream::setBaud(uint32_t baud)
+{
+  struct termios2 tio;
+  if(_fd < 0 || 0 != ioctl(_fd, TCGETS2, &tio)) {
+    return false;
+  }
+
+  tio.c_cflag &= ~CBAUD;
+  tio.c_cflag |= BOTHER;
+  tio.c_ispeed = baud;
+  tio.c_ospeed = baud;
+
+  return 0 == ioctl(_fd, TCSETS2, &tio);
+}
+
+size_t PosixSerialStream::fill()
+{
+  size_t total = 0;
+  while(_fd >= 0 && _count < sizeof(_rx))
+  {
+    // Largest contiguous free space in the ring
+    size_t tail = (_head + _count) % sizeof(_rx);
+    size_t space = tail >= _head ? sizeof(_rx) - tail : _head - tail;
+
+    ssize_t n = ::read(_fd, _rx + tail, space);
+    if(n > 0) {
+      _count += n;
+      total += n;
+    } else if(0 == n) {
+      // EOF, e.g. the other end of a pty was closed
+      _error = true;
+      break;
+    } else {
+      if(EINTR == errno) {
+        continue;
+      }
+      if(EAGAIN != errno && EWOULDBLOCK != errno) {
+        _error = true;
+      }
+      break;
+    }
+  }
+
+  return total;
+}
+
+int PosixSerialStream::available()
+{
+  if(0 == _count) {
+    fill();
+  }
+  return (int)_count;
+}
+
+int PosixSerialStream::read()
+{
+  if(0 == available()) {
+    return -1;
+  }
+
+  uint8_t c = _rx[_head];
+  _head = (_head + 1) % sizeof(_rx);
+  _count--;
+  return c;
+}
+
+int PosixSerialStream::peek()
+{
+  if(0 == available()) {
+    return -1;
+  }
+  return _rx[_head];
+}
+
+size_t PosixSerialStream::readBytes(char *buffer, size_t length)
+{
+  size_t n = 0;
+  while(n < length && available() > 0)
+  {
+    size_t chunk = _count;
+    if(_head + chunk > sizeof(_rx)) {
+      chunk = sizeof(_rx) - _head;
+    }
+    if(chunk > length - n) {
+      chunk = length - n;
+    }
+    memcpy(buffer + n, _rx + _head, chunk);
+    _head = (_head + chunk) % sizeof(_rx);
+    _count -= chunk;
+    n += chunk;
+  }
+  return n;
+}
+
+size_t PosixSerialStream::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t PosixSerialStream::write(const uint8_t *buffer, size_t size)
+{
+  size_t written = 0;
+  while(_fd >= 0 && written < size)
+  {
+    ssize_t n = ::write(_fd, buffer + written, size - written);
+    if(n > 0) {
+      written += n;
+    } else if(n < 0 && EINTR == errno) {
+      continue;
+    } else if(n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+      // The kernel buffer is full, RAPI frames are short so wait for it
+      struct pollfd pfd = { _fd, POLLOUT, 0 };
+      poll(&pfd, 1, 100);
+    } else {
+      _error = true;
+      break;
+    }
+  }
+  return written;
+}
+
+void PosixSerialStream::flush()
+{
+  // Bytes are handed straight to the kernel, nothing is buffered here and
+  // waiting for the UART to drain would block the event loop
+}
@@ -0,0 +1,60 @@
+#ifndef __POSIX_SERIAL_STREAM_H
+#define __POSIX_SERIAL_STREAM_H
+
+#include <Stream.h>
+
+#ifndef POSIX_SERIAL_RX_BUFFER
+#define POSIX_SERIAL_RX_BUFFER 1024
+#endif
+
+// Stream over a serial device or pty. The fd is non-blocking, reads are
+// done in bulk in to a ring buffer by fill(), which available() calls
+// when the ring is empty, so the Stream never blocks on input.
+class PosixSerialStream : public Stream
+{
+  private:
+    int _fd;
+    bool _owner;
+    uint8_t _rx[POSIX_SERIAL_RX_BUFFER];
+    size_t _head;
+    size_t _count;
+    bool _error;
+
+  public:
+    PosixSerialStream();
+    ~PosixSerialStream();
+
+    // Open a serial device raw 8N1 at the given baud rate, any rate the
+    // UART supports is allowed, not just the standard Bxxx ones
+    bool begin(const char *device, uint32_t baud);
+    // Use an already open fd, e.g. a pty, it is made non-blocking
+    bool begin(int fd, bool owner = false);
+    void end();
+
+    bool setBaud(uint32_t baud);
+
+    int fd() {
+      return _fd;
+    }
+
+    // EOF or a read error, e.g. the device was unplugged
+    bool hasError() {
+      return _error;
+    }
+
+    // Read everything the fd has pending in to the ring buffer, returns the
+    // number of bytes read
+    size_t fill();
+
+    int available();
+    int read();
+    int peek();
+    size_t readBytes(char *buffer, size_t length);
+
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    void flush();
+};
+
+#endif // __POSIX_SERIAL_STREAM_H
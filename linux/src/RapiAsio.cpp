@@ -0,0 +1,274 @@
+#include <Arduino.h>
+
+#include <chrono>
+
+#include "RapiAsio.h"
+
+RapiAsioStream::RapiAsioStream(rapi_asio::serial_port &port) :
+  _port(port),
+  _rx{},
+  _head(0),
+  _count(0),
+  _tx(),
+  _txBusy(),
+  _onError(nullptr)
+{
+}
+
+size_t RapiAsioStream::_push(const uint8_t *data, size_t length)
+{
+  size_t n = 0;
+  while(n < length && _count < sizeof(_rx)) {
+    _rx[(_head + _count) % sizeof(_rx)] = data[n++];
+    _count++;
+  }
+  return n;
+}
+
+int RapiAsioStream::available()
+{
+  return (int)_count;
+}
+
+int RapiAsioStream::read()
+{
+  if(0 == _count) {
+    return -1;
+  }
+
+  uint8_t c = _rx[_head];
+  _head = (_head + 1) % sizeof(_rx);
+  _count--;
+  return c;
+}
+
+int RapiAsioStream::peek()
+{
+  if(0 == _count) {
+    return -1;
+  }
+  return _rx[_head];
+}
+
+size_t RapiAsioStream::write(uint8_t c)
+{
+  _tx.push_back((char)c);
+  return 1;
+}
+
+size_t RapiAsioStream::write(const uint8_t *buffer, size_t size)
+{
+  _tx.append((const char *)buffer, size);
+  return size;
+}
+
+void RapiAsioStream::flush()
+{
+  if(_txBusy.empty()) {
+    _startWrite();
+  }
+}
+
+void RapiAsioStream::_startWrite()
+{
+  if(_tx.empty() || !_port.is_open()) {
+    return;
+  }
+
+  // Anything written while this is in flight goes out in the next batch
+  _txBusy.swap(_tx);
+  rapi_asio::async_write(_port, rapi_asio::buffer(_txBusy),
+    [this](const RapiAsioErrorCode &ec, size_t) {
+      if(rapi_asio::error::operation_aborted == ec) {
+        return;
+      }
+      _txBusy.clear();
+      if(ec) {
+        _tx.clear();
+        if(_onError) {
+          _onError(ec);
+        }
+        return;
+      }
+      _startWrite();
+    });
+}
+
+RapiAsioLink::RapiAsioLink(const RapiAsioExecutor &executor) :
+  _executor(executor),
+  _handlerExecutor(executor),
+  _port(executor),
+  _timer(executor),
+  _stream(_port),
+  _timers(),
+  _sender(&_stream, &_timers),
+  _chunk{},
+  _timerArmed(false),
+  _timerDue(0),
+  _onError(nullptr)
+{
+  _sender.setReadTimeout(0);
+  _stream._onError = [this](const RapiAsioErrorCode &ec) { _error(ec); };
+}
+
+RapiAsioLink::~RapiAsioLink()
+{
+  close();
+}
+
+bool RapiAsioLink::begin(const char *device, uint32_t baud)
+{
+  RapiAsioErrorCode ec;
+  _port.open(device, ec);
+  if(ec) {
+    return false;
+  }
+
+  typedef rapi_asio::serial_port_base base;
+  _port.set_option(base::baud_rate(baud), ec);
+  if(!ec) _port.set_option(base::character_size(8), ec);
+  if(!ec) _port.set_option(base::parity(base::parity::none), ec);
+  if(!ec) _port.set_option(base::stop_bits(base::stop_bits::one), ec);
+  if(!ec) _port.set_option(base::flow_control(base::flow_control::none), ec);
+  if(ec) {
+    close();
+    return false;
+  }
+
+  _startRead();
+  return true;
+}
+
+bool RapiAsioLink::begin(int fd)
+{
+  RapiAsioErrorCode ec;
+  _port.assign(fd, ec);
+  if(ec) {
+    return false;
+  }
+
+  _startRead();
+  return true;
+}
+
+void RapiAsioLink::close()
+{
+  RapiAsioErrorCode ec;
+  _port.close(ec);
+  _timer.cancel();
+  _timerArmed = false;
+}
+
+void RapiAsioLink::_startRead()
+{
+  _port.async_read_some(rapi_asio::buffer(_chunk),
+    [this](const RapiAsioErrorCode &ec, size_t length) {
+      if(rapi_asio::error::operation_aborted == ec) {
+        return;
+      }
+      if(ec) {
+        _error(ec);
+        return;
+      }
+      _stream._push(_chunk, length);
+      _service();
+      _startRead();
+    });
+}
+
+void RapiAsioLink::_service()
+{
+  // loop() handles one frame at a time, a partial frame is kept for later
+  while(_stream.available() > 0)
+  {
+    int before = _stream.available();
+    _sender.loop();
+    if(_stream.available() >= before) {
+      break;
+    }
+  }
+
+  _rearm();
+}
+
+void RapiAsioLink::_rearm()
+{
+  uint32_t when;
+  if(!_timers.nextExpiry(when))
+  {
+    if(_timerArmed) {
+      _timer.cancel();
+      _timerArmed = false;
+    }
+    return;
+  }
+
+  // Most reads don't change the next deadline, don't restart the wait
+  if(_timerArmed && when == _timerDue) {
+    return;
+  }
+
+  int32_t due = (int32_t)(when - millis());
+  if(due < 0) {
+    due = 0;
+  }
+
+  _timerArmed = true;
+  _timerDue = when;
+  _timer.expires_after(std::chrono::milliseconds(due));
+  _timer.async_wait([this](const RapiAsioErrorCode &ec) {
+    if(rapi_asio::error::operation_aborted == ec) {
+      return;
+    }
+    _timerArmed = false;
+    _timers.loop();
+    _rearm();
+  });
+}
+
+void RapiAsioLink::_error(const RapiAsioErrorCode &ec)
+{
+  close();
+  if(_onError) {
+    _onError(ec);
+  }
+}
+
+RapiAsioResponse RapiAsioLink::_copy(RapiSender &sender, int result)
+{
+  RapiAsioResponse response;
+  response.result = result;
+  response.response = sender.getResponse();
+  for(int i = 0; i < sender.getTokenCnt(); i++) {
+    response.tokens.push_back(sender.getToken(i));
+  }
+  return response;
+}
+
+void RapiAsioLink::sendCmd(const std::string &cmd, RapiAsioHandler handler, unsigned long timeout)
+{
+  dispatch([this, cmd, handler, timeout]() {
+    _sender.sendCmd(cmd.c_str(), [this, handler](int result) {
+      if(handler) {
+        RapiAsioResponse response = _copy(_sender, result);
+        rapi_asio::post(_handlerExecutor, [handler, response]() {
+          handler(response);
+        });
+      }
+    }, timeout);
+  });
+}
+
+void RapiAsioLink::setOnEvent(RapiAsioHandler handler)
+{
+  dispatch([this, handler]() {
+    _sender.setOnEvent([this, handler]() {
+      if(handler) {
+        RapiAsioResponse response = _copy(_sender, RAPI_RESPONSE_ASYNC_EVENT);
+        rapi_asio::post(_handlerExecutor, [handler, response]() {
+          handler(response);
+        });
+      }
+    });
+  });
+}
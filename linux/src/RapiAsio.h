@@ -0,0 +1,171 @@
+#ifndef __RAPI_ASIO_H
+#define __RAPI_ASIO_H
+
+// asio adapter: runs a RapiSender on an asio executor (io_context, strand,
+// ...) so it can live inside an existing async service. Standalone asio is
+// used if available, define RAPI_ASIO_USE_BOOST to use Boost.Asio instead.
+
+// The Arduino F() macro breaks asio's templates
+#pragma push_macro("F")
+#undef F
+
+#if __has_include(<asio.hpp>) && !defined(RAPI_ASIO_USE_BOOST)
+#ifndef ASIO_STANDALONE
+#define ASIO_STANDALONE
+#endif
+#include <asio.hpp>
+namespace rapi_asio = ::asio;
+typedef std::error_code RapiAsioErrorCode;
+#else
+#include <boost/asio.hpp>
+namespace rapi_asio = boost::asio;
+typedef boost::system::error_code RapiAsioErrorCode;
+#endif
+
+#pragma pop_macro("F")
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <Stream.h>
+#include <RapiSender.h>
+#include <RapiTimer.h>
+
+#ifndef RAPI_ASIO_RX_BUFFER
+#define RAPI_ASIO_RX_BUFFER 512
+#endif
+
+#define RAPI_ASIO_READ_CHUNK 128
+
+typedef rapi_asio::any_io_executor RapiAsioExecutor;
+
+// Response or event copied out of the sender, the sender's own buffers are
+// only valid inside its callbacks
+struct RapiAsioResponse
+{
+  int result;
+  std::string response;
+  std::vector<std::string> tokens;
+};
+
+typedef std::function<void(const RapiAsioResponse &response)> RapiAsioHandler;
+typedef std::function<void(const RapiAsioErrorCode &ec)> RapiAsioErrorHandler;
+
+// Stream the sender reads and writes through. Received data is pushed in
+// by the link, writes are gathered until flush() and then sent with one
+// async_write.
+class RapiAsioStream : public Stream
+{
+  friend class RapiAsioLink;
+
+  private:
+    rapi_asio::serial_port &_port;
+    uint8_t _rx[RAPI_ASIO_RX_BUFFER];
+    size_t _head;
+    size_t _count;
+    std::string _tx;
+    std::string _txBusy;
+    RapiAsioErrorHandler _onError;
+
+    size_t _push(const uint8_t *data, size_t length);
+    void _startWrite();
+
+  public:
+    RapiAsioStream(rapi_asio::serial_port &port);
+
+    int available();
+    int read();
+    int peek();
+
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    void flush();
+};
+
+// One RAPI link. Everything, including the sender callbacks, runs on the
+// link executor; use a strand if the io_context has more than one thread.
+// The sender and timers() may only be used from that executor, from other
+// threads go through dispatch() or the sendCmd() below.
+class RapiAsioLink
+{
+  private:
+    RapiAsioExecutor _executor;
+    RapiAsioExecutor _handlerExecutor;
+    rapi_asio::serial_port _port;
+    rapi_asio::steady_timer _timer;
+    RapiAsioStream _stream;
+    RapiTimerWheel _timers;
+    RapiSender _sender;
+    uint8_t _chunk[RAPI_ASIO_READ_CHUNK];
+    bool _timerArmed;
+    uint32_t _timerDue;
+    RapiAsioErrorHandler _onError;
+
+    void _startRead();
+    void _service();
+    void _rearm();
+    void _error(const RapiAsioErrorCode &ec);
+    static RapiAsioResponse _copy(RapiSender &sender, int result);
+
+  public:
+    RapiAsioLink(const RapiAsioExecutor &executor);
+    ~RapiAsioLink();
+
+    RapiAsioLink(const RapiAsioLink &) = delete;
+    RapiAsioLink &operator=(const RapiAsioLink &) = delete;
+
+    // Open a serial device raw 8N1, or adopt an open fd (e.g. a pty)
+    bool begin(const char *device, uint32_t baud);
+    bool begin(int fd);
+    // Close the port, pending reads, writes and the timer are cancelled.
+    // Only destroy the link once it has been closed from its executor.
+    void close();
+
+    RapiAsioExecutor get_executor() {
+      return _executor;
+    }
+
+    // Executor sendCmd() and setOnEvent() handlers are posted to, defaults
+    // to the link executor
+    void setHandlerExecutor(const RapiAsioExecutor &executor) {
+      _handlerExecutor = executor;
+    }
+
+    // Called on the link executor if the port fails, e.g. USB unplugged
+    void setOnError(RapiAsioErrorHandler onError) {
+      _onError = onError;
+    }
+
+    RapiSender &sender() {
+      return _sender;
+    }
+    RapiTimerWheel &timers() {
+      return _timers;
+    }
+
+    // Run fn on the link executor, then re-arm the deadline timer for
+    // anything fn scheduled. Use this to touch sender() or timers() from
+    // outside the link's own callbacks.
+    template <typename Function>
+    void dispatch(Function fn)
+    {
+      rapi_asio::dispatch(_executor, [this, fn]() mutable {
+        fn();
+        _rearm();
+      });
+    }
+
+    // Thread safe, the handler gets a copy of the response on the handler
+    // executor
+    void sendCmd(const std::string &cmd, RapiAsioHandler handler = nullptr, unsigned long timeout = RAPI_TIMEOUT_MS);
+
+    // Async events ($ST, $AT, ...) posted to the handler executor. Replaces
+    // the sender event handler, so don't combine with OpenEVSEClass, use
+    // its own callbacks instead.
+    void setOnEvent(RapiAsioHandler handler);
+};
+
+#endif // __RAPI_ASIO_H
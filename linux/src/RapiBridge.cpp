@@ -0,0 +1,405 @@
+#include <Arduino.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "RapiBridge.h"
+
+#define RAPI_BRIDGE_LISTEN_BACKLOG 8
+#define RAPI_BRIDGE_READ_CHUNK     256
+
+// "$OK 1 2" -> "$OK 1 2 :1A^3C\r", no sequence ID if seq is -1
+static std::string frame(const std::string &body, int seq)
+{
+  char tail[12];
+  std::string out = body;
+  if(seq >= 0) {
+    snprintf(tail, sizeof(tail), " %c%02X", ESRAPI_SOS, seq);
+    out += tail;
+  }
+
+  uint8_t chk = 0;
+  for(char c : out) {
+    chk ^= (uint8_t)c;
+  }
+  snprintf(tail, sizeof(tail), "^%02X\r", chk);
+  return out + tail;
+}
+
+static int hexValue(char c)
+{
+  if(c >= '0' && c <= '9') return c - '0';
+  if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+// Remove the checksum and sequence ID from a frame body, returns false if
+// the checksum is present and wrong
+static bool unframe(std::string &body, int &seq)
+{
+  seq = -1;
+
+  size_t pos = body.rfind('^');
+  if(std::string::npos != pos)
+  {
+    uint8_t chk = 0;
+    for(size_t i = 0; i < pos; i++) {
+      chk ^= (uint8_t)body[i];
+    }
+    int hi = pos + 1 < body.size() ? hexValue(body[pos + 1]) : -1;
+    int lo = pos + 2 < body.size() ? hexValue(body[pos + 2]) : -1;
+    if(hi < 0 || lo < 0 || ((hi << 4) | lo) != chk) {
+      return false;
+    }
+    body.erase(pos);
+  }
+
+  pos = body.rfind(ESRAPI_SOS);
+  if(std::string::npos != pos && pos > 0 && ' ' == body[pos - 1] && pos + 3 == body.size())
+  {
+    int hi = hexValue(body[pos + 1]);
+    int lo = hexValue(body[pos + 2]);
+    if(hi >= 0 && lo >= 0) {
+      seq = (hi << 4) | lo;
+      body.erase(pos - 1);
+    }
+  }
+  return true;
+}
+
+RapiBridge::RapiBridge(RapiReactor &reactor, RapiSender &sender) :
+  _reactor(reactor),
+  _sender(sender),
+  _listeners(),
+  _unixPath(),
+  _clients(),
+  _nextId(1),
+  _lastServed(0),
+  _inFlight(0),
+  _onEvent(nullptr),
+  _stats()
+{
+  _sender.setOnEvent([this]() { _event(); });
+}
+
+RapiBridge::~RapiBridge()
+{
+  end();
+  _sender.setOnEvent(nullptr);
+}
+
+bool RapiBridge::_listen(int fd)
+{
+  if(0 != listen(fd, RAPI_BRIDGE_LISTEN_BACKLOG) ||
+     !_reactor.watch(fd, EPOLLIN, [this, fd](uint32_t) { _accept(fd); }))
+  {
+    close(fd);
+    return false;
+  }
+
+  _listeners.push_back(fd);
+  return true;
+}
+
+bool RapiBridge::listenTcp(const char *address, uint16_t port)
+{
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if(address && 1 != inet_pton(AF_INET, address, &addr.sin_addr)) {
+    return false;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(fd < 0) {
+    return false;
+  }
+
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if(0 != bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    close(fd);
+    return false;
+  }
+
+  return _listen(fd);
+}
+
+bool RapiBridge::listenUnix(const char *path)
+{
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if(strlen(path) >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(fd < 0) {
+    return false;
+  }
+
+  // A stale socket from a previous run
+  unlink(path);
+  if(0 != bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    close(fd);
+    return false;
+  }
+
+  _unixPath = path;
+  return _listen(fd);
+}
+
+void RapiBridge::end()
+{
+  for(int fd : _listeners) {
+    _reactor.unwatch(fd);
+    close(fd);
+  }
+  _listeners.clear();
+
+  if(!_unixPath.empty()) {
+    unlink(_unixPath.c_str());
+    _unixPath.clear();
+  }
+
+  while(!_clients.empty()) {
+    _close(_clients.front());
+  }
+}
+
+RapiBridge::Client *RapiBridge::_find(uint32_t id)
+{
+  for(Client &client : _clients) {
+    if(id == client.id) {
+      return &client;
+    }
+  }
+  return nullptr;
+}
+
+void RapiBridge::_accept(int listener)
+{
+  int fd;
+  while((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+  {
+    if(_clients.size() >= RAPI_BRIDGE_MAX_CLIENTS) {
+      close(fd);
+      continue;
+    }
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    uint32_t id = _nextId++;
+    if(!_reactor.watch(fd, EPOLLIN, [this, id](uint32_t events) { _service(id, events); })) {
+      close(fd);
+      continue;
+    }
+
+    _clients.push_back({ id, fd, std::string(), std::string(), std::deque<Request>(), true });
+    _stats.clients++;
+  }
+}
+
+void RapiBridge::_service(uint32_t id, uint32_t events)
+{
+  Client *client = _find(id);
+  if(!client) {
+    return;
+  }
+
+  if(events & EPOLLOUT) {
+    client->writable = true;
+    _reactor.modify(client->fd, EPOLLIN);
+    if(!_flush(*client)) {
+      return;
+    }
+  }
+
+  if(events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+  {
+    char buffer[RAPI_BRIDGE_READ_CHUNK];
+    ssize_t n;
+    while((n = recv(client->fd, buffer, sizeof(buffer), 0)) > 0)
+    {
+      for(ssize_t i = 0; i < n; i++)
+      {
+        char c = buffer[i];
+        if(ESRAPI_SOC == c) {
+          client->rx.assign(1, c);
+        } else if(client->rx.empty()) {
+          // Wait for the start of a frame
+        } else if(ESRAPI_EOC == c) {
+          std::string line;
+          line.swap(client->rx);
+          if(!_request(*client, line)) {
+            return;
+          }
+        } else if(client->rx.size() < RAPI_BUFLEN) {
+          client->rx += c;
+        } else {
+          client->rx.clear();
+        }
+      }
+    }
+
+    if(0 == n || (n < 0 && EAGAIN != errno && EWOULDBLOCK != errno)) {
+      _close(*client);
+      return;
+    }
+  }
+
+  _schedule();
+}
+
+bool RapiBridge::_request(Client &client, std::string &line)
+{
+  Request request;
+  request.command.swap(line);
+  bool valid = unframe(request.command, request.seq);
+
+  if(!valid || client.queue.size() >= RAPI_BRIDGE_CLIENT_QUEUE) {
+    // What the controller does with a bad checksum
+    _stats.rejected++;
+    return _send(client, frame("$NK", request.seq));
+  }
+
+  client.queue.push_back(request);
+  return true;
+}
+
+void RapiBridge::_schedule()
+{
+  while(_inFlight < RAPI_BRIDGE_DEPTH)
+  {
+    // Round robin: the next client after the last one served with a
+    // command waiting, clients are in id order
+    Client *next = nullptr;
+    for(Client &client : _clients)
+    {
+      if(client.queue.empty()) {
+        continue;
+      }
+      if(client.id > _lastServed) {
+        next = &client;
+        break;
+      }
+      if(!next) {
+        next = &client;
+      }
+    }
+    if(!next) {
+      return;
+    }
+
+    Request request = next->queue.front();
+    next->queue.pop_front();
+    _lastServed = next->id;
+    _inFlight++;
+    _stats.commands++;
+
+    uint32_t id = next->id;
+    int seq = request.seq;
+    _sender.sendCmd(request.command.c_str(), [this, id, seq](int result) {
+      _inFlight--;
+      _complete(id, seq, result);
+      _schedule();
+    });
+  }
+}
+
+void RapiBridge::_complete(uint32_t id, int seq, int result)
+{
+  if(RAPI_RESPONSE_OK != result && RAPI_RESPONSE_NK != result) {
+    // The client sees the timeout it would have on a direct link
+    _stats.unanswered++;
+    return;
+  }
+
+  Client *client = _find(id);
+  if(!client) {
+    return;
+  }
+
+  std::string body = _sender.getResponse();
+  int linkSeq;
+  unframe(body, linkSeq);
+  _send(*client, frame(body, seq));
+}
+
+void RapiBridge::_event()
+{
+  _stats.events++;
+
+  std::string body = _sender.getResponse();
+  int seq;
+  unframe(body, seq);
+  std::string event = frame(body, -1);
+
+  for(auto it = _clients.begin(); it != _clients.end(); )
+  {
+    // _send() may drop a client that is not keeping up
+    Client &client = *it++;
+    _send(client, event);
+  }
+
+  if(_onEvent) {
+    _onEvent();
+  }
+}
+
+bool RapiBridge::_send(Client &client, const std::string &data)
+{
+  if(client.tx.size() + data.size() > RAPI_BRIDGE_MAX_BACKLOG) {
+    _stats.dropped++;
+    _close(client);
+    return false;
+  }
+
+  client.tx += data;
+  return _flush(client);
+}
+
+bool RapiBridge::_flush(Client &client)
+{
+  while(client.writable && !client.tx.empty())
+  {
+    ssize_t n = send(client.fd, client.tx.data(), client.tx.size(), MSG_NOSIGNAL);
+    if(n < 0)
+    {
+      if(EAGAIN == errno || EWOULDBLOCK == errno) {
+        // Carry on when the socket has room
+        client.writable = false;
+        _reactor.modify(client.fd, EPOLLIN | EPOLLOUT);
+        return true;
+      }
+      _close(client);
+      return false;
+    }
+    client.tx.erase(0, n);
+  }
+  return true;
+}
+
+void RapiBridge::_close(Client &client)
+{
+  _reactor.unwatch(client.fd);
+  close(client.fd);
+
+  // Responses to its commands still in the sender are dropped in _complete()
+  uint32_t id = client.id;
+  _clients.remove_if([id](const Client &c) { return id == c.id; });
+}
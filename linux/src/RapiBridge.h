@@ -0,0 +1,109 @@
+#ifndef __RAPI_BRIDGE_H
+#define __RAPI_BRIDGE_H
+
+#include <stdint.h>
+#include <deque>
+#include <list>
+#include <string>
+
+#include <RapiSender.h>
+
+#include "RapiReactor.h"
+
+// Commands handed to the sender at once, one on the wire and one queued so
+// the link never idles waiting for the next client
+#ifndef RAPI_BRIDGE_DEPTH
+#define RAPI_BRIDGE_DEPTH         2
+#endif
+
+#define RAPI_BRIDGE_CLIENT_QUEUE  8    // commands per client, more get $NK
+#define RAPI_BRIDGE_MAX_BACKLOG   4096 // unsent bytes before a client is dropped
+#define RAPI_BRIDGE_MAX_CLIENTS   32
+
+struct RapiBridgeStats
+{
+  uint32_t clients;       // accepted since begin
+  uint32_t dropped;       // disconnected for not reading
+  uint32_t commands;      // forwarded to the controller
+  uint32_t rejected;      // bad checksum or client queue full
+  uint32_t unanswered;    // timed out or bad response, client sees a timeout
+  uint32_t events;        // async events fanned out
+};
+
+// Shares one RAPI link between many local clients over TCP and/or Unix
+// sockets. Clients speak plain RAPI as if they had the serial port: their
+// commands are queued per client and handed to the sender round robin,
+// the controller's sequence IDs are the sender's own and responses go back
+// with the client's ID and a new checksum. Async events go to every client.
+//
+// Everything runs on the reactor the sender was added to.
+class RapiBridge
+{
+  private:
+    struct Request {
+      std::string command;
+      int seq;
+    };
+
+    struct Client {
+      uint32_t id;
+      int fd;
+      std::string rx;
+      std::string tx;
+      std::deque<Request> queue;
+      bool writable;
+    };
+
+    RapiReactor &_reactor;
+    RapiSender &_sender;
+    std::list<int> _listeners;
+    std::string _unixPath;
+    std::list<Client> _clients;
+    uint32_t _nextId;
+    uint32_t _lastServed;
+    int _inFlight;
+    RapiEventHandler _onEvent;
+    RapiBridgeStats _stats;
+
+    bool _listen(int fd);
+    void _accept(int listener);
+    void _service(uint32_t id, uint32_t events);
+    bool _request(Client &client, std::string &line);
+    void _schedule();
+    void _complete(uint32_t id, int seq, int result);
+    void _event();
+    // false if the client had to be closed
+    bool _send(Client &client, const std::string &data);
+    bool _flush(Client &client);
+    void _close(Client &client);
+    Client *_find(uint32_t id);
+
+  public:
+    RapiBridge(RapiReactor &reactor, RapiSender &sender);
+    ~RapiBridge();
+
+    RapiBridge(const RapiBridge &) = delete;
+    RapiBridge &operator=(const RapiBridge &) = delete;
+
+    // Listen for clients, address NULL for all interfaces. Can be called
+    // more than once.
+    bool listenTcp(const char *address, uint16_t port);
+    bool listenUnix(const char *path);
+    // Close the listeners and disconnect every client
+    void end();
+
+    // The bridge takes the sender's event handler, this is called as well
+    // for local use of the events
+    void setOnEvent(RapiEventHandler onEvent) {
+      _onEvent = onEvent;
+    }
+
+    size_t getClientCount() {
+      return _clients.size();
+    }
+    const RapiBridgeStats &getStats() {
+      return _stats;
+    }
+};
+
+#endif // __RAPI_BRIDGE_H
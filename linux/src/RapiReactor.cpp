@@ -0,0 +1,187 @@
+#include <Arduino.h>
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+
+#include "RapiReactor.h"
+
+#define RAPI_REACTOR_MAX_EVENTS 64
+
+RapiReactor::RapiReactor() :
+  _epoll(epoll_create1(EPOLL_CLOEXEC)),
+  _running(false),
+  _timers(),
+  _watches()
+{
+}
+
+RapiReactor::~RapiReactor()
+{
+  if(_epoll >= 0) {
+    close(_epoll);
+  }
+}
+
+RapiReactor::Watch *RapiReactor::_find(int fd)
+{
+  for(Watch &watch : _watches) {
+    if(fd == watch.fd) {
+      return &watch;
+    }
+  }
+  return nullptr;
+}
+
+bool RapiReactor::watch(int fd, uint32_t events, RapiReactorHandler handler)
+{
+  if(_find(fd)) {
+    return false;
+  }
+
+  _watches.push_back({ fd, handler, nullptr, nullptr });
+  Watch &watch = _watches.back();
+
+  struct epoll_event ev = {};
+  ev.events = events;
+  ev.data.ptr = &watch;
+  if(0 != epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev)) {
+    _watches.pop_back();
+    return false;
+  }
+
+  return true;
+}
+
+bool RapiReactor::modify(int fd, uint32_t events)
+{
+  Watch *watch = _find(fd);
+  if(!watch) {
+    return false;
+  }
+
+  struct epoll_event ev = {};
+  ev.events = events;
+  ev.data.ptr = watch;
+  return 0 == epoll_ctl(_epoll, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void RapiReactor::unwatch(int fd)
+{
+  for(auto it = _watches.begin(); it != _watches.end(); ++it)
+  {
+    if(fd == it->fd)
+    {
+      epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+      // Events for this fd may still be pending in the current batch
+      it->fd = -1;
+      it->handler = nullptr;
+      it->sender = nullptr;
+      it->stream = nullptr;
+      return;
+    }
+  }
+}
+
+bool RapiReactor::add(RapiSender &sender, PosixSerialStream &stream, RapiReactorHandler onError)
+{
+  if(!watch(stream.fd(), EPOLLIN, onError)) {
+    return false;
+  }
+
+  Watch &watch = _watches.back();
+  watch.sender = &sender;
+  watch.stream = &stream;
+
+  sender.setStream(&stream);
+  sender.setTimerWheel(&_timers);
+  sender.setReadTimeout(0);
+  return true;
+}
+
+void RapiReactor::remove(RapiSender &sender)
+{
+  for(Watch &watch : _watches) {
+    if(&sender == watch.sender) {
+      unwatch(watch.fd);
+      return;
+    }
+  }
+}
+
+void RapiReactor::_serviceLink(Watch &watch)
+{
+  PosixSerialStream *stream = watch.stream;
+  RapiSender *sender = watch.sender;
+
+  stream->fill();
+  // loop() handles one frame at a time, a partial frame is kept for later
+  while(watch.sender && stream->available() > 0)
+  {
+    int before = stream->available();
+    sender->loop();
+    if(stream->available() >= before) {
+      break;
+    }
+  }
+
+  if(watch.sender && stream->hasError())
+  {
+    RapiReactorHandler onError = watch.handler;
+    unwatch(watch.fd);
+    if(onError) {
+      onError(EPOLLERR);
+    }
+  }
+}
+
+bool RapiReactor::runOnce(int max_wait)
+{
+  _timers.loop();
+
+  int timeout = max_wait;
+  uint32_t next;
+  if(_timers.nextExpiry(next))
+  {
+    int32_t due = (int32_t)(next - millis());
+    if(due < 0) {
+      due = 0;
+    }
+    if(timeout < 0 || due < timeout) {
+      timeout = due;
+    }
+  }
+
+  struct epoll_event events[RAPI_REACTOR_MAX_EVENTS];
+  int count = epoll_wait(_epoll, events, RAPI_REACTOR_MAX_EVENTS, timeout);
+  if(count < 0) {
+    return EINTR == errno;
+  }
+
+  for(int i = 0; i < count; i++)
+  {
+    Watch &watch = *(Watch *)events[i].data.ptr;
+    if(watch.fd < 0) {
+      continue;
+    }
+
+    if(watch.sender) {
+      _serviceLink(watch);
+    } else if(watch.handler) {
+      watch.handler(events[i].events);
+    }
+  }
+
+  // Drop the watches removed while dispatching
+  _watches.remove_if([](const Watch &watch) { return watch.fd < 0; });
+
+  _timers.loop();
+  return true;
+}
+
+void RapiReactor::run()
+{
+  _running = true;
+  while(_running && runOnce()) {
+  }
+}
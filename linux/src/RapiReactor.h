@@ -0,0 +1,67 @@
+#ifndef __RAPI_REACTOR_H
+#define __RAPI_REACTOR_H
+
+#include <stdint.h>
+#include <functional>
+#include <list>
+
+#include <RapiSender.h>
+#include <RapiTimer.h>
+
+#include "PosixSerialStream.h"
+
+typedef std::function<void(uint32_t events)> RapiReactorHandler;
+
+// Single threaded epoll event loop for any number of RAPI links. Each
+// RapiSender is only run when its fd is readable or one of the reactor
+// timers (command timeouts, polls, ...) is due, nothing busy-polls.
+class RapiReactor
+{
+  private:
+    struct Watch {
+      int fd;
+      RapiReactorHandler handler;
+      RapiSender *sender;
+      PosixSerialStream *stream;
+    };
+
+    int _epoll;
+    bool _running;
+    RapiTimerWheel _timers;
+    std::list<Watch> _watches;
+
+    Watch *_find(int fd);
+    void _serviceLink(Watch &watch);
+
+  public:
+    RapiReactor();
+    ~RapiReactor();
+
+    RapiReactor(const RapiReactor &) = delete;
+    RapiReactor &operator=(const RapiReactor &) = delete;
+
+    // Run sender on this reactor. The sender is switched to non-blocking
+    // reads and to the reactor timer wheel, so add it before sending any
+    // commands. onError is called if the stream hits EOF or an error.
+    bool add(RapiSender &sender, PosixSerialStream &stream, RapiReactorHandler onError = nullptr);
+    void remove(RapiSender &sender);
+
+    // Watch any other fd, handler gets the EPOLLxxx events
+    bool watch(int fd, uint32_t events, RapiReactorHandler handler);
+    bool modify(int fd, uint32_t events);
+    void unwatch(int fd);
+
+    RapiTimerWheel &timers() {
+      return _timers;
+    }
+
+    // Wait for and dispatch events, at most max_wait ms (-1 for no limit
+    // other than the next timer). Returns false on an epoll error.
+    bool runOnce(int max_wait = -1);
+    void run();
+    void stop() {
+      _running = false;
+    }
+};
+
+#endif // __RAPI_REACTOR_H
@@ -0,0 +1,155 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <Arduino.h>
+
+#include "RapiReplay.h"
+
+RapiReplayStream::RapiReplayStream() :
+  _header(),
+  _duration(0),
+  _realTime(true),
+  _base(0),
+  _next(0),
+  _released(0),
+  _readPos(0),
+  _written(0),
+  _mismatches(0)
+{
+}
+
+bool RapiReplayStream::begin(const void *data, size_t size)
+{
+  RapiCaptureReader reader;
+  if(!reader.begin(data, size)) {
+    return false;
+  }
+
+  _header = reader.header();
+  _tx.clear();
+  _rx.clear();
+  _chunks.clear();
+  _duration = 0;
+
+  // Time each TX byte was sent, to time the commands
+  std::vector<uint32_t> txTimes;
+
+  RapiCaptureRecord record;
+  while(reader.next(record))
+  {
+    if(record.tx) {
+      _tx.append((const char *)record.data, record.length);
+      txTimes.insert(txTimes.end(), record.length, record.time);
+    } else {
+      _rx.append((const char *)record.data, record.length);
+      _chunks.push_back({ record.time, _tx.size(), _rx.size() });
+    }
+    _duration = record.time;
+  }
+  if(!reader.atEnd()) {
+    return false;
+  }
+
+  _parseCommands(txTimes);
+  restart();
+  return true;
+}
+
+void RapiReplayStream::_parseCommands(const std::vector<uint32_t> &txTimes)
+{
+  _commands.clear();
+
+  size_t start = std::string::npos;
+  for(size_t i = 0; i < _tx.size(); i++)
+  {
+    if('$' == _tx[i]) {
+      start = i;
+    } else if('\r' == _tx[i] && std::string::npos != start) {
+      RapiReplayCommand command = { txTimes[start], _tx.substr(start, i - start), -1 };
+
+      size_t pos = command.command.rfind('^');
+      if(std::string::npos != pos) {
+        command.command.erase(pos);
+      }
+      pos = command.command.rfind(" :");
+      if(std::string::npos != pos) {
+        command.seq = strtol(command.command.c_str() + pos + 2, NULL, 16);
+        command.command.erase(pos);
+      }
+
+      _commands.push_back(command);
+      start = std::string::npos;
+    }
+  }
+}
+
+void RapiReplayStream::restart()
+{
+  _base = micros();
+  _next = 0;
+  _released = 0;
+  _readPos = 0;
+  _written = 0;
+  _mismatches = 0;
+}
+
+void RapiReplayStream::_release()
+{
+  uint32_t now = micros();
+  while(_next < _chunks.size())
+  {
+    const Chunk &chunk = _chunks[_next];
+    if(_written < chunk.txBefore ||
+       (_realTime && (int32_t)(now - (_base + chunk.time)) < 0))
+    {
+      break;
+    }
+    _released = chunk.end;
+    _next++;
+  }
+}
+
+int RapiReplayStream::available()
+{
+  _release();
+  return _released - _readPos;
+}
+
+int RapiReplayStream::read()
+{
+  if(_readPos >= _released) {
+    _release();
+    if(_readPos >= _released) {
+      return -1;
+    }
+  }
+  return (uint8_t)_rx[_readPos++];
+}
+
+int RapiReplayStream::peek()
+{
+  if(_readPos >= _released) {
+    _release();
+    if(_readPos >= _released) {
+      return -1;
+    }
+  }
+  return (uint8_t)_rx[_readPos];
+}
+
+size_t RapiReplayStream::write(uint8_t c)
+{
+  if(_written >= _tx.size() || (uint8_t)_tx[_written] != c) {
+    _mismatches++;
+  }
+  _written++;
+  return 1;
+}
+
+size_t RapiReplayStream::write(const uint8_t *buffer, size_t size)
+{
+  for(size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+  return size;
+}
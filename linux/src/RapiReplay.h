@@ -0,0 +1,110 @@
+#ifndef __RAPI_REPLAY_H
+#define __RAPI_REPLAY_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <Stream.h>
+#include <RapiCapture.h>
+
+// A command sent in a capture, see RapiReplayStream::commands()
+struct RapiReplayCommand
+{
+  uint32_t time;        // micros() since the start of the capture
+  std::string command;  // e.g. "$SC 16", checksum and sequence ID removed
+  int seq;              // sequence ID, -1 if none
+};
+
+// Plays the received side of a RapiCaptureStream capture back to a
+// RapiSender. The sender writes its commands as usual, each received
+// record is held back until the sender has written everything that was
+// sent before it in the capture, so responses never overtake their
+// commands. In real time mode it is also held until its original time
+// relative to restart(), otherwise it is released as soon as possible.
+//
+// What is written is compared with the captured TX bytes, a parser or
+// queue change that sends something different shows up in
+// getMismatches().
+class RapiReplayStream : public Stream
+{
+  private:
+    struct Chunk {
+      uint32_t time;
+      size_t txBefore;
+      size_t end;       // offset in _rx just after this chunk
+    };
+
+    RapiCaptureHeader _header;
+    std::string _tx;
+    std::string _rx;
+    std::vector<Chunk> _chunks;
+    std::vector<RapiReplayCommand> _commands;
+    uint32_t _duration;
+
+    bool _realTime;
+    uint32_t _base;
+    size_t _next;
+    size_t _released;
+    size_t _readPos;
+    size_t _written;
+    uint32_t _mismatches;
+
+    void _release();
+    void _parseCommands(const std::vector<uint32_t> &txTimes);
+
+  public:
+    RapiReplayStream();
+
+    // Load a capture, false if it is not one. The data is copied.
+    bool begin(const void *data, size_t size);
+    // Start again from the beginning, real time is relative to now
+    void restart();
+    void setRealTime(bool realTime) {
+      _realTime = realTime;
+    }
+
+    const RapiCaptureHeader &header() {
+      return _header;
+    }
+    // Commands found in the captured TX bytes, in order
+    const std::vector<RapiReplayCommand> &commands() {
+      return _commands;
+    }
+    // Time of the last record
+    uint32_t getDuration() {
+      return _duration;
+    }
+    // micros() restart() was called
+    uint32_t getBase() {
+      return _base;
+    }
+
+    // Everything received in the capture has been read
+    bool done() {
+      return _readPos >= _rx.size();
+    }
+    size_t getRxSize() {
+      return _rx.size();
+    }
+    size_t getTxSize() {
+      return _tx.size();
+    }
+    size_t getWritten() {
+      return _written;
+    }
+    // Written bytes that differ from, or go beyond, the captured TX
+    uint32_t getMismatches() {
+      return _mismatches;
+    }
+
+    // Stream
+    int available();
+    int read();
+    int peek();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+};
+
+#endif // __RAPI_REPLAY_H
@@ -0,0 +1,138 @@
+#include <Arduino.h>
+
+#include "RapiSimulation.h"
+
+RapiSimulation::RapiSimulation() :
+  _timers(),
+  _links(),
+  _steps(0),
+  _running(false)
+{
+}
+
+RapiSimulation::~RapiSimulation()
+{
+  end();
+}
+
+void RapiSimulation::begin(uint64_t start)
+{
+  virtualClockBegin(start);
+}
+
+void RapiSimulation::end()
+{
+  if(virtualClockRunning()) {
+    virtualClockEnd();
+  }
+}
+
+void RapiSimulation::add(RapiSender &sender, RapiSimulator &sim)
+{
+  // A blocking read would spin forever, the clock does not move on its own
+  sender.setTimerWheel(&_timers);
+  sender.setReadTimeout(0);
+  _links.push_back({ &sender, &sim });
+}
+
+uint64_t RapiSimulation::now()
+{
+  return virtualClockMicros();
+}
+
+// Handle everything due now, returns true if anything was
+bool RapiSimulation::_settle()
+{
+  bool worked = false;
+  bool busy = true;
+  while(busy)
+  {
+    busy = false;
+    uint32_t active = _timers.active();
+    _timers.loop();
+    for(Link &link : _links)
+    {
+      while(link.sim->available() > 0) {
+        link.sender->loop();
+        busy = true;
+      }
+    }
+    // Handlers that re-arm for now are picked up by the next pass
+    if(active != _timers.active()) {
+      busy = true;
+    }
+    worked |= busy;
+  }
+  return worked;
+}
+
+// When the next thing can happen, false if nothing is left
+bool RapiSimulation::_next(uint64_t &when)
+{
+  uint64_t current = now();
+  bool found = false;
+  uint32_t at;
+
+  if(_timers.nextExpiry(at))
+  {
+    int32_t due = (int32_t)(at - millis());
+    when = due > 0 ? (current / 1000 + due) * 1000 : current;
+    found = true;
+  }
+
+  for(Link &link : _links)
+  {
+    if(link.sim->nextByteAt(at))
+    {
+      int32_t due = (int32_t)(at - micros());
+      uint64_t byteAt = due > 0 ? current + due : current;
+      if(!found || byteAt < when) {
+        when = byteAt;
+      }
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+bool RapiSimulation::runUntil(uint64_t until)
+{
+  _running = true;
+  while(_running)
+  {
+    bool worked = _settle();
+
+    uint64_t current = now();
+    uint64_t next;
+    if(!_next(next))
+    {
+      if(until > current) {
+        virtualClockAdvance(until - current);
+      }
+      return false;
+    }
+
+    if(next <= current)
+    {
+      if(worked) {
+        continue;
+      }
+      // A lower bound from the wheel that is not due yet
+      next = (current / 1000 + 1) * 1000;
+    }
+    if(next > until)
+    {
+      if(until > current) {
+        virtualClockAdvance(until - current);
+      }
+      break;
+    }
+
+    virtualClockAdvance(next - current);
+    _steps++;
+  }
+
+  _settle();
+  return true;
+}
@@ -0,0 +1,75 @@
+#ifndef __RAPI_SIMULATION_H
+#define __RAPI_SIMULATION_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <RapiSender.h>
+#include <RapiTimer.h>
+
+#include "RapiSimulator.h"
+
+// Discrete event simulation of RAPI links on the virtual clock: senders
+// talk to in-process RapiSimulators and, rather than waiting in real time,
+// the clock jumps to the next thing that can happen, the next byte on any
+// link or the next timer on the wheel. Scenario events (vehicles arriving,
+// control decisions) are just RapiTimers on the same wheel.
+//
+// Everything must share the wheel, add() moves the senders on to it and
+// makes them non-blocking, schedule scenario events on timers(). Runs are
+// reproducible as long as the simulators are seeded and nothing reads the
+// real clock.
+class RapiSimulation
+{
+  private:
+    struct Link {
+      RapiSender *sender;
+      RapiSimulator *sim;
+    };
+
+    RapiTimerWheel _timers;
+    std::vector<Link> _links;
+    uint64_t _steps;
+    bool _running;
+
+    bool _settle();
+    bool _next(uint64_t &when);
+
+  public:
+    RapiSimulation();
+    ~RapiSimulation();
+
+    RapiSimulation(const RapiSimulation &) = delete;
+    RapiSimulation &operator=(const RapiSimulation &) = delete;
+
+    // Switch millis()/micros() to the virtual clock, starting at start us
+    void begin(uint64_t start = 0);
+    // Back to the real clock
+    void end();
+
+    void add(RapiSender &sender, RapiSimulator &sim);
+
+    RapiTimerWheel &timers() {
+      return _timers;
+    }
+
+    // Run until the clock reaches until (virtual us) or stop() is called.
+    // Returns false if there was nothing left to happen.
+    bool runUntil(uint64_t until);
+    bool runFor(uint64_t duration) {
+      return runUntil(now() + duration);
+    }
+    // From a timer or callback, return from runUntil() once it is handled
+    void stop() {
+      _running = false;
+    }
+
+    uint64_t now();
+
+    // Times the clock was moved on
+    uint64_t getSteps() {
+      return _steps;
+    }
+};
+
+#endif // __RAPI_SIMULATION_H
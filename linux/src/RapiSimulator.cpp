@@ -0,0 +1,650 @@
+#include <Arduino.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/epoll.h>
+
+#include <openevse.h>
+
+#include "RapiSimulator.h"
+#include "RapiReactor.h"
+
+// Magic cookie acknowledging a missed heartbeat, see OpenEVSEClass::heartbeatPulse()
+#define RAPI_SIMULATOR_HEARTBEAT_ACK 165
+
+RapiSimulator::RapiSimulator() :
+  _in(),
+  _out(),
+  _latency(0),
+  _jitter(0),
+  _byteTime(0),
+  _lineFree(0),
+  _seed(1),
+  _legacy(false),
+  _d9(false),
+  _firmware(RAPI_SIMULATOR_FIRMWARE),
+  _protocol(RAPI_SIMULATOR_PROTOCOL),
+  _evseState(OPENEVSE_STATE_NOT_CONNECTED),
+  _pilotState(OPENEVSE_STATE_NOT_CONNECTED),
+  _reportedState(OPENEVSE_STATE_NOT_CONNECTED),
+  _vflags(OPENEVSE_VFLAG_SESSION_ENDED),
+  _vehicle(false),
+  _pilot(RAPI_SIMULATOR_MAX_CURRENT),
+  _maxCurrent(RAPI_SIMULATOR_MAX_CURRENT),
+  _sessionStart(0),
+  _lastUpdate(millis()),
+  _sessionWattSeconds(0),
+  _totalWattHours(0),
+  _gfiCount(0),
+  _noGndCount(0),
+  _stuckCount(0),
+  _hbInterval(0),
+  _hbCurrent(0),
+  _hbTriggered(0),
+  _hbLastPulse(0),
+  _lcd{},
+  _commands(0),
+  _eventAt(0),
+  _armedFault(-1),
+  _armedWhen(RAPI_SIMULATOR_FAULT_NOW)
+{
+  _lineFree = micros();
+}
+
+void RapiSimulator::setLatency(uint32_t latency, uint32_t jitter)
+{
+  _latency = latency;
+  _jitter = jitter;
+}
+
+void RapiSimulator::setBaud(uint32_t baud)
+{
+  // 8N1, 10 bits per byte
+  _byteTime = baud > 0 ? (10000000UL + baud - 1) / baud : 0;
+}
+
+void RapiSimulator::setVersion(const char *firmware, const char *protocol)
+{
+  _firmware = firmware;
+  _protocol = protocol;
+}
+
+void RapiSimulator::setLegacy(bool legacy)
+{
+  _legacy = legacy;
+  if(legacy) {
+    setVersion(RAPI_SIMULATOR_LEGACY_FIRMWARE, RAPI_SIMULATOR_LEGACY_PROTOCOL);
+  } else {
+    setVersion(RAPI_SIMULATOR_FIRMWARE, RAPI_SIMULATOR_PROTOCOL);
+  }
+}
+
+uint32_t RapiSimulator::_random()
+{
+  // xorshift32, reproducible for a given seed
+  _seed ^= _seed << 13;
+  _seed ^= _seed >> 17;
+  _seed ^= _seed << 5;
+  return _seed;
+}
+
+void RapiSimulator::_update(uint32_t now)
+{
+  uint32_t elapsed = now - _lastUpdate;
+  _lastUpdate = now;
+
+  if(_charging())
+  {
+    double watts = (double)_pilot * (RAPI_SIMULATOR_VOLTS / 1000.0);
+    double ws = watts * elapsed / 1000.0;
+    _sessionWattSeconds += ws;
+    _totalWattHours += ws / 3600.0;
+  }
+
+  if(_hbInterval > 0 && 2 != _hbTriggered &&
+     now - _hbLastPulse > _hbInterval * 1000UL)
+  {
+    // Missed heartbeat, fall back to the heartbeat current
+    _hbTriggered = 2;
+    if(_hbCurrent < _pilot) {
+      _pilot = _hbCurrent;
+      _stateChanged();
+    }
+  }
+}
+
+void RapiSimulator::_send(uint32_t ready, const char *body, int seq)
+{
+  char frame[RAPI_SIMULATOR_MAX_TOKENS * 16];
+  int len = snprintf(frame, sizeof(frame) - 8, "%s", body);
+  if(seq >= 0) {
+    len += snprintf(frame + len, sizeof(frame) - 8 - len, " :%02X", seq);
+  }
+
+  uint8_t chk = 0;
+  for(int i = 0; i < len; i++) {
+    chk ^= frame[i];
+  }
+  sprintf(frame + len, "^%02X\r", chk);
+
+  // The line is FIFO, a frame can't start before the previous one is out
+  Frame out = { ready, frame, 0 };
+  if((int32_t)(_lineFree - ready) > 0) {
+    out.start = _lineFree;
+  }
+  _lineFree = out.start + out.data.size() * _byteTime;
+  _out.push_back(out);
+}
+
+void RapiSimulator::_reply(uint32_t ready, bool ok, const char *args, int seq)
+{
+  char body[RAPI_SIMULATOR_MAX_TOKENS * 12];
+  snprintf(body, sizeof(body), "%s%s%s", ok ? "$OK" : "$NK", args ? " " : "", args ? args : "");
+  _send(ready, body, seq);
+}
+
+void RapiSimulator::sendEvent(const char *body)
+{
+  _send(micros(), body, -1);
+  _eventAt = _out.back().start;
+}
+
+void RapiSimulator::_stateChanged()
+{
+  char event[48];
+  if(_legacy) {
+    // Only the EVSE state is reported, not capacity or flag changes
+    if(_evseState == _reportedState) {
+      return;
+    }
+    snprintf(event, sizeof(event), "$ST %02x", _evseState);
+  } else {
+    snprintf(event, sizeof(event), "$AT %02x %02x %u %04x",
+      _evseState, _pilotState, (unsigned)_pilot, (unsigned)_vflags);
+  }
+  _reportedState = _evseState;
+  sendEvent(event);
+}
+
+void RapiSimulator::setState(uint8_t evse_state, uint8_t pilot_state)
+{
+  _update(millis());
+
+  if(OPENEVSE_STATE_CHARGING == evse_state && !_charging()) {
+    _sessionStart = millis();
+  }
+  _evseState = evse_state;
+  _pilotState = pilot_state;
+
+  if(_charging()) {
+    _vflags |= OPENEVSE_VFLAG_CHARGING_ON;
+  } else {
+    _vflags &= ~OPENEVSE_VFLAG_CHARGING_ON;
+  }
+
+  _stateChanged();
+}
+
+void RapiSimulator::boot(uint8_t post_code)
+{
+  _evseState = OPENEVSE_STATE_STARTING;
+  _sessionWattSeconds = 0;
+  _hbInterval = 0;
+  _hbTriggered = 0;
+
+  char event[48];
+  snprintf(event, sizeof(event), "$AB %02x %s", post_code, _firmware.c_str());
+  sendEvent(event);
+
+  if(_vehicle) {
+    setState(OPENEVSE_STATE_CONNECTED, OPENEVSE_STATE_CONNECTED);
+  } else {
+    setState(OPENEVSE_STATE_NOT_CONNECTED, OPENEVSE_STATE_NOT_CONNECTED);
+  }
+}
+
+void RapiSimulator::plugIn(bool charge)
+{
+  _vehicle = true;
+  _sessionWattSeconds = 0;
+  _vflags |= OPENEVSE_VFLAG_EV_CONNECTED;
+  _vflags &= ~OPENEVSE_VFLAG_SESSION_ENDED;
+
+  // Sleeping, disabled or in fault the EVSE doesn't start charging
+  if(_evseState <= OPENEVSE_STATE_CHARGING)
+  {
+    uint8_t state = charge ? OPENEVSE_STATE_CHARGING : OPENEVSE_STATE_CONNECTED;
+    setState(state, state);
+  }
+}
+
+void RapiSimulator::unplug()
+{
+  _vehicle = false;
+  _vflags &= ~OPENEVSE_VFLAG_EV_CONNECTED;
+  _vflags |= OPENEVSE_VFLAG_SESSION_ENDED;
+
+  if(_evseState <= OPENEVSE_STATE_CHARGING) {
+    setState(OPENEVSE_STATE_NOT_CONNECTED, OPENEVSE_STATE_NOT_CONNECTED);
+  }
+}
+
+void RapiSimulator::fault(uint8_t evse_state)
+{
+  switch(evse_state)
+  {
+    case OPENEVSE_STATE_GFI_FAULT:
+      _gfiCount++;
+      _vflags |= OPENEVSE_VFLAG_GFI_TRIPPED;
+      break;
+    case OPENEVSE_STATE_NO_EARTH_GROUND:
+      _noGndCount++;
+      _vflags |= OPENEVSE_VFLAG_NOGND_TRIPPED;
+      break;
+    case OPENEVSE_STATE_STUCK_RELAY:
+      _stuckCount++;
+      break;
+  }
+
+  setState(evse_state, _pilotState);
+}
+
+void RapiSimulator::armFault(uint8_t evse_state, uint8_t when)
+{
+  if(RAPI_SIMULATOR_FAULT_NOW == when) {
+    fault(evse_state);
+    return;
+  }
+  _armedFault = evse_state;
+  _armedWhen = when;
+}
+
+void RapiSimulator::_fireFault()
+{
+  uint8_t state = (uint8_t)_armedFault;
+  _armedFault = -1;
+  fault(state);
+}
+
+void RapiSimulator::_command(char *line)
+{
+  uint32_t now = micros();
+  size_t len = strlen(line);
+
+  _commands++;
+  _update(millis());
+
+  if(_armedFault >= 0 && RAPI_SIMULATOR_FAULT_NEXT_COMMAND == _armedWhen) {
+    _fireFault();
+  }
+
+  // Command transfer time, processing time, then the reply goes out
+  uint32_t ready = now + (len + 1) * _byteTime + _latency;
+  if(_jitter > 0) {
+    ready += _random() % (_jitter + 1);
+  }
+
+  // Checksum is optional, if given it has to be right
+  char *chk = strchr(line, '^');
+  if(chk)
+  {
+    uint8_t sum = 0;
+    for(char *s = line; s < chk; s++) {
+      sum ^= *s;
+    }
+    if(sum != (uint8_t)strtoul(chk + 1, NULL, 16)) {
+      _reply(ready, false, NULL, -1);
+      return;
+    }
+    *chk = '\0';
+  }
+
+  int seq = -1;
+  char *sos = strstr(line, " :");
+  if(sos) {
+    seq = (int)strtoul(sos + 2, NULL, 16);
+    *sos = '\0';
+  }
+
+  // Keep the raw arguments for $FP, the text may contain spaces
+  char *rest = strchr(line, ' ');
+  rest = rest ? rest + 1 : line + strlen(line);
+
+  char *tokens[RAPI_SIMULATOR_MAX_TOKENS];
+  char argsCopy[RAPI_SIMULATOR_MAX_TOKENS * 16];
+  snprintf(argsCopy, sizeof(argsCopy), "%s", line);
+  int count = 0;
+  for(char *tok = strtok(argsCopy, " "); tok && count < RAPI_SIMULATOR_MAX_TOKENS; tok = strtok(NULL, " ")) {
+    tokens[count++] = tok;
+  }
+  if(0 == count || '$' != tokens[0][0] || 3 != strlen(tokens[0])) {
+    _reply(ready, false, NULL, seq);
+    return;
+  }
+
+  const char *cmd = tokens[0] + 1;
+  char args[RAPI_SIMULATOR_MAX_TOKENS * 12];
+  args[0] = '\0';
+  bool ok = true;
+
+  if(!strcmp(cmd, "GV")) {
+    snprintf(args, sizeof(args), "%s %s", _firmware.c_str(), _protocol.c_str());
+  } else if(!strcmp(cmd, "GS")) {
+    uint32_t elapsed = _charging() ? (millis() - _sessionStart) / 1000 : 0;
+    if(_legacy) {
+      snprintf(args, sizeof(args), "%d %u", _evseState, (unsigned)elapsed);
+    } else {
+      snprintf(args, sizeof(args), "%02x %u %02x %04x", _evseState, (unsigned)elapsed, _pilotState, (unsigned)_vflags);
+    }
+  } else if(!strcmp(cmd, "GG")) {
+    snprintf(args, sizeof(args), "%u %u", _charging() ? _pilot * 1000U : 0U, (unsigned)RAPI_SIMULATOR_VOLTS);
+  } else if(!strcmp(cmd, "GP")) {
+    snprintf(args, sizeof(args), "250 -2560 -2560");
+  } else if(!strcmp(cmd, "GU")) {
+    snprintf(args, sizeof(args), "%u %u", (unsigned)_sessionWattSeconds, (unsigned)_totalWattHours);
+  } else if(!strcmp(cmd, "GF")) {
+    snprintf(args, sizeof(args), "%x %x %x", (unsigned)_gfiCount, (unsigned)_noGndCount, (unsigned)_stuckCount);
+  } else if(!strcmp(cmd, "GE")) {
+    snprintf(args, sizeof(args), "%u 0000", _pilot);
+  } else if(!strcmp(cmd, "GC")) {
+    snprintf(args, sizeof(args), "%d %d %u %u", RAPI_SIMULATOR_MIN_CURRENT, RAPI_SIMULATOR_MAX_CURRENT, _pilot, _maxCurrent);
+  } else if(!strcmp(cmd, "GA")) {
+    snprintf(args, sizeof(args), "220 0");
+  } else if(!strcmp(cmd, "GD")) {
+    snprintf(args, sizeof(args), "0 0 0 0");
+  } else if(!strcmp(cmd, "GI")) {
+    snprintf(args, sizeof(args), "SIMEVS%04X", 0xFF00 | (_seed & 0xFF));
+  } else if(!strcmp(cmd, "GT")) {
+    time_t t = time(NULL);
+    struct tm tm;
+    localtime_r(&t, &tm);
+    snprintf(args, sizeof(args), "%d %d %d %d %d %d",
+      tm.tm_year % 100, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+  } else if(!strcmp(cmd, "SC") && count >= 2) {
+    long amps = strtol(tokens[1], NULL, 10);
+    if(count >= 3 && 'M' == tokens[2][0]) {
+      ok = amps >= RAPI_SIMULATOR_MIN_CURRENT && amps <= RAPI_SIMULATOR_MAX_CURRENT;
+      if(ok) {
+        _maxCurrent = amps;
+      }
+    } else {
+      ok = amps >= RAPI_SIMULATOR_MIN_CURRENT && amps <= _maxCurrent;
+    }
+    if(amps < RAPI_SIMULATOR_MIN_CURRENT) {
+      amps = RAPI_SIMULATOR_MIN_CURRENT;
+    } else if(amps > _maxCurrent) {
+      amps = _maxCurrent;
+    }
+    if(amps != _pilot) {
+      _pilot = amps;
+      _stateChanged();
+    }
+    snprintf(args, sizeof(args), "%u", _pilot);
+  } else if(!strcmp(cmd, "SY")) {
+    if(1 == count) {
+      // Pulse, NK while a missed pulse hasn't been acknowledged
+      ok = 2 != _hbTriggered;
+      if(ok) {
+        _hbLastPulse = millis();
+      }
+    } else if(2 == count && RAPI_SIMULATOR_HEARTBEAT_ACK == strtol(tokens[1], NULL, 10)) {
+      if(2 == _hbTriggered) {
+        _hbTriggered = 1;
+        _pilot = _maxCurrent;
+        _stateChanged();
+      }
+      _hbLastPulse = millis();
+    } else if(count >= 3) {
+      _hbInterval = strtoul(tokens[1], NULL, 10);
+      _hbCurrent = strtoul(tokens[2], NULL, 10);
+      _hbTriggered = 0;
+      _hbLastPulse = millis();
+    }
+    snprintf(args, sizeof(args), "%u %u %u", (unsigned)_hbInterval, (unsigned)_hbCurrent, _hbTriggered);
+  } else if(!strcmp(cmd, "FP") && count >= 3) {
+    int x = strtol(tokens[1], NULL, 10);
+    int y = strtol(tokens[2], NULL, 10) & 1;
+    // Text is everything after "x y ", spaces in it are sent as 0xFE
+    const char *text = rest;
+    for(int skip = 0; skip < 2 && text; skip++) {
+      text = strchr(text, ' ');
+      text = text ? text + 1 : NULL;
+    }
+    for(int i = x; text && *text && i < 16; i++, text++) {
+      _lcd[y][i] = (0xFE == (uint8_t)*text) ? ' ' : *text;
+    }
+  } else if(!strcmp(cmd, "FE")) {
+    if(_evseState >= OPENEVSE_STATE_SLEEPING) {
+      uint8_t state = _vehicle ? OPENEVSE_STATE_CHARGING : OPENEVSE_STATE_NOT_CONNECTED;
+      setState(state, state);
+    }
+  } else if(!strcmp(cmd, "FS")) {
+    setState(OPENEVSE_STATE_SLEEPING, _pilotState);
+  } else if(!strcmp(cmd, "FD")) {
+    setState(OPENEVSE_STATE_DISABLED, _pilotState);
+  } else if(!strcmp(cmd, "FR")) {
+    _reply(ready, true, NULL, seq);
+    boot();
+    return;
+  } else if(!strcmp(cmd, "GZ") || !strcmp(cmd, "GR") || !strcmp(cmd, "SR")) {
+    ok = _d9;
+    if(ok && 'Z' == cmd[1]) {
+      snprintf(args, sizeof(args), "5000");
+    } else if(ok && 'G' == cmd[0]) {
+      snprintf(args, sizeof(args), "%d %d %d", _charging(), _charging(), _charging());
+    }
+  } else if(!strcmp(cmd, "FB") || !strcmp(cmd, "FC") || !strcmp(cmd, "FF") ||
+            !strcmp(cmd, "F0") || !strcmp(cmd, "FO") || !strcmp(cmd, "S1") ||
+            !strcmp(cmd, "SA") || !strcmp(cmd, "SB") || !strcmp(cmd, "SL") ||
+            !strcmp(cmd, "ST") || !strcmp(cmd, "SV")) {
+    // Accepted, nothing simulated
+  } else {
+    ok = false;
+  }
+
+  _reply(ready, ok, args[0] ? args : NULL, seq);
+}
+
+size_t RapiSimulator::pending()
+{
+  size_t count = 0;
+  for(const Frame &frame : _out) {
+    count += frame.data.size() - frame.pos;
+  }
+  return count;
+}
+
+bool RapiSimulator::nextByteAt(uint32_t &when)
+{
+  if(_out.empty()) {
+    return false;
+  }
+  const Frame &frame = _out.front();
+  when = frame.start + (frame.pos + 1) * _byteTime;
+  return true;
+}
+
+int RapiSimulator::available()
+{
+  uint32_t now = micros();
+  size_t count = 0;
+  for(const Frame &frame : _out)
+  {
+    int32_t sent = (int32_t)(now - frame.start);
+    if(sent < 0) {
+      break;
+    }
+    size_t arrived = frame.data.size();
+    if(_byteTime > 0 && (uint32_t)sent / _byteTime < arrived) {
+      arrived = sent / _byteTime;
+    }
+    count += arrived - frame.pos;
+    if(arrived < frame.data.size()) {
+      break;
+    }
+  }
+  return (int)count;
+}
+
+int RapiSimulator::read()
+{
+  if(0 == available()) {
+    return -1;
+  }
+
+  Frame &frame = _out.front();
+  uint8_t c = frame.data[frame.pos++];
+  bool midResponse = _armedFault >= 0 && RAPI_SIMULATOR_FAULT_MID_RESPONSE == _armedWhen &&
+                     frame.pos == frame.data.size() / 2 && 0 == frame.data.compare(0, 2, "$O");
+  if(frame.pos >= frame.data.size()) {
+    _out.pop_front();
+  }
+  if(midResponse) {
+    _fireFault();
+  }
+  return c;
+}
+
+int RapiSimulator::peek()
+{
+  if(0 == available()) {
+    return -1;
+  }
+
+  Frame &frame = _out.front();
+  return (uint8_t)frame.data[frame.pos];
+}
+
+size_t RapiSimulator::write(uint8_t c)
+{
+  if('\r' == c) {
+    std::string line;
+    line.swap(_in);
+    _command(&line[0]);
+  } else if('\n' != c && _in.size() < RAPI_SIMULATOR_MAX_TOKENS * 16) {
+    _in.push_back((char)c);
+  }
+  return 1;
+}
+
+size_t RapiSimulator::write(const uint8_t *buffer, size_t size)
+{
+  for(size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+RapiSimulatorPty::RapiSimulatorPty() :
+  _sim(),
+  _reactor(nullptr),
+  _txTimer([this]() { _transmit(); }),
+  _fd(-1),
+  _slave(-1),
+  _name{},
+  _backlog()
+{
+}
+
+RapiSimulatorPty::~RapiSimulatorPty()
+{
+  end();
+}
+
+bool RapiSimulatorPty::begin(RapiReactor &reactor)
+{
+  end();
+
+  _fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if(_fd < 0) {
+    return false;
+  }
+  if(0 != grantpt(_fd) || 0 != unlockpt(_fd) || 0 != ptsname_r(_fd, _name, sizeof(_name))) {
+    end();
+    return false;
+  }
+
+  // Raw until the client sets its own mode, no echo of the replies
+  struct termios tio;
+  if(0 == tcgetattr(_fd, &tio)) {
+    cfmakeraw(&tio);
+    tcsetattr(_fd, TCSANOW, &tio);
+  }
+
+  // Hold the slave open, with no slave open the master reports a hang up
+  // and epoll would spin
+  _slave = open(_name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if(_slave < 0 || !reactor.watch(_fd, EPOLLIN, [this](uint32_t) { _read(); })) {
+    end();
+    return false;
+  }
+
+  _reactor = &reactor;
+  return true;
+}
+
+void RapiSimulatorPty::end()
+{
+  if(_reactor) {
+    _txTimer.cancel();
+    _reactor->unwatch(_fd);
+    _reactor = nullptr;
+  }
+  if(_slave >= 0) {
+    close(_slave);
+    _slave = -1;
+  }
+  if(_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+  _name[0] = '\0';
+  _backlog.clear();
+}
+
+void RapiSimulatorPty::_read()
+{
+  uint8_t buf[256];
+  ssize_t n;
+  while((n = ::read(_fd, buf, sizeof(buf))) > 0) {
+    _sim.write(buf, n);
+  }
+  _transmit();
+}
+
+void RapiSimulatorPty::_transmit()
+{
+  if(_fd < 0 || !_reactor) {
+    return;
+  }
+
+  int c;
+  while(_backlog.size() < 256 && (c = _sim.read()) >= 0) {
+    _backlog.push_back((char)c);
+  }
+
+  if(!_backlog.empty())
+  {
+    ssize_t n = ::write(_fd, _backlog.data(), _backlog.size());
+    if(n > 0) {
+      _backlog.erase(0, n);
+    }
+  }
+
+  // Come back when the next byte is due, or the pty has room again
+  uint32_t when;
+  if(!_backlog.empty()) {
+    _reactor->timers().schedule(_txTimer, 1);
+  } else if(_sim.nextByteAt(when)) {
+    int32_t due = (int32_t)(when - micros());
+    _reactor->timers().schedule(_txTimer, due > 0 ? (due + 999) / 1000 : 0);
+  } else {
+    _txTimer.cancel();
+  }
+}
@@ -0,0 +1,208 @@
+#ifndef __RAPI_SIMULATOR_H
+#define __RAPI_SIMULATOR_H
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+
+#include <Stream.h>
+#include <RapiTimer.h>
+
+class RapiReactor;
+
+#define RAPI_SIMULATOR_MAX_TOKENS 10
+
+// When an armed fault is reported, see RapiSimulator::armFault()
+#define RAPI_SIMULATOR_FAULT_NOW           0
+#define RAPI_SIMULATOR_FAULT_NEXT_COMMAND  1 // ahead of the next command's response
+#define RAPI_SIMULATOR_FAULT_MID_RESPONSE  2 // once half of a response has been read
+
+// Defaults match a current OpenEVSE controller
+#define RAPI_SIMULATOR_FIRMWARE        "7.1.3"
+#define RAPI_SIMULATOR_PROTOCOL        "5.1.0"
+#define RAPI_SIMULATOR_LEGACY_FIRMWARE "4.8.0"
+#define RAPI_SIMULATOR_LEGACY_PROTOCOL "4.0.1"
+
+#define RAPI_SIMULATOR_VOLTS        240000 // mV
+#define RAPI_SIMULATOR_MIN_CURRENT  6
+#define RAPI_SIMULATOR_MAX_CURRENT  32
+
+// Simulated OpenEVSE controller speaking RAPI. It is a Stream so a
+// RapiSender can talk to it directly in-process, see RapiSimulatorPty to
+// put it behind a pseudo terminal instead.
+//
+// Responses are sent after the configured latency (plus random jitter)
+// and, if a baud rate is set, at the rate the serial line would deliver
+// them: read() only returns the bytes that would have arrived by now.
+class RapiSimulator : public Stream
+{
+  private:
+    struct Frame {
+      uint32_t start;     // micros() the first bit goes on the wire
+      std::string data;
+      size_t pos;
+    };
+
+    std::string _in;
+    std::deque<Frame> _out;
+
+    // Link
+    uint32_t _latency;
+    uint32_t _jitter;
+    uint32_t _byteTime;
+    uint32_t _lineFree;
+    uint32_t _seed;
+    bool _legacy;
+    bool _d9;
+    std::string _firmware;
+    std::string _protocol;
+
+    // Controller state
+    uint8_t _evseState;
+    uint8_t _pilotState;
+    uint8_t _reportedState;
+    uint32_t _vflags;
+    bool _vehicle;
+    uint8_t _pilot;
+    uint8_t _maxCurrent;
+    uint32_t _sessionStart;
+    uint32_t _lastUpdate;
+    double _sessionWattSeconds;
+    double _totalWattHours;
+    uint32_t _gfiCount;
+    uint32_t _noGndCount;
+    uint32_t _stuckCount;
+    uint32_t _hbInterval;
+    uint32_t _hbCurrent;
+    uint8_t _hbTriggered;
+    uint32_t _hbLastPulse;
+    char _lcd[2][17];
+
+    uint32_t _commands;
+    uint32_t _eventAt;
+    int _armedFault;
+    uint8_t _armedWhen;
+
+    uint32_t _random();
+    void _update(uint32_t now);
+    void _command(char *line);
+    void _reply(uint32_t ready, bool ok, const char *args, int seq);
+    void _send(uint32_t ready, const char *body, int seq);
+    void _stateChanged();
+    void _fireFault();
+    bool _charging() {
+      return 3 == _evseState;
+    }
+
+  public:
+    RapiSimulator();
+
+    // Processing time per command in microseconds, each response is delayed
+    // by latency + [0, jitter]
+    void setLatency(uint32_t latency, uint32_t jitter = 0);
+    // Emulate the transfer time of a serial line, 0 for an infinitely fast
+    // one
+    void setBaud(uint32_t baud);
+    void setSeed(uint32_t seed) {
+      _seed = seed ? seed : 1;
+    }
+
+    void setVersion(const char *firmware, const char *protocol);
+    // Pre 5.0.0 protocol: $GS is "state elapsed" in decimal and state
+    // changes are reported with $ST rather than $AT
+    void setLegacy(bool legacy);
+    // linco-work D9 extensions ($GZ, $GR, $SR), needs protocol 6.0.0+
+    void setD9(bool d9) {
+      _d9 = d9;
+    }
+
+    // Drive the simulated EVSE, state changes send the async events a real
+    // controller would
+    void boot(uint8_t post_code = 0);
+    void plugIn(bool charge = true);
+    void unplug();
+    void fault(uint8_t evse_state);
+    // Fault at a chosen moment relative to the link traffic, one at a time
+    void armFault(uint8_t evse_state, uint8_t when);
+    bool isFaultArmed() {
+      return _armedFault >= 0;
+    }
+    void setState(uint8_t evse_state, uint8_t pilot_state);
+    // Raw async event, e.g. "$WF 2", the checksum is added
+    void sendEvent(const char *body);
+
+    uint8_t getState() {
+      return _evseState;
+    }
+    uint8_t getPilot() {
+      return _pilot;
+    }
+    const char *getLcd(int line) {
+      return _lcd[line & 1];
+    }
+    uint32_t getCommands() {
+      return _commands;
+    }
+    // micros() the first byte of the last async event goes on the wire
+    uint32_t getEventAt() {
+      return _eventAt;
+    }
+
+    // Bytes queued that have not been read yet, delivered or not
+    size_t pending();
+    // micros() time the next byte arrives, false if nothing is queued
+    bool nextByteAt(uint32_t &when);
+
+    // Stream
+    int available();
+    int read();
+    int peek();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+};
+
+// A simulator behind a pty, for clients that open a serial device. The
+// client opens slaveName(), the simulator side is driven by a RapiReactor.
+class RapiSimulatorPty
+{
+  private:
+    RapiSimulator _sim;
+    RapiReactor *_reactor;
+    RapiTimer _txTimer;
+    int _fd;
+    int _slave;
+    char _name[64];
+    std::string _backlog;
+
+    void _read();
+    void _transmit();
+
+  public:
+    RapiSimulatorPty();
+    ~RapiSimulatorPty();
+
+    RapiSimulatorPty(const RapiSimulatorPty &) = delete;
+    RapiSimulatorPty &operator=(const RapiSimulatorPty &) = delete;
+
+    bool begin(RapiReactor &reactor);
+    void end();
+
+    RapiSimulator &sim() {
+      return _sim;
+    }
+    const char *slaveName() {
+      return _name;
+    }
+    int fd() {
+      return _fd;
+    }
+
+    // Call after driving sim() directly (plugIn() etc.) from outside the
+    // reactor callbacks so queued events get sent
+    void kick() {
+      _transmit();
+    }
+};
+
+#endif // __RAPI_SIMULATOR_H
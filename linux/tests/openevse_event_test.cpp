@@ -0,0 +1,140 @@
+// OpenEVSEClass subscribers: a callback that pumps the sender, and so
+// publishes a second event inside the first, must not cut the outer
+// dispatch short, and an unsubscribe in the inner one must move the outer
+// one on. The first status read after begin() is not a vflags edge.
+// Exits non-zero on failure.
+
+#include <Arduino.h>
+
+#include <stdio.h>
+
+#include <openevse.h>
+
+#include "RapiSimulator.h"
+
+#if !OPENEVSE_ENABLE_ASYNC_EVENTS
+#error "openevse_event_test needs OPENEVSE_ENABLE_ASYNC_EVENTS"
+#endif
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+      printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      failures++; \
+    } \
+  } while(0)
+
+static void run(RapiSender &rapi, uint32_t ms)
+{
+  uint32_t start = millis();
+  while(millis() - start < ms) {
+    rapi.loop();
+  }
+}
+
+static void nestedDispatch()
+{
+  printf("nested dispatch\n");
+
+  RapiSimulator sim;
+  RapiSender rapi(&sim);
+  OpenEVSEClass evse;
+
+  bool connected = false;
+  evse.begin(rapi, [&](bool ok) { connected = ok; });
+  run(rapi, 200);
+  CHECK(connected);
+
+  int a = 0, b = 0, c = 0;
+  uint8_t bLast = OPENEVSE_STATE_INVALID;
+  uint8_t cLast = OPENEVSE_STATE_INVALID;
+  OpenEVSESubscriber first([&](const OpenEVSEEvent &event) {
+    if(1 == ++a) {
+      // Pumps loop(), the $AT for the fault is published in here
+      sim.fault(OPENEVSE_STATE_GFI_FAULT);
+      rapi.sendCmdSync("$GE");
+    }
+  });
+  OpenEVSESubscriber second([&](const OpenEVSEEvent &event) {
+    b++;
+    bLast = event.evse_state;
+  });
+  OpenEVSESubscriber third;
+  third.setCallback([&](const OpenEVSEEvent &event) {
+    c++;
+    cLast = event.evse_state;
+    if(OPENEVSE_STATE_GFI_FAULT == event.evse_state) {
+      // Inner dispatch, second is the outer one's next
+      second.unsubscribe();
+    }
+  });
+  evse.subscribe(first, OPENEVSE_EVENT_STATE);
+  evse.subscribe(second, OPENEVSE_EVENT_STATE);
+  evse.subscribe(third, OPENEVSE_EVENT_STATE);
+
+  sim.plugIn();
+  run(rapi, 200);
+
+  CHECK(2 == a);
+  // second only saw the fault, it was removed before the outer event got to it
+  CHECK(1 == b);
+  CHECK(OPENEVSE_STATE_GFI_FAULT == bLast);
+  CHECK(!second.isSubscribed());
+  // third saw both, the fault first
+  CHECK(2 == c);
+  CHECK(OPENEVSE_STATE_CHARGING == cLast);
+}
+
+static void firstRead()
+{
+  printf("first read\n");
+
+  RapiSimulator sim;
+  RapiSender rapi(&sim);
+  OpenEVSEClass evse;
+
+  int edges = 0;
+  uint32_t changed = 0;
+  OpenEVSESubscriber flags([&](const OpenEVSEEvent &event) {
+    edges++;
+    changed = event.changed;
+  });
+  evse.subscribe(flags, OPENEVSE_EVENT_FLAGS);
+
+  bool connected = false;
+  evse.begin(rapi, [&](bool ok) { connected = ok; });
+  run(rapi, 200);
+  CHECK(connected);
+
+  // Nothing to compare the first vflags with
+  evse.getStatus([](int ret, uint8_t evse_state, uint32_t session_time, uint8_t pilot_state, uint32_t vflags) { });
+  run(rapi, 200);
+  CHECK(0 == edges);
+  CHECK(OPENEVSE_VFLAG_SESSION_ENDED & evse.getLastStatus().vflags);
+
+  sim.plugIn();
+  run(rapi, 200);
+  CHECK(edges > 0);
+  CHECK(OPENEVSE_VFLAG_EV_CONNECTED & changed);
+
+  // The pilot is seen from $GC, not only $AT
+  long pilot = 0;
+  evse.setCurrentCapacity(10, false, [](int ret, long pilot) { });
+  // Called in response order, the pilot is third
+  evse.getCurrentCapacity([&](int ret, long min_current, long max_hardware_current, long p, long max_configured_current) {
+    pilot = p;
+  });
+  run(rapi, 200);
+  CHECK(10 == pilot);
+  CHECK(10 == evse.getLastStatus().current_capacity);
+}
+
+int main()
+{
+  nestedDispatch();
+  firstRead();
+
+  printf("%s\n", failures ? "FAILED" : "passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+// RapiSender retries: a late reply to the first attempt of a command, or
+// the reply to a retry, must complete that command once and never be
+// taken as the reply to the next one. Runs on the virtual clock against a
+// scripted Stream, exits non-zero on failure.
+
+#include <Arduino.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "RapiSender.h"
+
+#define TEST_TIMEOUT 100 // ms
+
+// Records what is written, replays what the test queues
+class ScriptStream : public Stream
+{
+  private:
+    std::string _in;
+    std::string _out;
+
+  public:
+    int available() override {
+      return (int)_in.size();
+    }
+    int read() override
+    {
+      if(_in.empty()) {
+        return -1;
+      }
+      int c = (uint8_t)_in[0];
+      _in.erase(0, 1);
+      return c;
+    }
+    int peek() override {
+      return _in.empty() ? -1 : (uint8_t)_in[0];
+    }
+    size_t write(uint8_t c) override {
+      _out += (char)c;
+      return 1;
+    }
+
+    // Queue a response, with the checksum and optionally a sequence ID
+    void reply(const char *body, int sequenceId = -1)
+    {
+      char frame[64];
+      if(sequenceId >= 0) {
+        snprintf(frame, sizeof(frame), "%s %c%02X", body, ESRAPI_SOS, (unsigned)sequenceId);
+      } else {
+        snprintf(frame, sizeof(frame), "%s", body);
+      }
+      uint8_t chk = 0;
+      for(const char *s = frame; *s; s++) {
+        chk ^= *s;
+      }
+      char tail[8];
+      snprintf(tail, sizeof(tail), "^%02X%c", (unsigned)chk, ESRAPI_EOC);
+      _in += frame;
+      _in += tail;
+    }
+
+    // Times command has been written
+    int sent(const char *command)
+    {
+      int count = 0;
+      for(size_t at = _out.find(command); std::string::npos != at; at = _out.find(command, at + 1)) {
+        count++;
+      }
+      return count;
+    }
+
+    // Sequence ID of the nth (from 0) write of command, -1 if none
+    int sequenceId(const char *command, int nth)
+    {
+      size_t at = _out.find(command);
+      for(; nth > 0 && std::string::npos != at; nth--) {
+        at = _out.find(command, at + 1);
+      }
+      if(std::string::npos == at) {
+        return -1;
+      }
+      size_t sos = _out.find(ESRAPI_SOS, at);
+      size_t end = _out.find('^', at);
+      if(std::string::npos == sos || sos > end) {
+        return -1;
+      }
+      return (int)strtoul(_out.c_str() + sos + 1, NULL, 16);
+    }
+};
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+      printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      failures++; \
+    } \
+  } while(0)
+
+static void run(RapiSender &rapi, uint32_t ms)
+{
+  for(uint32_t i = 0; i <= ms; i++)
+  {
+    rapi.loop();
+    virtualClockAdvance(1000);
+  }
+  rapi.loop();
+}
+
+// $GV times out, is retried, then both attempts are answered
+static void lateReply(bool sequenceIds)
+{
+  printf("late reply, sequence IDs %s\n", sequenceIds ? "on" : "off");
+
+  ScriptStream stream;
+  RapiTimerWheel timers;
+  RapiSender rapi(&stream, &timers);
+  rapi.enableSequenceId(sequenceIds ? 1 : 0);
+  rapi.setRetries(1);
+
+  int version = 1, settings = 1, versionCalls = 0, settingsCalls = 0;
+  String pilot;
+  rapi.sendCmd("$GV", [&](int ret) { version = ret; versionCalls++; }, TEST_TIMEOUT);
+  rapi.sendCmd("$GE", [&](int ret) {
+    settings = ret;
+    settingsCalls++;
+    pilot = rapi.getToken(1) ? rapi.getToken(1) : "";
+  }, TEST_TIMEOUT);
+
+  run(rapi, TEST_TIMEOUT + 10);
+  CHECK(2 == stream.sent("$GV"));
+  CHECK(stream.sequenceId("$GV", 0) == stream.sequenceId("$GV", 1));
+
+  // The first attempt is answered late, after the retry went out
+  stream.reply("$OK 7.1.3 5.0.0", stream.sequenceId("$GV", 0));
+  run(rapi, 1);
+  CHECK(RAPI_RESPONSE_OK == version);
+  CHECK(1 == versionCalls);
+  CHECK(0 == stream.sent("$GE"));
+
+  // Then the retry, dropped, not taken as the reply to $GE
+  stream.reply("$OK 7.1.3 5.0.0", stream.sequenceId("$GV", 1));
+  run(rapi, 1);
+  CHECK(1 == versionCalls);
+  CHECK(0 == settingsCalls);
+  CHECK(1 == stream.sent("$GE"));
+  CHECK(1 == rapi.getStats().stale);
+
+  stream.reply("$OK 16 0201", stream.sequenceId("$GE", 0));
+  run(rapi, 1);
+  CHECK(1 == settingsCalls);
+  CHECK(RAPI_RESPONSE_OK == settings);
+  CHECK(pilot == "16");
+  CHECK(0 == rapi.getStats().bad_sequence_id);
+#ifdef ENABLE_RAPI_LATENCY_STATS
+  // Each command completed once, with the time to its handler
+  const RapiCommandLatency *latency = rapi.getLatency().find("GV");
+  CHECK(latency && 1 == latency->rtt.count() && 1 == latency->handle.count());
+#endif
+}
+
+// The retry is never answered, the next command goes after the timeout
+static void lostReply()
+{
+  printf("lost reply to the retry\n");
+
+  ScriptStream stream;
+  RapiTimerWheel timers;
+  RapiSender rapi(&stream, &timers);
+  rapi.setRetries(1);
+
+  int settings = 1;
+  rapi.sendCmd("$GV", nullptr, TEST_TIMEOUT);
+  rapi.sendCmd("$GE", [&](int ret) { settings = ret; }, TEST_TIMEOUT);
+
+  run(rapi, TEST_TIMEOUT + 10);
+  stream.reply("$OK 7.1.3 5.0.0");
+  run(rapi, 1);
+  CHECK(0 == stream.sent("$GE"));
+
+  run(rapi, TEST_TIMEOUT + 10);
+  CHECK(1 == stream.sent("$GE"));
+  stream.reply("$OK 16 0201");
+  run(rapi, 1);
+  CHECK(RAPI_RESPONSE_OK == settings);
+}
+
+// Senders not given a wheel each have their own, one link's loop() must
+// not time out another link's commands
+static void ownWheel()
+{
+  printf("own timer wheel\n");
+
+  ScriptStream first, second;
+  RapiSender a(&first), b(&second);
+  CHECK(a.getTimerWheel() != b.getTimerWheel());
+
+  int ret = 1;
+  b.sendCmd("$GV", [&](int r) { ret = r; }, TEST_TIMEOUT);
+  run(a, TEST_TIMEOUT + 10);
+  CHECK(1 == ret);
+  CHECK(0 == b.getStats().timeouts);
+  run(b, 1);
+  CHECK(RAPI_RESPONSE_TIMEOUT == ret);
+}
+
+int main()
+{
+  virtualClockBegin();
+
+  lateReply(false);
+  lateReply(true);
+  lostReply();
+  ownWheel();
+
+  virtualClockEnd();
+
+  printf("%s\n", failures ? "FAILED" : "passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,653 @@
+// Offline analyzer for RapiCaptureStream captures, for weeks of traffic
+//
+// usage: rapi_analyze [-j threads] [-T timeout_ms] [-s timeline.csv] [-o file] capture...
+//   -j  worker threads, default one per core
+//   -T  a command with no response after this long is a timeout (2000)
+//   -s  write the EVSE state transitions ($AT, $ST, $AB) as CSV
+//
+// Each capture is memory mapped and its records split in to one TX and
+// one RX byte stream. The streams are cut in to segments that are scanned
+// for frames in parallel, '$' and '\r' are found 16 bytes at a time with
+// SSE2 and the checksums XORed the same way. Commands are then paired with
+// their responses by sequence ID, or in order if IDs are not enabled.
+// Results are written as JSON.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <RapiCapture.h>
+
+#define ANALYZE_SEGMENT_SIZE    (4 * 1024 * 1024)
+#define ANALYZE_DEFAULT_TIMEOUT 2000
+#define ANALYZE_MAX_PENDING     16
+
+#define FRAME_BAD_CHECKSUM      0x01
+#define FRAME_NO_CHECKSUM       0x02
+#define FRAME_TRUNCATED         0x04 // a '$' before the '\r'
+
+struct Frame
+{
+  uint64_t time;        // us since the start of the capture
+  uint32_t offset;      // in the direction's byte stream
+  uint32_t length;      // '$' up to, not including, the '\r'
+  uint8_t flags;
+};
+
+// A direction of a capture, the record payloads stitched together
+struct Direction
+{
+  std::string data;
+  std::vector<uint32_t> offsets;  // stream offset of each record...
+  std::vector<uint64_t> times;    // ...and its time
+  std::vector<std::vector<Frame>> segments;
+
+  uint64_t timeAt(uint32_t offset) const
+  {
+    size_t i = std::upper_bound(offsets.begin(), offsets.end(), offset) - offsets.begin();
+    return i ? times[i - 1] : 0;
+  }
+};
+
+struct CommandStats
+{
+  uint64_t count;
+  uint64_t ok;
+  uint64_t nk;
+  uint64_t timeouts;
+  uint64_t errors;
+  std::vector<uint32_t> latency;
+};
+
+struct Transition
+{
+  uint64_t time;
+  const char *event;
+  int evseState;
+  int pilotState;
+};
+
+struct Capture
+{
+  std::string name;
+  bool valid;
+  RapiCaptureHeader header;
+  uint64_t bytes;
+  uint64_t duration;
+  Direction tx;
+  Direction rx;
+
+  // Results
+  uint64_t txFrames;
+  uint64_t rxFrames;
+  uint64_t badChecksum;
+  uint64_t noChecksum;
+  uint64_t truncated;
+  uint64_t unmatched;
+  std::map<std::string, CommandStats> commands;
+  std::map<std::string, uint64_t> events;
+  std::vector<Transition> timeline;
+};
+
+static std::vector<Capture> captures;
+
+template <typename Function>
+static void parallelFor(size_t count, unsigned threads, Function fn)
+{
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for(size_t i; (i = next++) < count; ) {
+      fn(i);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for(unsigned i = 1; i < threads && i < count; i++) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for(std::thread &thread : pool) {
+    thread.join();
+  }
+}
+
+// Next '$' or '\r'
+static const uint8_t *findFrameByte(const uint8_t *p, const uint8_t *end)
+{
+#ifdef __SSE2__
+  const __m128i dollar = _mm_set1_epi8('$');
+  const __m128i cr = _mm_set1_epi8('\r');
+  for(; end - p >= 16; p += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, dollar), _mm_cmpeq_epi8(v, cr)));
+    if(mask) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for(; p < end; p++) {
+    if('$' == *p || '\r' == *p) {
+      return p;
+    }
+  }
+  return end;
+}
+
+static uint8_t xorBytes(const uint8_t *p, size_t length)
+{
+  uint8_t chk = 0;
+#ifdef __SSE2__
+  if(length >= 16)
+  {
+    __m128i acc = _mm_setzero_si128();
+    for(; length >= 16; p += 16, length -= 16) {
+      acc = _mm_xor_si128(acc, _mm_loadu_si128((const __m128i *)p));
+    }
+    acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 8));
+    acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 4));
+    acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 2));
+    acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 1));
+    chk = (uint8_t)_mm_cvtsi128_si32(acc);
+  }
+#endif
+  while(length--) {
+    chk ^= *p++;
+  }
+  return chk;
+}
+
+static int hexValue(uint8_t c)
+{
+  if(c >= '0' && c <= '9') return c - '0';
+  if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+static uint8_t checkFrame(const uint8_t *frame, uint32_t length)
+{
+  if(length < 4 || '^' != frame[length - 3]) {
+    return FRAME_NO_CHECKSUM;
+  }
+  int hi = hexValue(frame[length - 2]);
+  int lo = hexValue(frame[length - 1]);
+  if(hi < 0 || lo < 0 || xorBytes(frame, length - 3) != ((hi << 4) | lo)) {
+    return FRAME_BAD_CHECKSUM;
+  }
+  return 0;
+}
+
+// Frames starting in [start, end) of the stream, the last may run past end
+static void scanSegment(const Direction &dir, uint32_t start, uint32_t end, std::vector<Frame> &frames)
+{
+  const uint8_t *data = (const uint8_t *)dir.data.data();
+  const uint8_t *limit = data + dir.data.size();
+  const uint8_t *p = (const uint8_t *)memchr(data + start, '$', end - start);
+
+  while(p && p < data + end)
+  {
+    const uint8_t *q = findFrameByte(p + 1, limit);
+    Frame frame = { dir.timeAt(p - data), (uint32_t)(p - data), (uint32_t)(q - p), 0 };
+    if(q == limit) {
+      // Capture ended mid frame
+      frame.flags = FRAME_TRUNCATED;
+      frames.push_back(frame);
+      break;
+    }
+    if('$' == *q) {
+      frame.flags = FRAME_TRUNCATED;
+      frames.push_back(frame);
+      p = q;
+      continue;
+    }
+
+    frame.flags = checkFrame(p, frame.length);
+    frames.push_back(frame);
+
+    p = q + 1 < data + end ? (const uint8_t *)memchr(q + 1, '$', data + end - (q + 1)) : NULL;
+  }
+}
+
+static bool load(Capture &capture)
+{
+  int fd = open(capture.name.c_str(), O_RDONLY);
+  if(fd < 0) {
+    perror(capture.name.c_str());
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) < 0 || 0 == st.st_size) {
+    fprintf(stderr, "%s: empty\n", capture.name.c_str());
+    close(fd);
+    return false;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(MAP_FAILED == map) {
+    perror(capture.name.c_str());
+    return false;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  bool ok = false;
+  RapiCaptureReader reader;
+  if(reader.begin(map, st.st_size))
+  {
+    capture.header = reader.header();
+    capture.bytes = st.st_size;
+
+    // Record times are 32 bit micros(), unwrap them
+    RapiCaptureRecord record;
+    uint32_t last = 0;
+    uint64_t time = 0;
+    while(reader.next(record))
+    {
+      time += (uint32_t)(record.time - last);
+      last = record.time;
+
+      Direction &dir = record.tx ? capture.tx : capture.rx;
+      dir.offsets.push_back(dir.data.size());
+      dir.times.push_back(time);
+      dir.data.append((const char *)record.data, record.length);
+    }
+    capture.duration = time;
+
+    if(!reader.atEnd()) {
+      fprintf(stderr, "%s: truncated, analyzing what is there\n", capture.name.c_str());
+    }
+    ok = true;
+  } else {
+    fprintf(stderr, "%s: not a RAPI capture\n", capture.name.c_str());
+  }
+
+  munmap(map, st.st_size);
+  return ok;
+}
+
+// Fields of a frame body, "$OK 01 02 :1A^2F" -> "$OK", "01", "02", up to
+// max of them; seq is set if present
+static int tokenize(const uint8_t *frame, uint32_t length, std::string *tokens, int max, int &seq)
+{
+  seq = -1;
+  if(length >= 3 && '^' == frame[length - 3]) {
+    length -= 3;
+  }
+
+  int count = 0;
+  uint32_t i = 0;
+  while(i < length)
+  {
+    while(i < length && ' ' == frame[i]) {
+      i++;
+    }
+    uint32_t start = i;
+    while(i < length && ' ' != frame[i]) {
+      i++;
+    }
+    if(i > start)
+    {
+      if(':' == frame[start] && i - start == 3) {
+        seq = (hexValue(frame[start + 1]) << 4) | hexValue(frame[start + 2]);
+      } else if(count < max) {
+        tokens[count++].assign((const char *)frame + start, i - start);
+      }
+    }
+  }
+  return count;
+}
+
+struct Pending
+{
+  uint64_t time;
+  int seq;
+  std::string command;
+};
+
+static void expire(Capture &capture, std::deque<Pending> &pending, uint64_t now, uint64_t timeout)
+{
+  while(!pending.empty() &&
+        (now - pending.front().time > timeout || pending.size() > ANALYZE_MAX_PENDING))
+  {
+    capture.commands[pending.front().command].timeouts++;
+    pending.pop_front();
+  }
+}
+
+// Walk both directions in time order pairing commands and responses
+static void pair(Capture &capture, uint64_t timeout)
+{
+  std::vector<const Frame *> tx, rx;
+  for(const std::vector<Frame> &segment : capture.tx.segments) {
+    for(const Frame &frame : segment) {
+      tx.push_back(&frame);
+    }
+  }
+  for(const std::vector<Frame> &segment : capture.rx.segments) {
+    for(const Frame &frame : segment) {
+      rx.push_back(&frame);
+    }
+  }
+  capture.txFrames = tx.size();
+  capture.rxFrames = rx.size();
+
+  std::deque<Pending> pending;
+  std::string tokens[5];
+  int lastState = -1;
+  int lastPilot = -1;
+
+  size_t t = 0, r = 0;
+  while(t < tx.size() || r < rx.size())
+  {
+    // A response is recorded after the command it answers
+    bool isTx = r >= rx.size() || (t < tx.size() && tx[t]->time <= rx[r]->time);
+    const Frame &frame = isTx ? *tx[t++] : *rx[r++];
+    const Direction &dir = isTx ? capture.tx : capture.rx;
+    const uint8_t *data = (const uint8_t *)dir.data.data() + frame.offset;
+
+    if(frame.flags & FRAME_TRUNCATED) {
+      capture.truncated++;
+      continue;
+    }
+    if(frame.flags & FRAME_NO_CHECKSUM) {
+      capture.noChecksum++;
+    }
+
+    int seq;
+    int count = tokenize(data, frame.length, tokens, 5, seq);
+    if(0 == count || tokens[0].size() < 3) {
+      continue;
+    }
+
+    if(isTx)
+    {
+      if(frame.flags & FRAME_BAD_CHECKSUM) {
+        capture.badChecksum++;
+      }
+      expire(capture, pending, frame.time, timeout);
+      std::string command = tokens[0].substr(1, 2);
+      capture.commands[command].count++;
+      pending.push_back({ frame.time, seq, command });
+      continue;
+    }
+
+    uint64_t end = capture.rx.timeAt(frame.offset + frame.length);
+    expire(capture, pending, end, timeout);
+
+    if("$OK" == tokens[0] || "$NK" == tokens[0])
+    {
+      std::deque<Pending>::iterator match = pending.end();
+      if(seq >= 0) {
+        match = std::find_if(pending.begin(), pending.end(), [seq](const Pending &p) { return p.seq == seq; });
+      } else if(!pending.empty()) {
+        match = pending.begin();
+      }
+      if(pending.end() == match) {
+        capture.unmatched++;
+        continue;
+      }
+
+      CommandStats &stats = capture.commands[match->command];
+      if(frame.flags & FRAME_BAD_CHECKSUM) {
+        capture.badChecksum++;
+        stats.errors++;
+      } else if("$OK" == tokens[0]) {
+        stats.ok++;
+        stats.latency.push_back((uint32_t)std::min<uint64_t>(end - match->time, UINT32_MAX));
+      } else {
+        stats.nk++;
+      }
+      pending.erase(match);
+      continue;
+    }
+
+    // Async event
+    if(frame.flags & FRAME_BAD_CHECKSUM) {
+      capture.badChecksum++;
+      continue;
+    }
+    std::string event = tokens[0].substr(1, 2);
+    capture.events[event]++;
+
+    int state = -1, pilot = -1;
+    if("AT" == event && count >= 3) {
+      state = strtol(tokens[1].c_str(), NULL, 16);
+      pilot = strtol(tokens[2].c_str(), NULL, 16);
+    } else if("ST" == event && count >= 2) {
+      state = strtol(tokens[1].c_str(), NULL, 16);
+      pilot = lastPilot;
+    } else if("AB" == event) {
+      capture.timeline.push_back({ frame.time, "AB", -1, -1 });
+      lastState = lastPilot = -1;
+      continue;
+    }
+    if(state >= 0 && (state != lastState || pilot != lastPilot)) {
+      capture.timeline.push_back({ frame.time, "AT" == event ? "AT" : "ST", state, pilot });
+      lastState = state;
+      lastPilot = pilot;
+    }
+  }
+
+  for(const Pending &p : pending) {
+    capture.commands[p.command].timeouts++;
+  }
+}
+
+static uint32_t percentile(std::vector<uint32_t> &values, double p)
+{
+  if(values.empty()) {
+    return 0;
+  }
+  size_t n = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+
+static double rate(uint64_t n, uint64_t total)
+{
+  return total ? (double)n / total : 0.0;
+}
+
+static int usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-j threads] [-T timeout_ms] [-s timeline.csv] [-o file] capture...\n", name);
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned threads = std::max(1U, std::thread::hardware_concurrency());
+  uint64_t timeout = ANALYZE_DEFAULT_TIMEOUT;
+  const char *timelineFile = NULL;
+  const char *output = NULL;
+
+  int opt;
+  while(-1 != (opt = getopt(argc, argv, "j:T:s:o:")))
+  {
+    switch(opt)
+    {
+      case 'j': threads = std::max(1, atoi(optarg)); break;
+      case 'T': timeout = strtoul(optarg, NULL, 10); break;
+      case 's': timelineFile = optarg; break;
+      case 'o': output = optarg; break;
+      default:
+        return usage(argv[0]);
+    }
+  }
+  if(optind >= argc) {
+    return usage(argv[0]);
+  }
+  timeout *= 1000;
+
+  struct timespec started;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+
+  captures.resize(argc - optind);
+  for(size_t i = 0; i < captures.size(); i++) {
+    captures[i].name = argv[optind + i];
+  }
+
+  parallelFor(captures.size(), threads, [](size_t i) {
+    captures[i].valid = load(captures[i]);
+  });
+
+  // Cut every stream in to segments and scan them all in parallel
+  struct Segment {
+    Direction *dir;
+    size_t index;
+    uint32_t start;
+    uint32_t end;
+  };
+  std::vector<Segment> segments;
+  for(Capture &capture : captures)
+  {
+    for(Direction *dir : { &capture.tx, &capture.rx })
+    {
+      size_t size = dir->data.size();
+      for(size_t start = 0; start < size; start += ANALYZE_SEGMENT_SIZE) {
+        segments.push_back({ dir, dir->segments.size(), (uint32_t)start,
+                             (uint32_t)std::min<size_t>(start + ANALYZE_SEGMENT_SIZE, size) });
+        dir->segments.emplace_back();
+      }
+    }
+  }
+  parallelFor(segments.size(), threads, [&segments](size_t i) {
+    Segment &segment = segments[i];
+    scanSegment(*segment.dir, segment.start, segment.end, segment.dir->segments[segment.index]);
+  });
+
+  parallelFor(captures.size(), threads, [timeout](size_t i) {
+    if(captures[i].valid) {
+      pair(captures[i], timeout);
+    }
+  });
+
+  // Merge
+  uint64_t bytes = 0, duration = 0, txFrames = 0, rxFrames = 0;
+  uint64_t badChecksum = 0, noChecksum = 0, truncated = 0, unmatched = 0, transitions = 0;
+  size_t valid = 0;
+  std::map<std::string, CommandStats> commands;
+  std::map<std::string, uint64_t> events;
+  for(Capture &capture : captures)
+  {
+    if(!capture.valid) {
+      continue;
+    }
+    valid++;
+    bytes += capture.bytes;
+    duration += capture.duration;
+    txFrames += capture.txFrames;
+    rxFrames += capture.rxFrames;
+    badChecksum += capture.badChecksum;
+    noChecksum += capture.noChecksum;
+    truncated += capture.truncated;
+    unmatched += capture.unmatched;
+    transitions += capture.timeline.size();
+
+    for(auto &item : capture.commands)
+    {
+      CommandStats &stats = commands[item.first];
+      stats.count += item.second.count;
+      stats.ok += item.second.ok;
+      stats.nk += item.second.nk;
+      stats.timeouts += item.second.timeouts;
+      stats.errors += item.second.errors;
+      stats.latency.insert(stats.latency.end(), item.second.latency.begin(), item.second.latency.end());
+    }
+    for(auto &item : capture.events) {
+      events[item.first] += item.second;
+    }
+  }
+
+  struct timespec finished;
+  clock_gettime(CLOCK_MONOTONIC, &finished);
+  double elapsed = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+
+  if(timelineFile)
+  {
+    FILE *csv = fopen(timelineFile, "w");
+    if(NULL == csv) {
+      perror(timelineFile);
+      return 1;
+    }
+    fprintf(csv, "capture,time_us,unix_time,event,evse_state,pilot_state\n");
+    for(const Capture &capture : captures)
+    {
+      for(const Transition &transition : capture.timeline)
+      {
+        uint32_t start = capture.header.start_time;
+        fprintf(csv, "%s,%llu,%llu,%s,%d,%d\n", capture.name.c_str(),
+          (unsigned long long)transition.time,
+          start ? (unsigned long long)(start + transition.time / 1000000) : 0ULL,
+          transition.event, transition.evseState, transition.pilotState);
+      }
+    }
+    fclose(csv);
+  }
+
+  FILE *out = stdout;
+  if(output && NULL == (out = fopen(output, "w"))) {
+    perror(output);
+    return 1;
+  }
+
+  fprintf(out, "{\n  \"captures\": %u,\n  \"bytes\": %llu,\n  \"capture_s\": %.1f,\n"
+    "  \"threads\": %u,\n  \"elapsed_ms\": %.1f,\n  \"mb_per_sec\": %.1f,\n",
+    (unsigned)valid, (unsigned long long)bytes, duration / 1e6,
+    threads, elapsed * 1000, elapsed > 0 ? bytes / elapsed / 1e6 : 0.0);
+  fprintf(out, "  \"frames\": { \"tx\": %llu, \"rx\": %llu, \"bad_checksum\": %llu, \"no_checksum\": %llu, "
+    "\"truncated\": %llu, \"unmatched_responses\": %llu },\n",
+    (unsigned long long)txFrames, (unsigned long long)rxFrames, (unsigned long long)badChecksum,
+    (unsigned long long)noChecksum, (unsigned long long)truncated, (unsigned long long)unmatched);
+
+  fprintf(out, "  \"commands\": [");
+  bool first = true;
+  for(auto &item : commands)
+  {
+    CommandStats &stats = item.second;
+    uint64_t failed = stats.nk + stats.timeouts + stats.errors;
+    uint32_t p50 = percentile(stats.latency, 50);
+    uint32_t p90 = percentile(stats.latency, 90);
+    uint32_t p99 = percentile(stats.latency, 99);
+    uint32_t max = stats.latency.empty() ? 0 : *std::max_element(stats.latency.begin(), stats.latency.end());
+    fprintf(out, "%s\n    { \"command\": \"%s\", \"count\": %llu, \"ok\": %llu, \"nk\": %llu, \"timeouts\": %llu, "
+      "\"errors\": %llu, \"error_rate\": %.4f, \"latency_us\": { \"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u } }",
+      first ? "" : ",", item.first.c_str(),
+      (unsigned long long)stats.count, (unsigned long long)stats.ok, (unsigned long long)stats.nk,
+      (unsigned long long)stats.timeouts, (unsigned long long)stats.errors, rate(failed, stats.count),
+      (unsigned)p50, (unsigned)p90, (unsigned)p99, (unsigned)max);
+    first = false;
+  }
+  fprintf(out, "\n  ],\n  \"events\": {");
+
+  first = true;
+  for(auto &item : events) {
+    fprintf(out, "%s \"%s\": %llu", first ? "" : ",", item.first.c_str(), (unsigned long long)item.second);
+    first = false;
+  }
+  fprintf(out, " },\n  \"state_transitions\": %llu\n}\n", (unsigned long long)transitions);
+
+  if(out != stdout) {
+    fclose(out);
+  }
+  return valid == captures.size() ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+// Share one OpenEVSE serial link between many local RAPI clients
+//
+// usage: rapi_bridge [-d device] [-b baud] [-S] [-c cycle_s] [-t port] [-a address] [-u path] [-s]
+//   -d  serial device, default /dev/ttyUSB0
+//   -S  use a simulated controller instead of a device, -c plugs a vehicle
+//       in and out every cycle_s seconds so there are events
+//   -t  listen on a TCP port, -a to bind to one address (e.g. 127.0.0.1)
+//   -u  listen on a Unix socket
+//   -s  use sequence IDs on the serial link
+//
+// Clients connect and send RAPI frames as they would on the serial port,
+// e.g. printf '$GS\r' | nc -q1 localhost 8023
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <openevse.h>
+
+#include "PosixSerialStream.h"
+#include "RapiBridge.h"
+#include "RapiReactor.h"
+#include "RapiSimulator.h"
+
+static volatile sig_atomic_t running = 1;
+
+static void onSignal(int)
+{
+  running = 0;
+}
+
+int main(int argc, char **argv)
+{
+  const char *device = "/dev/ttyUSB0";
+  uint32_t baud = 115200;
+  bool simulate = false;
+  int port = -1;
+  const char *address = NULL;
+  const char *path = NULL;
+  bool sequenceIds = false;
+  uint32_t cycle = 0;
+
+  int opt;
+  while(-1 != (opt = getopt(argc, argv, "d:b:Sc:t:a:u:s")))
+  {
+    switch(opt)
+    {
+      case 'd': device = optarg; break;
+      case 'b': baud = strtoul(optarg, NULL, 10); break;
+      case 'S': simulate = true; break;
+      case 'c': cycle = strtoul(optarg, NULL, 10); break;
+      case 't': port = atoi(optarg); break;
+      case 'a': address = optarg; break;
+      case 'u': path = optarg; break;
+      case 's': sequenceIds = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-d device] [-b baud] [-S] [-c cycle_s] [-t port] [-a address] [-u path] [-s]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(port < 0 && NULL == path) {
+    fprintf(stderr, "Nothing to listen on, give -t and/or -u\n");
+    return 1;
+  }
+
+  RapiReactor reactor;
+  RapiSimulatorPty sim;
+  if(simulate)
+  {
+    if(!sim.begin(reactor)) {
+      perror("simulator");
+      return 1;
+    }
+    sim.sim().setBaud(baud);
+    sim.sim().setLatency(2000, 1000);
+    device = sim.slaveName();
+  }
+
+  PosixSerialStream serial;
+  if(!serial.begin(device, baud)) {
+    perror(device);
+    return 1;
+  }
+
+  RapiSender rapi(&serial);
+  if(!reactor.add(rapi, serial, [](uint32_t) {
+    fprintf(stderr, "Serial link lost\n");
+    running = 0;
+  })) {
+    perror("reactor");
+    return 1;
+  }
+  rapi.enableSequenceId(sequenceIds ? 1 : 0);
+
+  RapiBridge bridge(reactor, rapi);
+  if(port >= 0 && !bridge.listenTcp(address, port)) {
+    perror("tcp");
+    return 1;
+  }
+  if(path && !bridge.listenUnix(path)) {
+    perror(path);
+    return 1;
+  }
+
+  RapiTimer cycleTimer([&sim]() {
+    if(OPENEVSE_STATE_NOT_CONNECTED == sim.sim().getState()) {
+      sim.sim().plugIn();
+    } else {
+      sim.sim().unplug();
+    }
+    sim.kick();
+  });
+  if(simulate && cycle > 0) {
+    reactor.timers().schedule(cycleTimer, cycle * 1000, cycle * 1000);
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  printf("Bridging %s\n", device);
+  fflush(stdout);
+
+  while(running && reactor.runOnce(1000)) {
+  }
+
+  bridge.end();
+  const RapiBridgeStats &stats = bridge.getStats();
+  printf("%u clients, %u commands, %u rejected, %u unanswered, %u events, %u dropped\n",
+    (unsigned)stats.clients, (unsigned)stats.commands, (unsigned)stats.rejected,
+    (unsigned)stats.unanswered, (unsigned)stats.events, (unsigned)stats.dropped);
+  return 0;
+}
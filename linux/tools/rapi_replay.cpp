@@ -0,0 +1,339 @@
+// Record, dump and replay RapiCaptureStream wire captures
+//
+// usage: rapi_replay [-f] [-n repeat] [-r read_timeout_ms] [-T timeout_ms] [-o file] capture
+//        rapi_replay -d capture
+//        rapi_replay -w capture [-t ms] [-b baud]
+//   replay  re-issues the captured commands through a RapiSender and plays
+//           the received bytes back, results are written as JSON
+//   -f      as fast as possible rather than with the original timing
+//   -d      print the capture as text
+//   -w      record a capture of OpenEVSEClass polling a RapiSimulator
+//
+// Parse time is the time spent in RapiSender::loop() while received bytes
+// were waiting, a rough measure of the parser cost per byte. It is only
+// meaningful with -f -r 0, otherwise it includes waiting for the rest of
+// each frame.
+
+#include <Arduino.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <openevse.h>
+#include <RapiCapture.h>
+
+#include "RapiReplay.h"
+#include "RapiSimulator.h"
+
+#define REPLAY_IDLE_TIMEOUT  2000 // ms with nothing left to send or receive
+#define RECORD_POLL_INTERVAL 100
+
+class FilePrint : public Print
+{
+  private:
+    FILE *_file;
+
+  public:
+    FilePrint(FILE *file) : _file(file) { }
+
+    size_t write(uint8_t c) {
+      return EOF == fputc(c, _file) ? 0 : 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size) {
+      return fwrite(buffer, 1, size, _file);
+    }
+    using Print::write;
+};
+
+struct ReplayResult
+{
+  uint32_t commands;
+  uint32_t ok;
+  uint32_t nk;
+  uint32_t timeouts;
+  uint32_t errors;
+  uint32_t events;
+  uint32_t mismatches;
+  uint64_t elapsed;
+  uint64_t parse;
+};
+
+static bool load(const char *name, std::vector<uint8_t> &data)
+{
+  FILE *in = fopen(name, "rb");
+  if(NULL == in) {
+    perror(name);
+    return false;
+  }
+
+  uint8_t buffer[4096];
+  size_t n;
+  while((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(in);
+  return true;
+}
+
+static int dump(const std::vector<uint8_t> &data)
+{
+  RapiCaptureReader reader;
+  if(!reader.begin(data.data(), data.size())) {
+    fprintf(stderr, "Not a RAPI capture\n");
+    return 1;
+  }
+
+  printf("# start %u, baud %u\n", (unsigned)reader.header().start_time, (unsigned)reader.header().baud);
+
+  RapiCaptureRecord record;
+  while(reader.next(record))
+  {
+    printf("%10u %s ", (unsigned)record.time, record.tx ? "TX" : "RX");
+    for(int i = 0; i < record.length; i++)
+    {
+      uint8_t c = record.data[i];
+      if('\r' == c) {
+        printf("\\r");
+      } else if(c < ' ' || c > '~') {
+        printf("\\x%02X", c);
+      } else {
+        putchar(c);
+      }
+    }
+    putchar('\n');
+  }
+
+  if(!reader.atEnd()) {
+    fprintf(stderr, "Capture truncated\n");
+    return 1;
+  }
+  return 0;
+}
+
+static int record(const char *name, uint32_t duration, uint32_t baud)
+{
+  FILE *out = fopen(name, "wb");
+  if(NULL == out) {
+    perror(name);
+    return 1;
+  }
+
+  FilePrint file(out);
+  RapiSimulator sim;
+  RapiCaptureStream tap(&sim);
+  RapiSender rapi(&tap);
+  OpenEVSEClass evse;
+
+  sim.setBaud(baud);
+  sim.setLatency(2000, 1000);
+  tap.begin(file, baud);
+
+  bool done = false;
+  evse.begin(rapi, [&](bool) { done = true; });
+  while(!done) {
+    rapi.loop();
+  }
+  // begin() turns them off, exercise the sequence ID path
+  rapi.enableSequenceId(1);
+
+  uint32_t start = millis();
+  uint32_t lastPoll = start;
+  uint32_t polls = 0;
+  bool plugged = false;
+  while(millis() - start < duration)
+  {
+    uint32_t now = millis();
+    if(now - lastPoll >= RECORD_POLL_INTERVAL)
+    {
+      lastPoll = now;
+      switch(polls++ % 4)
+      {
+        case 0:
+          evse.getStatus([](int, uint8_t, uint32_t, uint8_t, uint32_t) { });
+          break;
+        case 1:
+          evse.getChargeCurrentAndVoltage([](int, double, double) { });
+          break;
+        case 2:
+          evse.getEnergy([](int, double, double) { });
+          break;
+        case 3:
+          evse.heartbeatPulse([](int) { });
+          break;
+      }
+
+      if(0 == polls % 20) {
+        plugged = !plugged;
+        if(plugged) {
+          sim.plugIn();
+        } else {
+          sim.unplug();
+        }
+      }
+    }
+    rapi.loop();
+  }
+
+  tap.end();
+  fclose(out);
+  fprintf(stderr, "%u bytes, %u commands\n", (unsigned)tap.getCaptureSize(), (unsigned)rapi.getSent());
+  return 0;
+}
+
+static void replay(RapiReplayStream &stream, bool fast, uint32_t readTimeout, uint32_t timeout, ReplayResult &result)
+{
+  RapiSender rapi(&stream);
+  const std::vector<RapiReplayCommand> &commands = stream.commands();
+
+  stream.setRealTime(!fast);
+  rapi.setReadTimeout(readTimeout);
+  rapi.setRetries(0);
+  rapi.setOnEvent([&result]() { result.events++; });
+
+  size_t next = 0;
+  bool busy = false;
+  uint32_t idle = millis();
+
+  stream.restart();
+  uint32_t start = micros();
+  while(true)
+  {
+    if(!busy && next < commands.size() &&
+       (fast || micros() - stream.getBase() >= commands[next].time))
+    {
+      const RapiReplayCommand &command = commands[next++];
+      rapi.enableSequenceId(command.seq >= 0 ? 1 : 0);
+      if(command.seq >= 0) {
+        // The sender increments before sending, so this reproduces the ID
+        rapi.setSequenceId(command.seq - 1);
+      }
+
+      busy = true;
+      result.commands++;
+      rapi.sendCmd(command.command.c_str(), [&result, &busy](int ret) {
+        busy = false;
+        switch(ret)
+        {
+          case RAPI_RESPONSE_OK: result.ok++; break;
+          case RAPI_RESPONSE_NK: result.nk++; break;
+          case RAPI_RESPONSE_TIMEOUT: result.timeouts++; break;
+          default: result.errors++; break;
+        }
+      }, timeout);
+    }
+
+    if(stream.available() > 0)
+    {
+      uint32_t parse = micros();
+      rapi.loop();
+      result.parse += micros() - parse;
+      idle = millis();
+    } else {
+      rapi.loop();
+    }
+
+    if(!busy && next >= commands.size() &&
+       (stream.done() || millis() - idle > REPLAY_IDLE_TIMEOUT))
+    {
+      break;
+    }
+  }
+
+  result.elapsed += micros() - start;
+  result.mismatches += stream.getMismatches();
+}
+
+static int usage(const char *name)
+{
+  fprintf(stderr,
+    "usage: %s [-f] [-n repeat] [-r read_timeout_ms] [-T timeout_ms] [-o file] capture\n"
+    "       %s -d capture\n"
+    "       %s -w capture [-t ms] [-b baud]\n", name, name, name);
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  bool fast = false;
+  bool dumpOnly = false;
+  const char *recordTo = NULL;
+  uint32_t duration = 10000;
+  uint32_t baud = 115200;
+  uint32_t repeat = 1;
+  uint32_t readTimeout = RAPI_READ_TIMEOUT_MS;
+  uint32_t timeout = RAPI_TIMEOUT_MS;
+  const char *output = NULL;
+
+  int opt;
+  while(-1 != (opt = getopt(argc, argv, "fn:r:T:o:dw:t:b:")))
+  {
+    switch(opt)
+    {
+      case 'f': fast = true; break;
+      case 'n': repeat = strtoul(optarg, NULL, 10); break;
+      case 'r': readTimeout = strtoul(optarg, NULL, 10); break;
+      case 'T': timeout = strtoul(optarg, NULL, 10); break;
+      case 'o': output = optarg; break;
+      case 'd': dumpOnly = true; break;
+      case 'w': recordTo = optarg; break;
+      case 't': duration = strtoul(optarg, NULL, 10); break;
+      case 'b': baud = strtoul(optarg, NULL, 10); break;
+      default:
+        return usage(argv[0]);
+    }
+  }
+
+  if(recordTo) {
+    return record(recordTo, duration, baud);
+  }
+  if(optind != argc - 1) {
+    return usage(argv[0]);
+  }
+
+  std::vector<uint8_t> data;
+  if(!load(argv[optind], data)) {
+    return 1;
+  }
+  if(dumpOnly) {
+    return dump(data);
+  }
+
+  RapiReplayStream stream;
+  if(!stream.begin(data.data(), data.size())) {
+    fprintf(stderr, "Not a RAPI capture, or truncated\n");
+    return 1;
+  }
+
+  ReplayResult result = {};
+  for(uint32_t i = 0; i < repeat; i++) {
+    replay(stream, fast, readTimeout, timeout, result);
+  }
+
+  FILE *out = stdout;
+  if(output && NULL == (out = fopen(output, "w"))) {
+    perror(output);
+    return 1;
+  }
+
+  double seconds = result.elapsed / 1000000.0;
+  uint64_t rxBytes = (uint64_t)stream.getRxSize() * repeat;
+  fprintf(out, "{\n  \"benchmark\": \"rapi_replay\",\n  \"capture\": \"%s\",\n  \"mode\": \"%s\",\n  \"repeat\": %u,\n"
+    "  \"capture_ms\": %u,\n  \"elapsed_ms\": %u,\n"
+    "  \"commands\": %u,\n  \"ok\": %u,\n  \"nk\": %u,\n  \"timeouts\": %u,\n  \"errors\": %u,\n  \"events\": %u,\n"
+    "  \"tx_mismatches\": %u,\n  \"cmds_per_sec\": %.1f,\n  \"rx_bytes\": %llu,\n  \"parse_ns_per_byte\": %.1f\n}\n",
+    argv[optind], fast ? "fast" : "realtime", (unsigned)repeat,
+    (unsigned)(stream.getDuration() / 1000), (unsigned)(result.elapsed / 1000),
+    (unsigned)result.commands, (unsigned)result.ok, (unsigned)result.nk, (unsigned)result.timeouts,
+    (unsigned)result.errors, (unsigned)result.events, (unsigned)result.mismatches,
+    seconds > 0 ? result.commands / seconds : 0.0, (unsigned long long)rxBytes,
+    rxBytes ? result.parse * 1000.0 / rxBytes : 0.0);
+  if(out != stdout) {
+    fclose(out);
+  }
+
+  return result.mismatches || result.errors ? 2 : 0;
+}
@@ -0,0 +1,95 @@
+// Simulated OpenEVSE controllers behind ptys, point a client (or the
+// OpenEVSE WiFi firmware's native build) at the printed device names
+//
+// usage: rapi_sim [-n count] [-l latency_us] [-j jitter_us] [-b baud]
+//                 [-c cycle_s] [-s seed] [-L] [-D]
+//   -L  legacy pre 5.0.0 protocol
+//   -D  linco-work D9 extensions
+//   -c  plug in / unplug a vehicle every cycle_s seconds
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+#include <openevse.h>
+
+#include "RapiReactor.h"
+#include "RapiSimulator.h"
+
+int main(int argc, char **argv)
+{
+  int count = 1;
+  uint32_t latency = 2000;
+  uint32_t jitter = 0;
+  uint32_t baud = 115200;
+  uint32_t cycle = 0;
+  uint32_t seed = 1;
+  bool legacy = false;
+  bool d9 = false;
+
+  int opt;
+  while(-1 != (opt = getopt(argc, argv, "n:l:j:b:c:s:LD")))
+  {
+    switch(opt)
+    {
+      case 'n': count = atoi(optarg); break;
+      case 'l': latency = strtoul(optarg, NULL, 10); break;
+      case 'j': jitter = strtoul(optarg, NULL, 10); break;
+      case 'b': baud = strtoul(optarg, NULL, 10); break;
+      case 'c': cycle = strtoul(optarg, NULL, 10); break;
+      case 's': seed = strtoul(optarg, NULL, 10); break;
+      case 'L': legacy = true; break;
+      case 'D': d9 = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-n count] [-l latency_us] [-j jitter_us] [-b baud] [-c cycle_s] [-s seed] [-L] [-D]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  RapiReactor reactor;
+  std::vector<std::unique_ptr<RapiSimulatorPty>> sims;
+
+  for(int i = 0; i < count; i++)
+  {
+    RapiSimulatorPty *pty = new RapiSimulatorPty();
+    sims.emplace_back(pty);
+
+    RapiSimulator &sim = pty->sim();
+    sim.setLatency(latency, jitter);
+    sim.setBaud(baud);
+    sim.setSeed(seed + i);
+    sim.setLegacy(legacy);
+    if(d9) {
+      sim.setVersion(RAPI_SIMULATOR_FIRMWARE, "6.0.0");
+      sim.setD9(true);
+    }
+
+    if(!pty->begin(reactor)) {
+      perror("pty");
+      return 1;
+    }
+    printf("%s\n", pty->slaveName());
+  }
+  fflush(stdout);
+
+  RapiTimer cycleTimer([&sims]() {
+    for(auto &pty : sims) {
+      RapiSimulator &sim = pty->sim();
+      if(OPENEVSE_STATE_NOT_CONNECTED == sim.getState()) {
+        sim.plugIn();
+      } else {
+        sim.unplug();
+      }
+      pty->kick();
+    }
+  });
+  if(cycle > 0) {
+    reactor.timers().schedule(cycleTimer, cycle * 1000, cycle * 1000);
+  }
+
+  reactor.run();
+  return 0;
+}
@@ -0,0 +1,46 @@
+// Decode a binary trace written by rapiTraceWrite()
+//
+// usage: rapi_trace_decode [file]    (reads stdin if no file is given)
+
+#include <stdio.h>
+#include <string.h>
+
+#include "RapiTrace.h"
+
+int main(int argc, char **argv)
+{
+  FILE *in = stdin;
+  if(argc > 1 && NULL == (in = fopen(argv[1], "rb"))) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  RapiTraceHeader header;
+  if(1 != fread(&header, sizeof(header), 1, in) ||
+     RAPI_TRACE_MAGIC != header.magic)
+  {
+    fprintf(stderr, "Not a RAPI trace\n");
+    return 1;
+  }
+  if(RAPI_TRACE_VERSION != header.version || sizeof(RapiTraceRecord) != header.record_size) {
+    fprintf(stderr, "Unsupported trace version %u, record size %u\n",
+      (unsigned)header.version, (unsigned)header.record_size);
+    return 1;
+  }
+
+  printf("# %u records, %u dropped\n", (unsigned)header.records, (unsigned)header.dropped);
+  printf("#     time link event        cmd res sq value\n");
+
+  RapiTraceRecord record;
+  char line[80];
+  for(uint32_t i = 0; i < header.records && 1 == fread(&record, sizeof(record), 1, in); i++)
+  {
+    rapiTraceFormat(record, line, sizeof(line));
+    puts(line);
+  }
+
+  if(in != stdin) {
+    fclose(in);
+  }
+  return 0;
+}
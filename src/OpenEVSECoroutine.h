@@ -0,0 +1,443 @@
+#ifndef __OPENEVSE_COROUTINE_H
+#define __OPENEVSE_COROUTINE_H
+
+// C++20 coroutine support for OpenEVSEClass, included by openevse.h when
+// OPENEVSE_ENABLE_COROUTINES is set. Header only, the library itself is
+// built as C++17.
+//
+//   OpenEVSETask poll(OpenEVSEFramePool &pool, OpenEVSEClass &evse)
+//   {
+//     OpenEVSEVersionResult version = co_await evse.connect(sender);
+//     if(RAPI_RESPONSE_OK != version.ret) {
+//       co_return;
+//     }
+//     co_await evse.setCurrentCapacity(16, false);
+//     OpenEVSEStatusResult status = co_await evse.status();
+//     ...
+//   }
+//
+// A coroutine taking an OpenEVSEFramePool as its first parameter (second
+// for a member function) has its frame allocated from the pool. The
+// commands queue in the RapiSender as usual, the coroutine resumes from
+// RapiSender::loop() when the response is in.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+
+#include "openevse.h"
+
+#define OPENEVSE_AWAIT_COMMAND_LEN 32
+
+// Fixed size blocks from a buffer the caller provides, e.g. static or
+// reserved at start up, so coroutine frames need no heap. Frames too big
+// for a block, or with the pool empty, fall back to the heap and are
+// counted.
+class OpenEVSEFramePool
+{
+  private:
+    struct Block {
+      Block *next;
+    };
+
+    uint8_t *_buffer;
+    size_t _size;
+    size_t _blockSize;
+    Block *_free;
+    uint32_t _used;
+    uint32_t _highWater;
+    uint32_t _fallbacks;
+
+  public:
+    OpenEVSEFramePool(void *buffer, size_t size, size_t blockSize) :
+      _buffer((uint8_t *)buffer),
+      _size(0),
+      _blockSize(0),
+      _free(nullptr),
+      _used(0),
+      _highWater(0),
+      _fallbacks(0)
+    {
+      // Keep every block aligned for the frame
+      const size_t align = alignof(std::max_align_t);
+      _blockSize = (blockSize + align - 1) & ~(align - 1);
+      size_t skip = (align - ((uintptr_t)_buffer & (align - 1))) & (align - 1);
+      if(size <= skip || _blockSize < sizeof(Block)) {
+        return;
+      }
+      _buffer += skip;
+      _size = size - skip;
+
+      for(size_t offset = 0; offset + _blockSize <= _size; offset += _blockSize)
+      {
+        Block *block = (Block *)(_buffer + offset);
+        block->next = _free;
+        _free = block;
+      }
+    }
+
+    OpenEVSEFramePool(const OpenEVSEFramePool &) = delete;
+    OpenEVSEFramePool &operator=(const OpenEVSEFramePool &) = delete;
+
+    // nullptr if size does not fit a block or all are in use
+    void *allocate(size_t size)
+    {
+      if(size > _blockSize || nullptr == _free) {
+        _fallbacks++;
+        return nullptr;
+      }
+      Block *block = _free;
+      _free = block->next;
+      if(++_used > _highWater) {
+        _highWater = _used;
+      }
+      return block;
+    }
+
+    void release(void *ptr)
+    {
+      Block *block = (Block *)ptr;
+      block->next = _free;
+      _free = block;
+      _used--;
+    }
+
+    size_t getBlockSize() {
+      return _blockSize;
+    }
+    uint32_t getUsed() {
+      return _used;
+    }
+    uint32_t getHighWater() {
+      return _highWater;
+    }
+    // Frames that had to come from the heap
+    uint32_t getFallbacks() {
+      return _fallbacks;
+    }
+};
+
+// Return type for fire and forget coroutines: they start straight away and
+// free their frame when they finish.
+class OpenEVSETask
+{
+  public:
+    struct promise_type
+    {
+      // Each frame starts with where it came from
+      struct Header {
+        OpenEVSEFramePool *pool;
+      };
+      static constexpr size_t HEADER_SIZE = (sizeof(Header) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+      static void *allocate(OpenEVSEFramePool *pool, size_t size)
+      {
+        void *ptr = pool ? pool->allocate(size + HEADER_SIZE) : nullptr;
+        if(nullptr == ptr) {
+          pool = nullptr;
+          ptr = ::operator new(size + HEADER_SIZE);
+        }
+        ((Header *)ptr)->pool = pool;
+        return (uint8_t *)ptr + HEADER_SIZE;
+      }
+
+      static void *operator new(size_t size) {
+        return allocate(nullptr, size);
+      }
+      // Unoptimised builds with GCC 12 may give a false -Wmismatched-new-delete
+      // for these, the frame is still freed by operator delete below
+      template<typename... Args>
+      static void *operator new(size_t size, OpenEVSEFramePool &pool, Args &&...) {
+        return allocate(&pool, size);
+      }
+      template<typename Self, typename... Args>
+      static void *operator new(size_t size, Self &, OpenEVSEFramePool &pool, Args &&...) {
+        return allocate(&pool, size);
+      }
+
+      // GCC follows the pool buffer into the heap branch and warns
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfree-nonheap-object"
+      static void operator delete(void *ptr)
+      {
+        void *block = (uint8_t *)ptr - HEADER_SIZE;
+        OpenEVSEFramePool *pool = ((Header *)block)->pool;
+        if(pool) {
+          pool->release(block);
+        } else {
+          ::operator delete(block);
+        }
+      }
+#pragma GCC diagnostic pop
+
+      OpenEVSETask get_return_object() {
+        return OpenEVSETask();
+      }
+      std::suspend_never initial_suspend() noexcept {
+        return {};
+      }
+      std::suspend_never final_suspend() noexcept {
+        return {};
+      }
+      void return_void() {
+      }
+      void unhandled_exception() {
+        std::terminate();
+      }
+    };
+};
+
+// One RAPI command, resumes the coroutine with the parsed response. Lives
+// in the coroutine frame while it waits, the sender's completion handler
+// only holds a pointer to it so std::function does not allocate.
+template<typename T>
+class OpenEVSEAwaitable
+{
+  public:
+    typedef void (OpenEVSEClass::*Parser)(int ret, T &result);
+
+  private:
+    enum State {
+      Idle,
+      Sending,
+      Waiting,
+      Done
+    };
+
+    OpenEVSEClass &_evse;
+    char _command[OPENEVSE_AWAIT_COMMAND_LEN];
+    Parser _parse;
+    T _result;
+    State _state;
+    std::coroutine_handle<> _waiting;
+
+    void _complete(int ret)
+    {
+      (_evse.*_parse)(ret, _result);
+      if(Waiting == _state) {
+        // The frame, and so this, may be gone once this returns
+        _waiting.resume();
+      } else {
+        _state = Done;
+      }
+    }
+
+  public:
+    OpenEVSEAwaitable(OpenEVSEClass &evse, const char *command, Parser parse) :
+      _evse(evse),
+      _command{},
+      _parse(parse),
+      _result{},
+      _state(Idle),
+      _waiting()
+    {
+      snprintf(_command, sizeof(_command), "%s", command);
+    }
+
+    bool await_ready()
+    {
+      // Not begun, as if there was no answer
+      if(nullptr == _evse._sender) {
+        _result.ret = RAPI_RESPONSE_TIMEOUT;
+        return true;
+      }
+      return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> waiting)
+    {
+      _waiting = waiting;
+      _state = Sending;
+      _evse._sender->sendCmd(_command, [this](int ret) { _complete(ret); });
+      // A full queue completes straight away, carry on without suspending
+      if(Done == _state) {
+        return false;
+      }
+      _state = Waiting;
+      return true;
+    }
+
+    T await_resume() {
+      return _result;
+    }
+};
+
+// Resume after ms on the sender's timer wheel, for polling loops
+class OpenEVSEWaitAwaitable
+{
+  private:
+    RapiTimerWheel *_timers;
+    uint32_t _ms;
+    RapiTimer _timer;
+    std::coroutine_handle<> _waiting;
+
+  public:
+    OpenEVSEWaitAwaitable(RapiTimerWheel *timers, uint32_t ms) :
+      _timers(timers),
+      _ms(ms),
+      _timer(),
+      _waiting()
+    {
+    }
+
+    bool await_ready() {
+      return nullptr == _timers || 0 == _ms;
+    }
+
+    void await_suspend(std::coroutine_handle<> waiting)
+    {
+      _waiting = waiting;
+      _timer.setHandler([this]() {
+        // The frame, with the timer in it, may be gone once this returns
+        std::coroutine_handle<> waiting = _waiting;
+        waiting.resume();
+      });
+      _timers->schedule(_timer, _ms);
+    }
+
+    void await_resume() {
+    }
+};
+
+inline OpenEVSEWaitAwaitable OpenEVSEClass::wait(uint32_t ms)
+{
+  return OpenEVSEWaitAwaitable(_sender ? _sender->getTimerWheel() : nullptr, ms);
+}
+
+#if OPENEVSE_ENABLE_HEARTBEAT
+// heartbeatPulse(): $SY, and if that is $NK because a pulse was missed
+// $SY 165 to acknowledge it, as one await
+class OpenEVSEHeartbeatAwaitable
+{
+  private:
+    OpenEVSEClass &_evse;
+    bool _ackMissed;
+    bool _acking;
+    bool _suspended;
+    bool _done;
+    OpenEVSEResult _result;
+    std::coroutine_handle<> _waiting;
+
+    void _complete(int ret)
+    {
+      // A missed pulse limited the pilot, the ack restores it
+      if(RAPI_RESPONSE_NK == ret || _acking) {
+        _evse.cacheInvalidate(OPENEVSE_CACHE_CURRENT_CAPACITY | OPENEVSE_CACHE_SETTINGS);
+      }
+      if(RAPI_RESPONSE_NK == ret && _ackMissed && !_acking) {
+        _acking = true;
+        _evse._sender->sendCmd("$SY 165", [this](int ret) { _complete(ret); });
+        return;
+      }
+
+      _result.ret = ret;
+      if(_suspended) {
+        _waiting.resume();
+      } else {
+        _done = true;
+      }
+    }
+
+  public:
+    OpenEVSEHeartbeatAwaitable(OpenEVSEClass &evse, bool ack_missed) :
+      _evse(evse),
+      _ackMissed(ack_missed),
+      _acking(false),
+      _suspended(false),
+      _done(false),
+      _result{},
+      _waiting()
+    {
+    }
+
+    bool await_ready()
+    {
+      if(nullptr == _evse._sender) {
+        _result.ret = RAPI_RESPONSE_TIMEOUT;
+        return true;
+      }
+      return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> waiting)
+    {
+      _waiting = waiting;
+      _evse._sender->sendCmd("$SY", [this](int ret) { _complete(ret); });
+      if(_done) {
+        return false;
+      }
+      _suspended = true;
+      return true;
+    }
+
+    OpenEVSEResult await_resume() {
+      return _result;
+    }
+};
+
+inline OpenEVSEHeartbeatAwaitable OpenEVSEClass::heartbeat(bool ack_missed)
+{
+  return OpenEVSEHeartbeatAwaitable(*this, ack_missed);
+}
+#endif // OPENEVSE_ENABLE_HEARTBEAT
+
+inline OpenEVSEAwaitable<OpenEVSEVersionResult> OpenEVSEClass::connect(RapiSender &sender)
+{
+  _connected = false;
+  _statusValid = false;
+  _vflagsKnown = false;
+  _capacityKnown = false;
+  cacheInvalidate(OPENEVSE_CACHE_ALL);
+  attach(sender);
+  _sender->enableSequenceId(0);
+  return OpenEVSEAwaitable<OpenEVSEVersionResult>(*this, "$GV", &OpenEVSEClass::parseConnect);
+}
+
+inline OpenEVSEAwaitable<OpenEVSEResult> OpenEVSEClass::command(const char *command)
+{
+  return OpenEVSEAwaitable<OpenEVSEResult>(*this, command, &OpenEVSEClass::parseResult);
+}
+
+inline OpenEVSEAwaitable<OpenEVSEVersionResult> OpenEVSEClass::version()
+{
+  return OpenEVSEAwaitable<OpenEVSEVersionResult>(*this, "$GV", &OpenEVSEClass::parseVersion);
+}
+
+inline OpenEVSEAwaitable<OpenEVSEStatusResult> OpenEVSEClass::status()
+{
+  return OpenEVSEAwaitable<OpenEVSEStatusResult>(*this, "$GS", &OpenEVSEClass::parseStatus);
+}
+
+inline OpenEVSEAwaitable<OpenEVSEChargeResult> OpenEVSEClass::chargeCurrentAndVoltage()
+{
+  return OpenEVSEAwaitable<OpenEVSEChargeResult>(*this, "$GG", &OpenEVSEClass::parseChargeCurrentAndVoltage);
+}
+
+inline OpenEVSEAwaitable<OpenEVSETemperatureResult> OpenEVSEClass::temperature()
+{
+  return OpenEVSEAwaitable<OpenEVSETemperatureResult>(*this, "$GP", &OpenEVSEClass::parseTemperature);
+}
+
+inline OpenEVSEAwaitable<OpenEVSEEnergyResult> OpenEVSEClass::energy()
+{
+  return OpenEVSEAwaitable<OpenEVSEEnergyResult>(*this, "$GU", &OpenEVSEClass::parseEnergy);
+}
+
+inline OpenEVSEAwaitable<OpenEVSECurrentCapacityResult> OpenEVSEClass::currentCapacity()
+{
+  return OpenEVSEAwaitable<OpenEVSECurrentCapacityResult>(*this, "$GC", &OpenEVSEClass::parseCurrentCapacity);
+}
+
+inline OpenEVSEAwaitable<OpenEVSEPilotResult> OpenEVSEClass::setCurrentCapacity(long amps, bool save)
+{
+  char command[OPENEVSE_AWAIT_COMMAND_LEN];
+  snprintf(command, sizeof(command), "$SC %ld%s", amps, save ? "" : " V");
+  return OpenEVSEAwaitable<OpenEVSEPilotResult>(*this, command, &OpenEVSEClass::parsePilot);
+}
+
+#endif // __OPENEVSE_COROUTINE_H
@@ -0,0 +1,214 @@
+#include <string.h>
+#include <time.h>
+
+#include "RapiCapture.h"
+
+// Anything earlier and the RTC/NTP has not set the clock
+#define RAPI_CAPTURE_VALID_TIME 1577836800 // 2020-01-01
+
+RapiCaptureStream::RapiCaptureStream(Stream *stream) :
+  _stream(stream),
+  _sink(NULL),
+  _last(0),
+  _chunkTime(0),
+  _lastByte(0),
+  _bytes(0),
+  _chunkTx(false),
+  _chunkLength(0)
+{
+}
+
+void RapiCaptureStream::begin(Print &sink, uint32_t baud)
+{
+  end();
+
+  time_t now = time(NULL);
+  RapiCaptureHeader header = {
+    RAPI_CAPTURE_MAGIC,
+    RAPI_CAPTURE_VERSION,
+    0,
+    now >= RAPI_CAPTURE_VALID_TIME ? (uint32_t)now : 0,
+    baud
+  };
+
+  _sink = &sink;
+  _last = micros();
+  _bytes = _sink->write((const uint8_t *)&header, sizeof(header));
+}
+
+void RapiCaptureStream::end()
+{
+  flushCapture();
+  _sink = NULL;
+}
+
+void RapiCaptureStream::flushCapture()
+{
+  if(NULL == _sink || 0 == _chunkLength) {
+    return;
+  }
+
+  uint8_t head[6];
+  size_t len = 0;
+  head[len++] = (_chunkTx ? RAPI_CAPTURE_TX : 0) | _chunkLength;
+
+  uint32_t delta = _chunkTime - _last;
+  do {
+    head[len++] = (delta & 0x7f) | (delta > 0x7f ? 0x80 : 0);
+    delta >>= 7;
+  } while(delta);
+
+  _bytes += _sink->write(head, len);
+  _bytes += _sink->write(_chunk, _chunkLength);
+  _last = _chunkTime;
+  _chunkLength = 0;
+}
+
+void RapiCaptureStream::_record(bool tx, const uint8_t *data, size_t length)
+{
+  if(NULL == _sink || 0 == length) {
+    return;
+  }
+
+  uint32_t now = micros();
+  while(length > 0)
+  {
+    if(_chunkLength > 0 &&
+       (tx != _chunkTx ||
+        RAPI_CAPTURE_MAX_CHUNK == _chunkLength ||
+        now - _lastByte > RAPI_CAPTURE_MERGE_US))
+    {
+      flushCapture();
+    }
+    if(0 == _chunkLength) {
+      _chunkTx = tx;
+      _chunkTime = now;
+    }
+
+    size_t n = RAPI_CAPTURE_MAX_CHUNK - _chunkLength;
+    if(n > length) {
+      n = length;
+    }
+    memcpy(_chunk + _chunkLength, data, n);
+    _lastByte = now;
+    _chunkLength += n;
+    data += n;
+    length -= n;
+  }
+}
+
+int RapiCaptureStream::available()
+{
+  return _stream->available();
+}
+
+int RapiCaptureStream::read()
+{
+  int c = _stream->read();
+  if(c >= 0) {
+    uint8_t byte = (uint8_t)c;
+    _record(false, &byte, 1);
+  }
+  return c;
+}
+
+int RapiCaptureStream::peek()
+{
+  return _stream->peek();
+}
+
+size_t RapiCaptureStream::write(uint8_t c)
+{
+  size_t n = _stream->write(c);
+  if(n) {
+    _record(true, &c, 1);
+  }
+  return n;
+}
+
+size_t RapiCaptureStream::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = _stream->write(buffer, size);
+  _record(true, buffer, n);
+  return n;
+}
+
+int RapiCaptureStream::availableForWrite()
+{
+  return _stream->availableForWrite();
+}
+
+void RapiCaptureStream::flush()
+{
+  _stream->flush();
+}
+
+RapiCaptureReader::RapiCaptureReader() :
+  _data(NULL),
+  _size(0),
+  _pos(0),
+  _time(0),
+  _header()
+{
+}
+
+bool RapiCaptureReader::begin(const void *data, size_t size)
+{
+  _data = NULL;
+  _size = 0;
+  if(size < sizeof(_header)) {
+    return false;
+  }
+
+  memcpy(&_header, data, sizeof(_header));
+  if(RAPI_CAPTURE_MAGIC != _header.magic || RAPI_CAPTURE_VERSION != _header.version) {
+    return false;
+  }
+
+  _data = (const uint8_t *)data;
+  _size = size;
+  rewind();
+  return true;
+}
+
+void RapiCaptureReader::rewind()
+{
+  _pos = sizeof(_header);
+  _time = 0;
+}
+
+bool RapiCaptureReader::next(RapiCaptureRecord &record)
+{
+  if(NULL == _data || _pos >= _size) {
+    return false;
+  }
+
+  size_t pos = _pos;
+  uint8_t head = _data[pos++];
+  uint8_t length = head & RAPI_CAPTURE_LENGTH_MASK;
+
+  uint32_t delta = 0;
+  for(int shift = 0; ; shift += 7)
+  {
+    if(pos >= _size || shift > 28) {
+      return false;
+    }
+    uint8_t b = _data[pos++];
+    delta |= (uint32_t)(b & 0x7f) << shift;
+    if(0 == (b & 0x80)) {
+      break;
+    }
+  }
+
+  if(0 == length || _size - pos < length) {
+    return false;
+  }
+
+  _time += delta;
+  record.time = _time;
+  record.tx = 0 != (head & RAPI_CAPTURE_TX);
+  record.length = length;
+  record.data = _data + pos;
+  _pos = pos + length;
+  return true;
+}
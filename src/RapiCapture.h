@@ -0,0 +1,121 @@
+#ifndef __RAPI_CAPTURE_H
+#define __RAPI_CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <Arduino.h>
+
+// Wire capture of a RAPI link. RapiCaptureStream sits between RapiSender
+// and its Stream and records every byte sent and received with a
+// microsecond timestamp, so a field incident can be replayed later (see
+// linux/src/RapiReplay.h).
+//
+// File format, little endian:
+//   RapiCaptureHeader
+//   records:
+//     uint8_t  RAPI_CAPTURE_TX | length (1 - 127)
+//     varint   micros() since the previous record (first: since begin())
+//     uint8_t  data[length]
+//
+// A burst of bytes going the same way, each within RAPI_CAPTURE_MERGE_US
+// of the one before, shares a record stamped with the time of its first
+// byte, so a frame read in one go costs 2 - 3 bytes of overhead.
+
+#define RAPI_CAPTURE_MAGIC       0x50414352 // "RCAP"
+#define RAPI_CAPTURE_VERSION     1
+
+#define RAPI_CAPTURE_TX          0x80
+#define RAPI_CAPTURE_LENGTH_MASK 0x7f
+#define RAPI_CAPTURE_MAX_CHUNK   127
+
+// A little over two character times at 115200 baud, so back to back bytes
+// at that rate merge but the per byte timing at 9600 baud is kept
+#ifndef RAPI_CAPTURE_MERGE_US
+#define RAPI_CAPTURE_MERGE_US    200
+#endif
+
+struct RapiCaptureHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t start_time;  // time() at begin(), 0 if the clock was not set
+  uint32_t baud;        // informational, 0 if unknown
+};
+
+struct RapiCaptureRecord {
+  uint32_t time;        // micros() since begin()
+  bool tx;
+  uint8_t length;
+  const uint8_t *data;
+};
+
+class RapiCaptureStream : public Stream
+{
+  private:
+    Stream *_stream;
+    Print *_sink;
+    uint32_t _last;
+    uint32_t _chunkTime;
+    uint32_t _lastByte;
+    uint32_t _bytes;
+    bool _chunkTx;
+    uint8_t _chunkLength;
+    uint8_t _chunk[RAPI_CAPTURE_MAX_CHUNK];
+
+    void _record(bool tx, const uint8_t *data, size_t length);
+
+  public:
+    RapiCaptureStream(Stream *stream);
+
+    // Start writing a capture to sink, the sink must stay valid until end()
+    void begin(Print &sink, uint32_t baud = 0);
+    // Write out the buffered record and stop capturing
+    void end();
+    // Write out the buffered record, e.g. before syncing the sink
+    void flushCapture();
+
+    // Bytes of capture written so far, header included
+    uint32_t getCaptureSize() {
+      return _bytes;
+    }
+
+    // Stream, passed through to the wrapped stream
+    int available();
+    int read();
+    int peek();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    int availableForWrite();
+    void flush();
+};
+
+// Walk the records of a capture held in memory
+class RapiCaptureReader
+{
+  private:
+    const uint8_t *_data;
+    size_t _size;
+    size_t _pos;
+    uint32_t _time;
+    RapiCaptureHeader _header;
+
+  public:
+    RapiCaptureReader();
+
+    // false if data is not a capture this version understands
+    bool begin(const void *data, size_t size);
+    const RapiCaptureHeader &header() {
+      return _header;
+    }
+    void rewind();
+    // false at the end of the capture or if it is truncated
+    bool next(RapiCaptureRecord &record);
+    // true once next() has returned every record
+    bool atEnd() {
+      return _pos >= _size;
+    }
+};
+
+#endif // __RAPI_CAPTURE_H
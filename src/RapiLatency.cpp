@@ -0,0 +1,142 @@
+#include <string.h>
+
+#include "RapiLatency.h"
+
+RapiLatencyHistogram::RapiLatencyHistogram() :
+  _counts{},
+  _count(0),
+  _max(0)
+{
+}
+
+int RapiLatencyHistogram::bucket(uint32_t us)
+{
+  if(us < RAPI_LATENCY_MIN_US) {
+    return 0;
+  }
+
+  int msb = 31 - __builtin_clz(us);
+  int octave = msb - RAPI_LATENCY_MIN_US_BITS;
+  if(octave >= RAPI_LATENCY_OCTAVES) {
+    return RAPI_LATENCY_BUCKETS - 1;
+  }
+
+  int sub = (us >> (msb - 2)) & 3;
+  return 1 + (octave * 4) + sub;
+}
+
+uint32_t RapiLatencyHistogram::bucketLimit(int bucket)
+{
+  if(0 == bucket) {
+    return RAPI_LATENCY_MIN_US;
+  }
+
+  int octave = (bucket - 1) / 4;
+  int sub = (bucket - 1) % 4;
+  return (uint32_t)(5 + sub) << (octave + RAPI_LATENCY_MIN_US_BITS - 2);
+}
+
+void RapiLatencyHistogram::add(uint32_t us)
+{
+  _counts[bucket(us)]++;
+  _count++;
+  if(us > _max) {
+    _max = us;
+  }
+}
+
+void RapiLatencyHistogram::reset()
+{
+  memset(_counts, 0, sizeof(_counts));
+  _count = 0;
+  _max = 0;
+}
+
+uint32_t RapiLatencyHistogram::percentile(double percentile) const
+{
+  if(0 == _count) {
+    return 0;
+  }
+
+  uint32_t rank = (uint32_t)((percentile * _count) / 100.0 + 0.5);
+  if(rank < 1) {
+    rank = 1;
+  }
+
+  uint32_t seen = 0;
+  for(int i = 0; i < RAPI_LATENCY_BUCKETS; i++)
+  {
+    seen += _counts[i];
+    if(seen >= rank && i < RAPI_LATENCY_BUCKETS - 1) {
+      uint32_t limit = bucketLimit(i);
+      return limit < _max ? limit : _max;
+    }
+  }
+
+  return _max;
+}
+
+RapiLatencyStats::RapiLatencyStats() :
+  _commands(),
+  _used(0)
+{
+}
+
+RapiCommandLatency *RapiLatencyStats::_get(const char *command)
+{
+  if('$' == *command) {
+    command++;
+  }
+  char code[3] = { '?', '?', '\0' };
+  if(command[0] && command[1]) {
+    code[0] = command[0];
+    code[1] = command[1];
+  }
+
+  RapiCommandLatency *entry = const_cast<RapiCommandLatency *>(find(code));
+  if(entry) {
+    return entry;
+  }
+
+  // Keep the last slot for anything that does not fit
+  if(_used >= RAPI_LATENCY_COMMANDS - 1 && '?' != code[0]) {
+    return _get("??");
+  }
+
+  entry = &_commands[_used++];
+  memcpy(entry->command, code, sizeof(code));
+  return entry;
+}
+
+void RapiLatencyStats::record(const char *command, uint32_t queue_wait, bool responded, uint32_t rtt, uint32_t handle)
+{
+  RapiCommandLatency *entry = _get(command);
+  entry->queueWait.add(queue_wait);
+  if(responded) {
+    entry->rtt.add(rtt);
+    entry->handle.add(handle);
+  }
+}
+
+void RapiLatencyStats::reset()
+{
+  for(size_t i = 0; i < _used; i++) {
+    _commands[i].queueWait.reset();
+    _commands[i].rtt.reset();
+    _commands[i].handle.reset();
+  }
+  _used = 0;
+}
+
+const RapiCommandLatency *RapiLatencyStats::find(const char *command) const
+{
+  if('$' == *command) {
+    command++;
+  }
+  for(size_t i = 0; i < _used; i++) {
+    if(0 == strncmp(_commands[i].command, command, 2)) {
+      return &_commands[i];
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,83 @@
+#ifndef __RAPI_LATENCY_H
+#define __RAPI_LATENCY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Log-linear histogram of microsecond durations. Values below
+// RAPI_LATENCY_MIN_US share the first bucket, above that each power of two
+// is split in to 4 buckets, giving +/-12.5% resolution up to ~67 seconds.
+
+#define RAPI_LATENCY_MIN_US_BITS 6
+#define RAPI_LATENCY_MIN_US      (1UL << RAPI_LATENCY_MIN_US_BITS)
+#define RAPI_LATENCY_OCTAVES     20
+#define RAPI_LATENCY_BUCKETS     (1 + (RAPI_LATENCY_OCTAVES * 4))
+
+// Number of distinct commands tracked, any more are added to the entry
+// with the command "??"
+#ifndef RAPI_LATENCY_COMMANDS
+#define RAPI_LATENCY_COMMANDS 16
+#endif
+
+class RapiLatencyHistogram
+{
+  private:
+    uint32_t _counts[RAPI_LATENCY_BUCKETS];
+    uint32_t _count;
+    uint32_t _max;
+
+  public:
+    RapiLatencyHistogram();
+
+    void add(uint32_t us);
+    void reset();
+
+    // Upper bound of the bucket holding the given percentile (0-100) in us
+    uint32_t percentile(double percentile) const;
+
+    uint32_t count() const {
+      return _count;
+    }
+    uint32_t max() const {
+      return _max;
+    }
+
+    static int bucket(uint32_t us);
+    static uint32_t bucketLimit(int bucket);
+};
+
+struct RapiCommandLatency
+{
+  char command[3];                // two letter RAPI command, e.g. "GS"
+  RapiLatencyHistogram queueWait; // sendCmd() until the first byte is written
+  RapiLatencyHistogram rtt;       // first byte written until the first byte of the response
+  RapiLatencyHistogram handle;    // first byte of the response until its handler returned
+};
+
+class RapiLatencyStats
+{
+  private:
+    RapiCommandLatency _commands[RAPI_LATENCY_COMMANDS];
+    size_t _used;
+
+    RapiCommandLatency *_get(const char *command);
+
+  public:
+    RapiLatencyStats();
+
+    // command is the command as sent, e.g. "$SC 32 V". rtt and handle are
+    // not recorded for commands that did not get a response.
+    void record(const char *command, uint32_t queue_wait, bool responded, uint32_t rtt, uint32_t handle);
+    void reset();
+
+    size_t count() const {
+      return _used;
+    }
+    const RapiCommandLatency &get(size_t i) const {
+      return _commands[i];
+    }
+    // Look up by command, with or without the leading '$'
+    const RapiCommandLatency *find(const char *command) const;
+};
+
+#endif // __RAPI_LATENCY_H
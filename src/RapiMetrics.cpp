@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "RapiMetrics.h"
+
+#define RAPI_METRICS_PREFIX "openevse_rapi_"
+
+struct RapiMetricsWriter
+{
+  char *buffer;
+  size_t size;
+  size_t length;
+
+  void printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+  {
+    char *pos = length < size ? buffer + length : NULL;
+    size_t left = length < size ? size - length : 0;
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(pos, left, format, args);
+    va_end(args);
+
+    if(written > 0) {
+      length += written;
+    }
+  }
+
+  // A label value, with \ " and newline escaped as the format requires
+  void label(const char *value)
+  {
+    while(*value)
+    {
+      size_t run = strcspn(value, "\\\"\n");
+      printf("%.*s", (int)run, value);
+      value += run;
+      if(*value) {
+        printf("\\%c", '\n' == *value ? 'n' : *value);
+        value++;
+      }
+    }
+  }
+};
+
+struct RapiCounter {
+  const char *name;
+  const char *label;
+  const char *help;
+  uint32_t RapiLinkStats::*value;
+};
+
+static const RapiCounter rapiCounters[] = {
+  { "commands_sent_total", NULL, "Commands written to the controller, including retries", &RapiLinkStats::sent },
+  { "command_retries_total", NULL, "Commands re-sent after a timeout", &RapiLinkStats::retries },
+  { "stale_responses_total", NULL, "Late replies to an earlier attempt of a command, dropped", &RapiLinkStats::stale },
+  { "responses_total", "result=\"ok\"", "Responses and errors by result", &RapiLinkStats::success },
+  { "responses_total", "result=\"nk\"", NULL, &RapiLinkStats::nk },
+  { "responses_total", "result=\"timeout\"", NULL, &RapiLinkStats::timeouts },
+  { "responses_total", "result=\"invalid\"", NULL, &RapiLinkStats::invalid },
+  { "responses_total", "result=\"bad_checksum\"", NULL, &RapiLinkStats::bad_checksum },
+  { "responses_total", "result=\"bad_sequence_id\"", NULL, &RapiLinkStats::bad_sequence_id },
+  { "responses_total", "result=\"buffer_overflow\"", NULL, &RapiLinkStats::buffer_overflow },
+  { "queue_full_total", NULL, "Commands rejected because the queue was full", &RapiLinkStats::queue_full },
+  { "bytes_total", "direction=\"tx\"", "Bytes written to and read from the link", &RapiLinkStats::bytes_out },
+  { "bytes_total", "direction=\"rx\"", NULL, &RapiLinkStats::bytes_in },
+};
+
+static const char *rapiAsyncEventNames[RAPI_ASYNC_EVENT_TYPES] = {
+  "ST", "AT", "AB", "AN", "WF", "other"
+};
+
+size_t rapiMetricsRenderPrometheus(char *buffer, size_t size,
+                                   const RapiLinkStats *stats,
+                                   const char * const *names,
+                                   size_t count)
+{
+  RapiMetricsWriter out = { buffer, size, 0 };
+  if(size > 0) {
+    *buffer = '\0';
+  }
+
+  for(size_t c = 0; c < sizeof(rapiCounters) / sizeof(rapiCounters[0]); c++)
+  {
+    const RapiCounter &counter = rapiCounters[c];
+    if(counter.help) {
+      out.printf("# HELP " RAPI_METRICS_PREFIX "%s %s\n", counter.name, counter.help);
+      out.printf("# TYPE " RAPI_METRICS_PREFIX "%s counter\n", counter.name);
+    }
+
+    for(size_t i = 0; i < count; i++) {
+      out.printf(RAPI_METRICS_PREFIX "%s{link=\"", counter.name);
+      out.label(names[i]);
+      out.printf("\"%s%s} %u\n",
+        counter.label ? "," : "", counter.label ? counter.label : "",
+        (unsigned)(stats[i].*counter.value));
+    }
+  }
+
+  out.printf("# HELP " RAPI_METRICS_PREFIX "async_events_total Asynchronous events received by type\n");
+  out.printf("# TYPE " RAPI_METRICS_PREFIX "async_events_total counter\n");
+  for(size_t i = 0; i < count; i++) {
+    for(int type = 0; type < RAPI_ASYNC_EVENT_TYPES; type++) {
+      out.printf(RAPI_METRICS_PREFIX "async_events_total{link=\"");
+      out.label(names[i]);
+      out.printf("\",type=\"%s\"} %u\n",
+        rapiAsyncEventNames[type], (unsigned)stats[i].async_events[type]);
+    }
+  }
+
+  out.printf("# HELP " RAPI_METRICS_PREFIX "queue_high_water Most commands waiting in the queue at once\n");
+  out.printf("# TYPE " RAPI_METRICS_PREFIX "queue_high_water gauge\n");
+  for(size_t i = 0; i < count; i++) {
+    out.printf(RAPI_METRICS_PREFIX "queue_high_water{link=\"");
+    out.label(names[i]);
+    out.printf("\"} %u\n", (unsigned)stats[i].queue_high_water);
+  }
+
+  return out.length;
+}
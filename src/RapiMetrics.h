@@ -0,0 +1,19 @@
+#ifndef __RAPI_METRICS_H
+#define __RAPI_METRICS_H
+
+#include <stddef.h>
+
+#include "RapiSender.h"
+
+// Render the link stats of one or more RAPI links in the Prometheus text
+// exposition format (version 0.0.4). Each link is labeled with the
+// matching entry of names, e.g. link="garage", escaped as needed.
+//
+// Returns the length of the output, if this is >= size the buffer was too
+// small and the output has been truncated (like snprintf).
+size_t rapiMetricsRenderPrometheus(char *buffer, size_t size,
+                                   const RapiLinkStats *stats,
+                                   const char * const *names,
+                                   size_t count);
+
+#endif // __RAPI_METRICS_H
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "RapiSchema.h"
+
+static bool rapiFieldActive(const RapiField &field, uint32_t protocol)
+{
+  return protocol >= field.since && (0 == field.before || protocol < field.before);
+}
+
+static void rapiStoreInteger(uint8_t *dest, uint8_t size, unsigned long value)
+{
+  switch(size)
+  {
+    case 1: {
+      uint8_t v = (uint8_t)value;
+      memcpy(dest, &v, sizeof(v));
+    } break;
+    case 2: {
+      uint16_t v = (uint16_t)value;
+      memcpy(dest, &v, sizeof(v));
+    } break;
+    case 4: {
+      uint32_t v = (uint32_t)value;
+      memcpy(dest, &v, sizeof(v));
+    } break;
+    case 8: {
+      uint64_t v = (uint64_t)value;
+      memcpy(dest, &v, sizeof(v));
+    } break;
+  }
+}
+
+int rapiParseResponse(RapiSender &sender, int ret, uint32_t protocol, uint8_t flags,
+                      const RapiField *fields, size_t count, void *result)
+{
+  if(RAPI_RESPONSE_OK != ret &&
+     !(RAPI_RESPONSE_NK == ret && (flags & RAPI_SCHEMA_NK_HAS_DATA)))
+  {
+    return ret;
+  }
+
+  int tokens = 1;
+  for(size_t i = 0; i < count; i++)
+  {
+    if(rapiFieldActive(fields[i], protocol) && fields[i].token >= tokens) {
+      tokens = fields[i].token + 1;
+    }
+  }
+  if(sender.getTokenCnt() < tokens) {
+    return RAPI_RESPONSE_INVALID_RESPONSE;
+  }
+
+  for(size_t i = 0; i < count; i++)
+  {
+    const RapiField &field = fields[i];
+    if(!rapiFieldActive(field, protocol)) {
+      continue;
+    }
+
+    const char *token = sender.getToken(field.token);
+    uint8_t *dest = (uint8_t *)result + field.offset;
+    switch(field.type)
+    {
+      case RAPI_FIELD_SIGNED:
+        rapiStoreInteger(dest, field.size, (unsigned long)strtol(token, NULL, field.radix));
+        break;
+      case RAPI_FIELD_UNSIGNED:
+        rapiStoreInteger(dest, field.size, strtoul(token, NULL, field.radix));
+        break;
+      case RAPI_FIELD_BOOL: {
+        bool value = 0 != strtol(token, NULL, field.radix);
+        memcpy(dest, &value, sizeof(value));
+      } break;
+      case RAPI_FIELD_DOUBLE: {
+        double value = (double)strtol(token, NULL, field.radix) / (double)field.scale;
+        memcpy(dest, &value, sizeof(value));
+      } break;
+      case RAPI_FIELD_STRING:
+        strncpy((char *)dest, token, field.size - 1);
+        dest[field.size - 1] = '\0';
+        break;
+      case RAPI_FIELD_TOKEN:
+        while(' ' == *token) {
+          token++;
+        }
+        memcpy(dest, &token, sizeof(token));
+        break;
+    }
+  }
+
+  return ret;
+}
@@ -0,0 +1,101 @@
+#ifndef __RAPI_SCHEMA_H
+#define __RAPI_SCHEMA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+
+#include "RapiSender.h"
+
+// Declarative RAPI response parsing. Each command's response is described
+// by a constexpr table of fields, the token it is in, the radix, a scale
+// and the protocol versions it applies to, and decoded straight in to the
+// typed result struct by one shared routine:
+//
+//   static constexpr RapiField settingsFields[] = {
+//     RAPI_FIELD(OpenEVSESettingsResult, pilot, 1, 10),
+//     RAPI_FIELD(OpenEVSESettingsResult, flags, 2, 16)
+//   };
+//   rapiParse(sender, ret, protocol, settingsFields, result);
+//
+// The field type and size come from the struct member, so a table can not
+// disagree with the struct it fills.
+
+#define RAPI_FIELD_SIGNED    0 // strtol, any size
+#define RAPI_FIELD_UNSIGNED  1 // strtoul, any size
+#define RAPI_FIELD_BOOL      2 // non zero
+#define RAPI_FIELD_DOUBLE    3 // strtol / scale
+#define RAPI_FIELD_STRING    4 // copied in to a char array
+#define RAPI_FIELD_TOKEN     5 // const char * to the token, leading spaces skipped,
+                               // only valid until the next response
+
+// The response to a NK has the same fields, e.g. $SC when clamped
+#define RAPI_SCHEMA_NK_HAS_DATA  0x01
+
+struct RapiField
+{
+  uint8_t type;       // RAPI_FIELD_*
+  uint8_t token;      // 1 is the first token after $OK
+  uint8_t radix;
+  uint8_t size;       // of the member
+  uint16_t offset;    // of the member in the result
+  uint16_t scale;     // RAPI_FIELD_DOUBLE divides by this
+  uint32_t since;     // first protocol version with the field, 0 for all
+  uint32_t before;    // protocol version that dropped it, 0 for none
+};
+
+template<typename T>
+struct RapiFieldType
+{
+  static_assert(std::is_arithmetic<T>::value, "RAPI fields must be numbers, char arrays or const char *");
+  static_assert(sizeof(T) <= sizeof(long) || std::is_floating_point<T>::value, "RAPI integer fields must fit a long");
+  static constexpr uint8_t value =
+    std::is_same<T, bool>::value ? RAPI_FIELD_BOOL :
+    std::is_floating_point<T>::value ? RAPI_FIELD_DOUBLE :
+    std::is_signed<T>::value ? RAPI_FIELD_SIGNED :
+    RAPI_FIELD_UNSIGNED;
+};
+template<size_t N>
+struct RapiFieldType<char[N]> {
+  static constexpr uint8_t value = RAPI_FIELD_STRING;
+};
+template<>
+struct RapiFieldType<const char *> {
+  static constexpr uint8_t value = RAPI_FIELD_TOKEN;
+};
+
+// member can be an array element, e.g. temp[1]
+#define RAPI_FIELD_TYPE_OF(T, member) \
+  RapiFieldType<typename std::remove_cv<typename std::remove_reference<decltype(T::member)>::type>::type>::value
+#define RAPI_FIELD_RANGE(T, member, token, radix, since, before) \
+  { RAPI_FIELD_TYPE_OF(T, member), (token), (radix), sizeof(T::member), offsetof(T, member), 1, (since), (before) }
+
+// Fields in every protocol version
+#define RAPI_FIELD(T, member, token, radix) \
+  RAPI_FIELD_RANGE(T, member, token, radix, 0, 0)
+// Fields added, or changed, in protocol version since
+#define RAPI_FIELD_SINCE(T, member, token, radix, since) \
+  RAPI_FIELD_RANGE(T, member, token, radix, since, 0)
+// Fields as they were before protocol version before
+#define RAPI_FIELD_BEFORE(T, member, token, radix, before) \
+  RAPI_FIELD_RANGE(T, member, token, radix, 0, before)
+// Decimal integer in 1/scale units, to a double
+#define RAPI_FIELD_SCALED(T, member, token, scale) \
+  { RAPI_FIELD_TYPE_OF(T, member), (token), 10, sizeof(T::member), offsetof(T, member), (scale), 0, 0 }
+
+// Decode the response just received in to result. Returns ret, or
+// RAPI_RESPONSE_INVALID_RESPONSE if there are too few tokens for the fields
+// of this protocol version. result is left alone unless it is decoded.
+int rapiParseResponse(RapiSender &sender, int ret, uint32_t protocol, uint8_t flags,
+                      const RapiField *fields, size_t count, void *result);
+
+// Typed front end, sets result.ret
+template<typename T, size_t N>
+inline int rapiParse(RapiSender &sender, int ret, uint32_t protocol, const RapiField (&fields)[N], T &result, uint8_t flags = 0)
+{
+  static_assert(std::is_standard_layout<T>::value, "RAPI results must be standard layout");
+  result.ret = rapiParseResponse(sender, ret, protocol, flags, fields, N, &result);
+  return result.ret;
+}
+
+#endif // __RAPI_SCHEMA_H
@@ -1,9 +1,11 @@
-#if defined(ENABLE_DEBUG) && !defined(ENABLE_DEBUG_RAPI)
+// The binary trace replaces the text debug, which disturbs the link timing
+#if defined(ENABLE_DEBUG) && (!defined(ENABLE_DEBUG_RAPI) || defined(ENABLE_RAPI_TRACE))
 #undef ENABLE_DEBUG
 #endif
 
 #include <Arduino.h>
 #include "RapiSender.h"
+#include "RapiTrace.h"
 #include "MicroDebug.h"
 
 #define dbgprint(s) DBUG(s)
@@ -12,8 +14,6 @@
 #define DBG
 #endif
 
-static CommandItem commandQueueItems[RAPI_MAX_COMMANDS];
-
 // convert 2-digit hex string to uint8_t
 uint8_t
 htou8(const char *s) {
@@ -40,20 +40,34 @@ htou8(const char *s) {
   return u;
 }
 
-RapiSender::RapiSender(Stream * stream) :
+RapiSender::RapiSender(Stream * stream, RapiTimerWheel *timers) :
   _stream(stream),
-  _sent(0),
-  _success(0),
+  _ownTimers(),
+  _timers(timers ? timers : &_ownTimers),
+  _stats(),
   _connected(false),
   _sequenceId(RAPI_INVALID_SEQUENCE_ID),
   _flags(0),
   _tokenCnt(0),
   _tokens{},
   _onRapiEvent(nullptr),
-  _commandQueue(commandQueueItems, RAPI_MAX_COMMANDS),
-  _completeHandler(nullptr),
-  _timeout(0),
+  _traceLink(0),
+  _commandQueueItems(),
+  _commandQueue(_commandQueueItems, RAPI_MAX_COMMANDS),
+  _current(),
+  _timeoutTimer([this]() { _commandTimeout(); }),
+  _retries(0),
+  _attempts(0),
+  _stale(0),
   _waitingForReply(false),
+#ifdef ENABLE_RAPI_LATENCY_STATS
+  _latency(),
+  _queueWait(0),
+  _sentAt(0),
+  _frameAt(0),
+#endif
+  _readTimeout(RAPI_READ_TIMEOUT_MS),
+  _bufpos(0),
   _respBuf{},
   _respBufOrig{}
 {
@@ -61,12 +75,16 @@ RapiSender::RapiSender(Stream * stream) :
 
 void RapiSender::_sendNextCmd()
 {
-  CommandItem cmd;
-  if(_commandQueue.pop(cmd))
+  if(_commandQueue.pop(_current))
   {
-    _sendCmd(cmd.command.c_str());
-    _completeHandler = cmd.handler;
-    _timeout = millis() + cmd.timeout;
+#ifdef ENABLE_RAPI_LATENCY_STATS
+    _sentAt = micros();
+    _queueWait = _sentAt - _current.queued;
+#endif
+    _sendCmd(_current.command.c_str());
+    RAPI_TRACE(RAPI_TRACE_CMD_SENT, rapiTraceCode(_current.command.c_str()), 0, _sequenceId, 0, _traceLink);
+    _timers->schedule(_timeoutTimer, _current.timeout);
+    _attempts = 0;
     _waitingForReply = true;
   }
 }
@@ -74,8 +92,8 @@ void RapiSender::_sendNextCmd()
 // return = 0 = OK
 //        = 1 = command will cause buffer overflow
 void
-RapiSender::_sendCmd(const char *cmdstr) {
-  _stream->print(cmdstr);
+RapiSender::_sendCmd(const char *cmdstr, bool resend) {
+  _stats.bytes_out += _stream->print(cmdstr);
   dbgprint(cmdstr);
 
   const char *s = cmdstr;
@@ -84,30 +102,33 @@ RapiSender::_sendCmd(const char *cmdstr) {
     chk ^= *(s++);
   }
 
-  _sendTail(chk);
+  _sendTail(chk, resend);
 
-  _sent++;
+  _stats.sent++;
 }
 
-void RapiSender::_sendTail(uint8_t chk) {
+void RapiSender::_sendTail(uint8_t chk, bool resend) {
+  // Not _respBuf, that may hold a partially received frame
+  char tail[8];
+
   if (_sequenceIdEnabled()) {
-    if (++_sequenceId == RAPI_INVALID_SEQUENCE_ID)
+    // A retry keeps the sequence ID, so a late reply to the first attempt
+    // still matches
+    if (!resend && ++_sequenceId == RAPI_INVALID_SEQUENCE_ID)
       ++_sequenceId;
-    sprintf(_respBuf, " %c%02X", ESRAPI_SOS, (unsigned) _sequenceId);
-    const char *s = _respBuf;
+    sprintf(tail, " %c%02X", ESRAPI_SOS, (unsigned) _sequenceId);
+    const char *s = tail;
     while (*s) {
       chk ^= *(s++);
     }
-    _stream->print(_respBuf);
-    dbgprint(_respBuf);
+    _stats.bytes_out += _stream->print(tail);
+    dbgprint(tail);
   }
 
-  sprintf(_respBuf, "^%02X%c", (unsigned) chk, ESRAPI_EOC);
-  _stream->print(_respBuf);
-  dbgprintln(_respBuf);
+  sprintf(tail, "^%02X%c", (unsigned) chk, ESRAPI_EOC);
+  _stats.bytes_out += _stream->print(tail);
+  dbgprintln(tail);
   _stream->flush();
-
-  *_respBuf = 0;
 }
 
 // return = 0 = OK
@@ -127,10 +148,7 @@ RapiSender::_tokenize() {
     uint8_t rchk = htou8(s + 1);
     if (rchk != chk) {
       _tokenCnt = 0;
-#ifdef DBG
-      sprintf(_respBuf, "bad chk %x %x %s", rchk, chk, s);
-      dbgprintln(_respBuf);
-#endif
+      RAPI_TRACE(RAPI_TRACE_BAD_CHECKSUM, rapiTraceCode(_respBuf), RAPI_RESPONSE_BAD_CHECKSUM, _sequenceId, (rchk << 8) | chk, _traceLink);
       return RAPI_RESPONSE_BAD_CHECKSUM;
     }
     *s = '\0';
@@ -152,10 +170,7 @@ RapiSender::_tokenize() {
       *(s++) = '\0';
       uint8_t seqid = htou8(s + 1);
       if (seqid != _sequenceId) {
-#ifdef DBG
-        sprintf(_respBuf, "bad seqid %x %x %s", seqid, _sequenceId, s);
-        dbgprintln(_respBuf);
-#endif
+        RAPI_TRACE(RAPI_TRACE_BAD_SEQUENCE_ID, rapiTraceCode(_respBuf), RAPI_RESPONSE_BAD_SEQUENCE_ID, _sequenceId, (seqid << 8) | _sequenceId, _traceLink);
         _tokenCnt = 0;
         return RAPI_RESPONSE_BAD_SEQUENCE_ID;
       }
@@ -168,15 +183,62 @@ RapiSender::_tokenize() {
 
 void RapiSender::_commandComplete(int result)
 {
+  _timeoutTimer.cancel();
   if(_waitingForReply) {
-    if(nullptr != _completeHandler) {
-      _completeHandler(result);
+    RAPI_TRACE(RAPI_TRACE_CMD_COMPLETE, rapiTraceCode(_current.command.c_str()), result, _sequenceId, 0, _traceLink);
+    if(nullptr != _current.handler) {
+      _current.handler(result);
     }
+#ifdef ENABLE_RAPI_LATENCY_STATS
+    // Completed once the handler is done with the response
+    uint32_t completedAt = micros();
+    bool responded = RAPI_RESPONSE_TIMEOUT != result && (int32_t)(_frameAt - _sentAt) >= 0;
+    _latency.record(_current.command.c_str(), _queueWait, responded, _frameAt - _sentAt, completedAt - _frameAt);
+#endif
     _waitingForReply = false;
+
+    // The other attempts may still be answered, hold the next command back
+    // until they are or the timeout passes so they can not be taken as its
+    // reply
+    if(RAPI_RESPONSE_TIMEOUT != result && _attempts > 0) {
+      _stale = _attempts;
+      _timers->schedule(_timeoutTimer, _current.timeout);
+      return;
+    }
   }
   _sendNextCmd();
 }
 
+void RapiSender::_commandTimeout()
+{
+  if(!_waitingForReply)
+  {
+    // Gave up on the replies to earlier attempts
+    if(_stale > 0) {
+      _stale = 0;
+      _sendNextCmd();
+    }
+    return;
+  }
+
+  _stats.timeouts++;
+  RAPI_TRACE(RAPI_TRACE_CMD_TIMEOUT, rapiTraceCode(_current.command.c_str()), RAPI_RESPONSE_TIMEOUT, _sequenceId, _attempts, _traceLink);
+  if(_attempts < _retries)
+  {
+    _attempts++;
+    _stats.retries++;
+    RAPI_TRACE(RAPI_TRACE_CMD_RETRY, rapiTraceCode(_current.command.c_str()), 0, _sequenceId, _attempts, _traceLink);
+#ifdef ENABLE_RAPI_LATENCY_STATS
+    _sentAt = micros();
+#endif
+    _sendCmd(_current.command.c_str(), true);
+    _timers->schedule(_timeoutTimer, _current.timeout);
+    return;
+  }
+
+  _commandComplete(RAPI_RESPONSE_TIMEOUT);
+}
+
 void
 RapiSender::sendCmd(const char *cmdstr, RapiCommandCompleteHandler callback, unsigned long timeout) {
   String cmd = cmdstr;
@@ -188,14 +250,26 @@ RapiSender::sendCmd(String &cmdstr, RapiCommandCompleteHandler callback, unsigne
   CommandItem cmd = {
     cmdstr,
     callback,
-    timeout
+    (unsigned int)timeout
   };
+#ifdef ENABLE_RAPI_LATENCY_STATS
+  cmd.queued = micros();
+#endif
   if(_commandQueue.push(cmd)) {
-    if(!_waitingForReply) {
+    uint32_t used = _commandQueue.used();
+    if(used > _stats.queue_high_water) {
+      _stats.queue_high_water = used;
+    }
+    RAPI_TRACE(RAPI_TRACE_CMD_QUEUED, rapiTraceCode(cmdstr.c_str()), 0, _sequenceId, used, _traceLink);
+    if(!_waitingForReply && 0 == _stale) {
       _sendNextCmd();
     }
-  } else if(nullptr != callback) {
-    callback(RAPI_RESPONSE_QUEUE_FULL);
+  } else {
+    _stats.queue_full++;
+    RAPI_TRACE(RAPI_TRACE_CMD_QUEUE_FULL, rapiTraceCode(cmdstr.c_str()), RAPI_RESPONSE_QUEUE_FULL, _sequenceId, 0, _traceLink);
+    if(nullptr != callback) {
+      callback(RAPI_RESPONSE_QUEUE_FULL);
+    }
   }
 }
 
@@ -254,18 +328,22 @@ RapiSender::_waitForResult(unsigned long timeout) {
   unsigned long mss = millis();
 
   _tokenCnt = 0;
-  *_respBuf = 0;
-  int bufpos = 0;
   do {
     int bytesavail = _stream->available();
     if (bytesavail) {
       for (int i = 0; i < bytesavail; i++) {
         char c = _stream->read();
-        if (!bufpos && (c != ESRAPI_SOC)) {
+        _stats.bytes_in++;
+        if (c == ESRAPI_SOC) {
+          // start of a new frame, drop any partial frame
+          _bufpos = 0;
+        }
+        if (!_bufpos && (c != ESRAPI_SOC)) {
           // wait for start character
           continue;
-        } else if (bufpos && (c == ESRAPI_EOC)) {
-          _respBuf[bufpos] = '\0';
+        } else if (_bufpos && (c == ESRAPI_EOC)) {
+          _respBuf[_bufpos] = '\0';
+          _bufpos = 0;
           // Save the original response
           strncpy(_respBufOrig, _respBuf, RAPI_BUFLEN);
           int ret = _tokenize();
@@ -274,14 +352,30 @@ RapiSender::_waitForResult(unsigned long timeout) {
 
           return ret;
         } else {
-          _respBuf[bufpos++] = c;
-          if (bufpos >= (RAPI_BUFLEN - 1))
+#ifdef ENABLE_RAPI_LATENCY_STATS
+          if (!_bufpos) {
+            _frameAt = micros();
+          }
+#endif
+          _respBuf[_bufpos++] = c;
+          if (_bufpos >= (RAPI_BUFLEN - 1)) {
+            RAPI_TRACE(RAPI_TRACE_BUFFER_OVERFLOW, rapiTraceCode(_respBuf), RAPI_RESPONSE_BUFFER_OVERFLOW, _sequenceId, _bufpos, _traceLink);
+            _bufpos = 0;
             return RAPI_RESPONSE_BUFFER_OVERFLOW;
+          }
         }
       }
     }
   } while (!_tokenCnt && ((millis() - mss) < timeout));
 
+  if (!_tokenCnt) {
+    if (0 == timeout) {
+      // non-blocking, carry on with the frame when more data arrives
+      return RAPI_RESPONSE_INCOMPLETE;
+    }
+    _bufpos = 0;
+  }
+
 #ifdef DBG
   dbgprint("TOKENCNT: ");
   dbgprintln(_tokenCnt);
@@ -293,7 +387,7 @@ RapiSender::_waitForResult(unsigned long timeout) {
 
   if (_tokenCnt > 0) {
     if (!strcmp(_tokens[0], "$OK")) {
-      _success++;
+      _stats.success++;
       _connected = true;
       return RAPI_RESPONSE_OK;
     } else if (!strcmp(_tokens[0], "$NK")) {
@@ -312,6 +406,54 @@ RapiSender::_waitForResult(unsigned long timeout) {
   }
 }
 
+void RapiSender::_countResult(int result)
+{
+  switch(result)
+  {
+    case RAPI_RESPONSE_TIMEOUT:
+      _stats.timeouts++;
+      break;
+    case RAPI_RESPONSE_NK:
+      _stats.nk++;
+      break;
+    case RAPI_RESPONSE_INVALID_RESPONSE:
+      _stats.invalid++;
+      break;
+    case RAPI_RESPONSE_BAD_CHECKSUM:
+      _stats.bad_checksum++;
+      break;
+    case RAPI_RESPONSE_BAD_SEQUENCE_ID:
+      _stats.bad_sequence_id++;
+      break;
+    case RAPI_RESPONSE_BUFFER_OVERFLOW:
+      _stats.buffer_overflow++;
+      break;
+    case RAPI_RESPONSE_ASYNC_EVENT:
+    {
+      const char *event = _tokens[0];
+      int type = RAPI_ASYNC_EVENT_OTHER;
+      if(!strcmp(event, "$ST")) {
+        type = RAPI_ASYNC_EVENT_ST;
+      } else if(!strcmp(event, "$AT")) {
+        type = RAPI_ASYNC_EVENT_AT;
+      } else if(!strcmp(event, "$AB")) {
+        type = RAPI_ASYNC_EVENT_AB;
+      } else if(!strcmp(event, "$AN")) {
+        type = RAPI_ASYNC_EVENT_AN;
+      } else if(!strcmp(event, "$WF")) {
+        type = RAPI_ASYNC_EVENT_WF;
+      }
+      _stats.async_events[type]++;
+      break;
+    }
+  }
+}
+
+void RapiSender::resetStats()
+{
+  _stats = RapiLinkStats();
+}
+
 void
 RapiSender::enableSequenceId(uint8_t tf) {
   if (tf) {
@@ -328,26 +470,39 @@ RapiSender::loop()
 {
   if(_stream->available())
   {
-    int ret = _waitForResult(RAPI_READ_TIMEOUT_MS);
+    int ret = _waitForResult(_readTimeout);
+    if(RAPI_RESPONSE_INCOMPLETE == ret) {
+      _timers->loop();
+      return;
+    }
+    _countResult(ret);
     if(RAPI_RESPONSE_ASYNC_EVENT == ret) {
+      RAPI_TRACE(RAPI_TRACE_ASYNC_EVENT, rapiTraceCode(_tokens[0]), ret, _sequenceId, 0, _traceLink);
       // async EVSE state transition or WiFi event
       if(nullptr != _onRapiEvent) {
         _onRapiEvent();
       }
+    } else if(!_waitingForReply && _stale > 0) {
+      // A late reply to an earlier attempt of a command already completed
+      RAPI_TRACE(RAPI_TRACE_RESPONSE, _tokenCnt > 0 ? rapiTraceCode(_tokens[0]) : 0, ret, _sequenceId, _tokenCnt, _traceLink);
+      _stats.stale++;
+      if(0 == --_stale) {
+        _timeoutTimer.cancel();
+        _sendNextCmd();
+      }
     } else {
+      RAPI_TRACE(RAPI_TRACE_RESPONSE, _tokenCnt > 0 ? rapiTraceCode(_tokens[0]) : 0, ret, _sequenceId, _tokenCnt, _traceLink);
       _commandComplete(ret);
     }
   }
-  else if (_waitingForReply && millis() >= _timeout)
-  {
-    _commandComplete(RAPI_RESPONSE_TIMEOUT);
-  }
+
+  _timers->loop();
 }
 
 void RapiSender::flush()
 {
   DBUGLN("RapiSender::flush()");
-  while(hasPendingCommands() || _waitingForReply)
+  while(hasPendingCommands() || _waitingForReply || _stale > 0)
   {
     DBUGVAR(hasPendingCommands());
     DBUGVAR(_waitingForReply);
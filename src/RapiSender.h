@@ -3,6 +3,10 @@
 #include <functional>
 
 #include "queue.h"
+#include "RapiTimer.h"
+#ifdef ENABLE_RAPI_LATENCY_STATS
+#include "RapiLatency.h"
+#endif
 
 // only enable if RAPI ver
 #define RAPI_SEQUENCE_ID
@@ -22,6 +26,7 @@
 #define RAPI_MAX_COMMANDS 10
 #endif
 
+#define RAPI_RESPONSE_INCOMPLETE             -4 // internal, frame not yet complete
 #define RAPI_RESPONSE_QUEUE_FULL             -3
 #define RAPI_RESPONSE_BUFFER_OVERFLOW        -2
 #define RAPI_RESPONSE_TIMEOUT                -1
@@ -37,6 +42,15 @@
 // _flags
 #define RSF_SEQUENCE_ID_ENABLED   0x01
 
+// Async event types, index into RapiLinkStats::async_events
+#define RAPI_ASYNC_EVENT_ST       0 // $ST state transition
+#define RAPI_ASYNC_EVENT_AT       1 // $AT state transition (protocol 5.0.0+)
+#define RAPI_ASYNC_EVENT_AB       2 // $AB boot notification
+#define RAPI_ASYNC_EVENT_AN       3 // $AN button press
+#define RAPI_ASYNC_EVENT_WF       4 // $WF WiFi mode request
+#define RAPI_ASYNC_EVENT_OTHER    5
+#define RAPI_ASYNC_EVENT_TYPES    6
+
 typedef std::function<void()> RapiEventHandler;
 
 /*
@@ -45,45 +59,103 @@ typedef std::function<void()> RapiEventHandler;
 */
 typedef std::function<void(int result)> RapiCommandCompleteHandler;
 
+// Link health counters, all counts are since construction or resetStats()
+struct RapiLinkStats {
+  uint32_t sent;              // commands written, including retries
+  uint32_t success;           // $OK responses
+  uint32_t timeouts;
+  uint32_t retries;
+  uint32_t stale;             // late replies to an earlier attempt, dropped
+  uint32_t nk;                // $NK responses
+  uint32_t invalid;           // responses other than $OK/$NK/async
+  uint32_t bad_checksum;
+  uint32_t bad_sequence_id;
+  uint32_t buffer_overflow;
+  uint32_t queue_full;        // commands rejected with RAPI_RESPONSE_QUEUE_FULL
+  uint32_t queue_high_water;  // most commands waiting in the queue at once
+  uint32_t bytes_out;
+  uint32_t bytes_in;
+  uint32_t async_events[RAPI_ASYNC_EVENT_TYPES];
+};
+
 struct CommandItem {
   String command;
   RapiCommandCompleteHandler handler;
   unsigned int timeout;
+#ifdef ENABLE_RAPI_LATENCY_STATS
+  uint32_t queued;
+#endif
 };
 
 class RapiSender {
 private:
   Stream *_stream;
-  uint32_t _sent;
-  uint32_t _success;
+  RapiTimerWheel _ownTimers;
+  RapiTimerWheel *_timers;
+  RapiLinkStats _stats;
   bool _connected;
   uint8_t _sequenceId;
   uint8_t _flags;
   int _tokenCnt;
   const char *_tokens[RAPI_MAX_TOKENS];
   RapiEventHandler _onRapiEvent;
+  uint8_t _traceLink;
 
+  CommandItem _commandQueueItems[RAPI_MAX_COMMANDS];
   Queue<CommandItem> _commandQueue;
-  RapiCommandCompleteHandler _completeHandler;
-  uint32_t _timeout;
+  CommandItem _current;
+  RapiTimer _timeoutTimer;
+  uint8_t _retries;
+  uint8_t _attempts;
+  uint8_t _stale;             // replies still due to earlier attempts of the last command
   bool _waitingForReply;
 
+#ifdef ENABLE_RAPI_LATENCY_STATS
+  RapiLatencyStats _latency;
+  uint32_t _queueWait;
+  uint32_t _sentAt;
+  uint32_t _frameAt;
+#endif
+
+  unsigned long _readTimeout;
+  int _bufpos;
   char _respBuf[RAPI_BUFLEN];
   char _respBufOrig[RAPI_BUFLEN];
 
   int _tokenize();
   void _sendNextCmd();
-  void _sendCmd(const char *cmdstr);
-  void _sendTail(uint8_t chk);
+  void _sendCmd(const char *cmdstr, bool resend = false);
+  void _sendTail(uint8_t chk, bool resend);
   int _waitForResult(unsigned long timeout);
   void _commandComplete(int result);
+  void _commandTimeout();
+  void _countResult(int result);
   uint8_t _sequenceIdEnabled() {
     return (_flags & RSF_SEQUENCE_ID_ENABLED) ? 1 : 0;
   }
 public:
 
-  RapiSender(Stream *stream);
+  RapiSender(Stream *stream, RapiTimerWheel *timers = nullptr);
   void setStream(Stream *stream) { _stream = stream; }
+
+  // Timers for command deadlines, by default the sender has its own wheel.
+  // Sharing one is opt-in, whoever runs it runs every link's timers, so
+  // keep those senders on one thread. nullptr goes back to the sender's
+  // own. Only change while no command is outstanding.
+  void setTimerWheel(RapiTimerWheel *timers) { _timers = timers ? timers : &_ownTimers; }
+  RapiTimerWheel *getTimerWheel() { return _timers; }
+
+  // How long loop() waits for the rest of a partially received frame. With
+  // 0 loop() never blocks, partial frames are completed on later calls,
+  // for use with an event loop that calls loop() when data arrives.
+  void setReadTimeout(unsigned long timeout) { _readTimeout = timeout; }
+
+  // Number of times a command is re-sent after a timeout before the
+  // handler is called with RAPI_RESPONSE_TIMEOUT. A retry keeps the
+  // sequence ID. Once a retried command is answered the next one waits
+  // until the other attempts are answered too, or a timeout passes, and
+  // those late replies are dropped.
+  void setRetries(uint8_t retries) { _retries = retries; }
   //  void sendString(const char *str) { dbgprint(str); }
 
   void sendCmd(const char *cmdstr, RapiCommandCompleteHandler callback=nullptr, unsigned long timeout=RAPI_TIMEOUT_MS);
@@ -95,6 +167,10 @@ public:
   int sendCmdSync(const __FlashStringHelper *cmdstr, unsigned long timeout=RAPI_TIMEOUT_MS);
 
   void enableSequenceId(uint8_t tf);
+  bool isSequenceIdEnabled() { return 0 != _sequenceIdEnabled(); }
+  uint8_t getSequenceId() { return _sequenceId; }
+  // Continue from a saved sequence ID, e.g. after a deep sleep
+  void setSequenceId(uint8_t id) { _sequenceId = id; }
   int8_t getTokenCnt() { return _tokenCnt; }
   const char *getResponse() { return _respBufOrig; }
   const char *getToken(int i) {
@@ -106,11 +182,27 @@ public:
   }
 
   uint32_t getSent() {
-    return _sent;
+    return _stats.sent;
   }
   uint32_t getSuccess() {
-    return _success;
+    return _stats.success;
+  }
+  const RapiLinkStats &getStats() {
+    return _stats;
+  }
+  void resetStats();
+
+  // Link number recorded in RapiTraceRecord::link, see RapiTrace.h
+  void setTraceLink(uint8_t link) { _traceLink = link; }
+  uint8_t getTraceLink() { return _traceLink; }
+
+#ifdef ENABLE_RAPI_LATENCY_STATS
+  // Histograms per command of the queue wait, the wire round trip to the
+  // first byte of the response, and from there until the handler returned
+  const RapiLatencyStats &getLatency() {
+    return _latency;
   }
+#endif
   bool isConnected() {
     return _connected;
   }
@@ -0,0 +1,275 @@
+#include <Arduino.h>
+#include "RapiTimer.h"
+
+#define RAPI_TIMER_SLOT_EXPIRED 0xFFFF
+
+#define RAPI_TIMER_SLOT_BITS_MASK \
+  ((RAPI_TIMER_WHEEL_SLOTS < 64) ? ((1ULL << RAPI_TIMER_WHEEL_SLOTS) - 1) : ~0ULL)
+
+// Longest delay representable without parking in the top level
+#define RAPI_TIMER_WHEEL_RANGE \
+  ((1UL << (RAPI_TIMER_WHEEL_BITS * RAPI_TIMER_WHEEL_LEVELS)) - 1)
+
+RapiTimer::RapiTimer(RapiTimerHandler handler) :
+  _next(nullptr),
+  _pprev(nullptr),
+  _wheel(nullptr),
+  _expires(0),
+  _period(0),
+  _slot(RAPI_TIMER_SLOT_EXPIRED),
+  _handler(handler)
+{
+}
+
+RapiTimer::~RapiTimer()
+{
+  cancel();
+}
+
+void RapiTimer::cancel()
+{
+  if(_wheel && isActive()) {
+    _wheel->cancel(*this);
+  }
+}
+
+RapiTimerWheel::RapiTimerWheel() :
+  _slots{},
+  _occupied{},
+  _expired(nullptr),
+  _next(0),
+  _count(0)
+{
+}
+
+RapiTimerWheel &RapiTimerWheel::shared()
+{
+  static RapiTimerWheel wheel;
+  return wheel;
+}
+
+void RapiTimerWheel::_insert(RapiTimer &timer)
+{
+  uint32_t expires = timer._expires;
+  int32_t idx = (int32_t)(expires - _next);
+  int level = 0;
+  int slot;
+
+  if(idx < 0) {
+    // Already due, fire on the next tick
+    slot = _next & RAPI_TIMER_WHEEL_MASK;
+  } else {
+    while(level < RAPI_TIMER_WHEEL_LEVELS - 1 &&
+          (uint32_t)idx >= (1UL << (RAPI_TIMER_WHEEL_BITS * (level + 1))))
+    {
+      level++;
+    }
+    if((uint32_t)idx > RAPI_TIMER_WHEEL_RANGE) {
+      // Park at the edge of the wheel, re-inserted when cascaded
+      expires = _next + RAPI_TIMER_WHEEL_RANGE;
+    }
+    slot = (expires >> (RAPI_TIMER_WHEEL_BITS * level)) & RAPI_TIMER_WHEEL_MASK;
+  }
+
+  RapiTimer **head = &_slots[level][slot];
+  timer._next = *head;
+  if(timer._next) {
+    timer._next->_pprev = &timer._next;
+  }
+  timer._pprev = head;
+  timer._slot = (level << RAPI_TIMER_WHEEL_BITS) | slot;
+  *head = &timer;
+  _occupied[level] |= 1ULL << slot;
+}
+
+void RapiTimerWheel::_unlink(RapiTimer &timer)
+{
+  *timer._pprev = timer._next;
+  if(timer._next) {
+    timer._next->_pprev = timer._pprev;
+  }
+
+  if(RAPI_TIMER_SLOT_EXPIRED != timer._slot)
+  {
+    int level = timer._slot >> RAPI_TIMER_WHEEL_BITS;
+    int slot = timer._slot & RAPI_TIMER_WHEEL_MASK;
+    if(nullptr == _slots[level][slot]) {
+      _occupied[level] &= ~(1ULL << slot);
+    }
+  }
+
+  timer._next = nullptr;
+  timer._pprev = nullptr;
+  timer._slot = RAPI_TIMER_SLOT_EXPIRED;
+}
+
+// Move the current slot of level down the wheel, returns true if the
+// level has not wrapped so higher levels do not need cascading.
+bool RapiTimerWheel::_cascade(int level)
+{
+  int slot = (_next >> (RAPI_TIMER_WHEEL_BITS * level)) & RAPI_TIMER_WHEEL_MASK;
+
+  RapiTimer *timer = _slots[level][slot];
+  _slots[level][slot] = nullptr;
+  _occupied[level] &= ~(1ULL << slot);
+
+  while(timer)
+  {
+    RapiTimer *next = timer->_next;
+    _insert(*timer);
+    timer = next;
+  }
+
+  return 0 != slot;
+}
+
+void RapiTimerWheel::_runExpired()
+{
+  while(_expired)
+  {
+    RapiTimer *timer = _expired;
+    _unlink(*timer);
+
+    if(timer->_period)
+    {
+      // Re-arm before calling the handler so it is free to cancel
+      uint32_t tick = _next - 1;
+      timer->_expires += timer->_period;
+      if((int32_t)(timer->_expires - tick) <= 0) {
+        timer->_expires = tick + timer->_period;
+      }
+      _insert(*timer);
+    } else {
+      _count--;
+    }
+
+    if(timer->_handler) {
+      timer->_handler();
+    }
+  }
+}
+
+void RapiTimerWheel::schedule(RapiTimer &timer, uint32_t delay, uint32_t period)
+{
+  if(timer.isActive()) {
+    timer.cancel();
+  }
+
+  uint32_t now = millis();
+  if(0 == _count) {
+    _next = now;
+  }
+
+  timer._wheel = this;
+  timer._expires = now + delay;
+  timer._period = period;
+  _insert(timer);
+  _count++;
+}
+
+void RapiTimerWheel::cancel(RapiTimer &timer)
+{
+  if(timer.isActive() && this == timer._wheel)
+  {
+    _unlink(timer);
+    _count--;
+  }
+}
+
+void RapiTimerWheel::advance(uint32_t now)
+{
+  while((int32_t)(now - _next) >= 0)
+  {
+    if(0 == _count) {
+      _next = now + 1;
+      break;
+    }
+
+    uint32_t index = _next & RAPI_TIMER_WHEEL_MASK;
+    if(0 == index)
+    {
+      for(int level = 1; level < RAPI_TIMER_WHEEL_LEVELS; level++) {
+        if(_cascade(level)) {
+          break;
+        }
+      }
+    }
+    else if(0 == _occupied[0])
+    {
+      // Nothing due before the next cascade, skip ahead
+      uint32_t boundary = (_next | RAPI_TIMER_WHEEL_MASK) + 1;
+      _next = ((int32_t)(now - boundary) >= 0) ? boundary : now + 1;
+      continue;
+    }
+
+    _expired = _slots[0][index];
+    _slots[0][index] = nullptr;
+    _occupied[0] &= ~(1ULL << index);
+    if(_expired) {
+      _expired->_pprev = &_expired;
+      for(RapiTimer *timer = _expired; timer; timer = timer->_next) {
+        timer->_slot = RAPI_TIMER_SLOT_EXPIRED;
+      }
+    }
+
+    _next++;
+    _runExpired();
+  }
+}
+
+void RapiTimerWheel::loop()
+{
+  advance(millis());
+}
+
+bool RapiTimerWheel::nextExpiry(uint32_t &when)
+{
+  if(0 == _count) {
+    return false;
+  }
+
+  uint32_t best = UINT32_MAX;
+  for(int level = 0; level < RAPI_TIMER_WHEEL_LEVELS; level++)
+  {
+    uint64_t occupied = _occupied[level];
+    if(0 == occupied) {
+      continue;
+    }
+
+    int shift = RAPI_TIMER_WHEEL_BITS * level;
+    int current = (_next >> shift) & RAPI_TIMER_WHEEL_MASK;
+    uint64_t rotated = current ?
+      ((occupied >> current) | (occupied << (RAPI_TIMER_WHEEL_SLOTS - current))) & RAPI_TIMER_SLOT_BITS_MASK :
+      occupied;
+
+    uint32_t delta;
+    if(0 == level) {
+      delta = __builtin_ctzll(rotated);
+    }
+    else
+    {
+      // Slots are moved down the wheel on the tick their index comes round
+      uint32_t base = (_next >> shift) << shift;
+      bool passed = base != _next;
+      if(passed && (rotated & 1)) {
+        rotated &= ~1ULL;
+        delta = (RAPI_TIMER_WHEEL_SLOTS << shift) - (_next - base);
+        if(rotated) {
+          uint32_t d = (__builtin_ctzll(rotated) << shift) - (_next - base);
+          if(d < delta) {
+            delta = d;
+          }
+        }
+      } else {
+        delta = (__builtin_ctzll(rotated) << shift) - (_next - base);
+      }
+    }
+
+    if(delta < best) {
+      best = delta;
+    }
+  }
+
+  when = _next + best;
+  return true;
+}
@@ -0,0 +1,106 @@
+#ifndef __RAPI_TIMER_H
+#define __RAPI_TIMER_H
+
+#include <stdint.h>
+#include <functional>
+
+// Hierarchical timing wheel, see "Hashed and Hierarchical Timing Wheels"
+// (Varghese & Lauck). Each level has RAPI_TIMER_WHEEL_SLOTS slots, level 0
+// has a resolution of 1ms and each further level is RAPI_TIMER_WHEEL_SLOTS
+// times coarser. Insert and cancel are O(1), timers further out than the
+// wheel can represent are parked in the top level and re-cascaded.
+//
+// 5 bits x 4 levels covers ~17 minutes, 6 bits x 4 levels ~4.6 hours.
+
+#ifndef RAPI_TIMER_WHEEL_BITS
+#define RAPI_TIMER_WHEEL_BITS 5
+#endif
+
+#define RAPI_TIMER_WHEEL_LEVELS 4
+#define RAPI_TIMER_WHEEL_SLOTS  (1 << RAPI_TIMER_WHEEL_BITS)
+#define RAPI_TIMER_WHEEL_MASK   (RAPI_TIMER_WHEEL_SLOTS - 1)
+
+#if RAPI_TIMER_WHEEL_BITS > 6
+#error "RAPI_TIMER_WHEEL_BITS must be 6 or less"
+#endif
+
+typedef std::function<void()> RapiTimerHandler;
+
+class RapiTimerWheel;
+
+class RapiTimer
+{
+  friend class RapiTimerWheel;
+
+  private:
+    RapiTimer *_next;
+    RapiTimer **_pprev;
+    RapiTimerWheel *_wheel;
+    uint32_t _expires;
+    uint32_t _period;
+    uint16_t _slot;
+    RapiTimerHandler _handler;
+
+  public:
+    RapiTimer(RapiTimerHandler handler = nullptr);
+    ~RapiTimer();
+
+    RapiTimer(const RapiTimer &) = delete;
+    RapiTimer &operator=(const RapiTimer &) = delete;
+
+    void setHandler(RapiTimerHandler handler) {
+      _handler = handler;
+    }
+
+    bool isActive() {
+      return nullptr != _pprev;
+    }
+
+    // Absolute expiry time in ms (millis() time base), valid while active
+    uint32_t getExpires() {
+      return _expires;
+    }
+
+    void cancel();
+};
+
+class RapiTimerWheel
+{
+  private:
+    RapiTimer *_slots[RAPI_TIMER_WHEEL_LEVELS][RAPI_TIMER_WHEEL_SLOTS];
+    uint64_t _occupied[RAPI_TIMER_WHEEL_LEVELS];
+    RapiTimer *_expired;
+    uint32_t _next;
+    uint32_t _count;
+
+    void _insert(RapiTimer &timer);
+    void _unlink(RapiTimer &timer);
+    bool _cascade(int level);
+    void _runExpired();
+
+  public:
+    RapiTimerWheel();
+
+    // Start (or restart) a timer to fire in delay ms. If period is non-zero
+    // the timer is re-armed every period ms until cancelled.
+    void schedule(RapiTimer &timer, uint32_t delay, uint32_t period = 0);
+    void cancel(RapiTimer &timer);
+
+    // Fire all the timers due at or before now
+    void advance(uint32_t now);
+    void loop();
+
+    // Earliest time any timer could fire, a lower bound suitable for
+    // sizing a poll()/epoll_wait() timeout. Returns false if idle.
+    bool nextExpiry(uint32_t &when);
+
+    uint32_t active() {
+      return _count;
+    }
+
+    // One wheel for a whole single threaded program, for senders that
+    // should share their timers. Not used unless passed to them.
+    static RapiTimerWheel &shared();
+};
+
+#endif // __RAPI_TIMER_H
@@ -0,0 +1,102 @@
+#include <Arduino.h>
+#include <stdio.h>
+
+#include "RapiTrace.h"
+
+static const char *rapiTraceEventNames[] = {
+  "none",
+  "queued",
+  "queue_full",
+  "sent",
+  "retry",
+  "timeout",
+  "complete",
+  "response",
+  "bad_checksum",
+  "bad_seq_id",
+  "overflow",
+  "async",
+  "evse_state",
+  "evse_boot"
+};
+
+const char *rapiTraceEventName(uint8_t event)
+{
+  if(event < sizeof(rapiTraceEventNames) / sizeof(rapiTraceEventNames[0])) {
+    return rapiTraceEventNames[event];
+  }
+  return "unknown";
+}
+
+int rapiTraceFormat(const RapiTraceRecord &record, char *buffer, size_t size)
+{
+  char command[3] = {
+    record.command ? (char)(record.command >> 8) : '-',
+    record.command ? (char)(record.command & 0xff) : '-',
+    '\0'
+  };
+
+  return snprintf(buffer, size, "%10u %3u %-12s %s %3d %02X %04X",
+    (unsigned)record.time, (unsigned)record.link, rapiTraceEventName(record.event),
+    command, (int)record.result, (unsigned)record.seq, (unsigned)record.value);
+}
+
+#ifdef ENABLE_RAPI_TRACE
+
+RapiTraceRecord rapiTraceBuffer[RAPI_TRACE_RECORDS];
+uint32_t rapiTraceHead = 0;
+
+size_t rapiTraceSnapshot(RapiTraceRecord *records, size_t max)
+{
+  uint32_t head = rapiTraceHead;
+  uint32_t count = head < RAPI_TRACE_RECORDS ? head : RAPI_TRACE_RECORDS;
+  if(count > max) {
+    count = max;
+  }
+
+  for(uint32_t i = 0; i < count; i++) {
+    records[i] = rapiTraceBuffer[(head - count + i) & (RAPI_TRACE_RECORDS - 1)];
+  }
+
+  return count;
+}
+
+void rapiTraceClear()
+{
+  rapiTraceHead = 0;
+}
+
+void rapiTraceDump(Print &out)
+{
+  uint32_t head = rapiTraceHead;
+  uint32_t count = head < RAPI_TRACE_RECORDS ? head : RAPI_TRACE_RECORDS;
+
+  char line[64];
+  for(uint32_t i = 0; i < count; i++)
+  {
+    RapiTraceRecord record = rapiTraceBuffer[(head - count + i) & (RAPI_TRACE_RECORDS - 1)];
+    rapiTraceFormat(record, line, sizeof(line));
+    out.println(line);
+  }
+}
+
+void rapiTraceWrite(Print &out)
+{
+  uint32_t head = rapiTraceHead;
+  uint32_t count = head < RAPI_TRACE_RECORDS ? head : RAPI_TRACE_RECORDS;
+
+  RapiTraceHeader header = {
+    RAPI_TRACE_MAGIC,
+    RAPI_TRACE_VERSION,
+    sizeof(RapiTraceRecord),
+    count,
+    head - count
+  };
+  out.write((const uint8_t *)&header, sizeof(header));
+
+  for(uint32_t i = 0; i < count; i++) {
+    out.write((const uint8_t *)&rapiTraceBuffer[(head - count + i) & (RAPI_TRACE_RECORDS - 1)], sizeof(RapiTraceRecord));
+  }
+}
+
+#endif // ENABLE_RAPI_TRACE
@@ -0,0 +1,109 @@
+#ifndef __RAPI_TRACE_H
+#define __RAPI_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary trace of the RAPI link. Unlike ENABLE_DEBUG_RAPI nothing is
+// formatted or written to a serial port on the hot path, each trace point
+// is a handful of stores in to a RAM ring buffer so it can be left enabled
+// in production. Enable with ENABLE_RAPI_TRACE, the ring is decoded later
+// with rapiTraceDump() or offline from the rapiTraceWrite() output.
+
+#ifndef RAPI_TRACE_RECORDS
+#define RAPI_TRACE_RECORDS 128 // must be a power of 2
+#endif
+
+#if (RAPI_TRACE_RECORDS & (RAPI_TRACE_RECORDS - 1)) != 0
+#error "RAPI_TRACE_RECORDS must be a power of 2"
+#endif
+
+#define RAPI_TRACE_CMD_QUEUED         1 // value = queue depth
+#define RAPI_TRACE_CMD_QUEUE_FULL     2
+#define RAPI_TRACE_CMD_SENT           3
+#define RAPI_TRACE_CMD_RETRY          4 // value = attempt
+#define RAPI_TRACE_CMD_TIMEOUT        5
+#define RAPI_TRACE_CMD_COMPLETE       6 // result = RAPI_RESPONSE_XXX
+#define RAPI_TRACE_RESPONSE           7 // command = response, e.g. "OK", result = RAPI_RESPONSE_XXX
+#define RAPI_TRACE_BAD_CHECKSUM       8 // value = received << 8 | calculated
+#define RAPI_TRACE_BAD_SEQUENCE_ID    9 // value = received << 8 | expected
+#define RAPI_TRACE_BUFFER_OVERFLOW   10
+#define RAPI_TRACE_ASYNC_EVENT       11 // command = event, e.g. "AT"
+#define RAPI_TRACE_EVSE_STATE        12 // value = evse_state << 8 | pilot_state
+#define RAPI_TRACE_EVSE_BOOT         13 // value = post code
+
+// Binary dump format, little endian as the records are copied verbatim
+#define RAPI_TRACE_MAGIC             0x43525452 // "RTRC"
+#define RAPI_TRACE_VERSION           1
+
+struct RapiTraceRecord {
+  uint32_t time;      // micros()
+  uint16_t command;   // two letter command, first letter in the high byte
+  uint16_t value;     // event specific
+  uint8_t event;      // RAPI_TRACE_XXX
+  int8_t result;
+  uint8_t seq;        // sequence ID, 0 if not enabled
+  uint8_t link;       // set with RapiSender::setTraceLink()
+};
+
+struct RapiTraceHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t records;
+  uint32_t dropped;   // records overwritten before the dump
+};
+
+// Pack a command such as "$GS 1" or "AT" in to RapiTraceRecord::command
+static inline uint16_t rapiTraceCode(const char *command)
+{
+  if('$' == *command) {
+    command++;
+  }
+  if(!command[0]) {
+    return 0;
+  }
+  return ((uint16_t)(uint8_t)command[0] << 8) | (uint8_t)command[1];
+}
+
+class Print;
+
+// Human readable decode of one record, returns the length like snprintf
+int rapiTraceFormat(const RapiTraceRecord &record, char *buffer, size_t size);
+const char *rapiTraceEventName(uint8_t event);
+
+#ifdef ENABLE_RAPI_TRACE
+#include <Arduino.h>
+
+extern RapiTraceRecord rapiTraceBuffer[RAPI_TRACE_RECORDS];
+extern uint32_t rapiTraceHead;
+
+static inline void rapiTrace(uint8_t event, uint16_t command, int result, uint8_t seq, uint16_t value, uint8_t link)
+{
+  RapiTraceRecord &record = rapiTraceBuffer[rapiTraceHead++ & (RAPI_TRACE_RECORDS - 1)];
+  record.time = micros();
+  record.command = command;
+  record.value = value;
+  record.event = event;
+  record.result = (int8_t)result;
+  record.seq = seq;
+  record.link = link;
+}
+
+#define RAPI_TRACE(event, command, result, seq, value, link) \
+  rapiTrace((event), (command), (result), (seq), (value), (link))
+
+// Copy the ring, oldest record first, returns the number copied
+size_t rapiTraceSnapshot(RapiTraceRecord *records, size_t max);
+void rapiTraceClear();
+
+// Decode the ring to text, e.g. over a debug port
+void rapiTraceDump(Print &out);
+// Write a RapiTraceHeader followed by the raw records for offline decoding
+void rapiTraceWrite(Print &out);
+
+#else
+#define RAPI_TRACE(event, command, result, seq, value, link)
+#endif
+
+#endif // __RAPI_TRACE_H
@@ -1,4 +1,4 @@
-#if defined(ENABLE_DEBUG) && !defined(ENABLE_DEBUG_OPENEVSE)
+#if defined(ENABLE_DEBUG) && (!defined(ENABLE_DEBUG_OPENEVSE) || defined(ENABLE_RAPI_TRACE))
 #undef ENABLE_DEBUG
 #endif
 
@@ -6,22 +6,66 @@
 #include <MicroDebug.h>
 
 #include "openevse.h"
+#include "RapiSchema.h"
+#include "RapiTrace.h"
 
 #include <time.h>                       // time() ctime()
 #include <sys/time.h>                   // struct timeval
 
 #include <cstdio>                       // snprintf
+#include <cstddef>                      // offsetof
 
 #define OPENEVSE_LCD_SPACE_MAGIC_CHAR 0xFE
 
+// Clock values before this are assumed to be an unset RTC (2020-01-01)
+#define OPENEVSE_SNAPSHOT_MIN_TIME 1577836800
+
 OpenEVSEClass::OpenEVSEClass() :
   _sender(NULL),
   _connected(false),
   _protocol(OPENEVSE_ENCODE_VERSION(1,0,0)),
-  _boot(NULL),
+  _firmware{},
+  _status{ (uint8_t)OPENEVSE_STATE_INVALID, (uint8_t)OPENEVSE_STATE_INVALID, 0, 0, 0 },
+  _statusValid(false),
+  _vflagsKnown(false),
+  _capacityKnown(false)
+#if OPENEVSE_ENABLE_ASYNC_EVENTS
+  , _boot(NULL),
   _state(NULL),
-  _wifi(NULL)
+  _wifi(NULL),
+  _subscribers{},
+  _dispatch(NULL)
+#endif
+#if OPENEVSE_ENABLE_TELEMETRY
+  , _telemetry{},
+  _telemetryCallback(NULL),
+  _telemetryStart(0),
+  _telemetryPending(0)
+#endif
+#if OPENEVSE_ENABLE_CACHE
+  , _cacheTtl{},
+  _cacheUpdated{},
+  _cacheValid(0),
+  _cacheVersion{},
+  _cacheSerial{},
+  _cacheSettings{},
+  _cacheCurrentCapacity{},
+  _cacheAmmeter{},
+  _cacheTimer{}
+#endif
+{
+}
+
+OpenEVSEClass::~OpenEVSEClass()
 {
+#if OPENEVSE_ENABLE_ASYNC_EVENTS
+  for(uint8_t type = 0; type < OPENEVSE_EVENT_TYPES; type++)
+  {
+    while(_subscribers[type]) {
+      _subscribers[type]->unsubscribe();
+    }
+  }
+#endif
 }
 
 void OpenEVSEClass::begin(RapiSender &sender, std::function<void(bool connected)> callback)
@@ -34,52 +78,232 @@ void OpenEVSEClass::begin(RapiSender &sender, std::function<void(bool connected)
 void OpenEVSEClass::begin(RapiSender &sender, std::function<void(bool connected, const char *firmware, const char *protocol)> callback)
 {
   _connected = false;
-  _sender = &sender;
-
-  _sender->setOnEvent([this]() { onEvent(); });
+  _statusValid = false;
+  _vflagsKnown = false;
+  _capacityKnown = false;
+  cacheInvalidate(OPENEVSE_CACHE_ALL);
+  attach(sender);
   _sender->enableSequenceId(0);
 
   getVersion([this, callback](int ret, const char *firmware, const char *protocol) {
     if (RAPI_RESPONSE_OK == ret) {
-      int major, minor, patch;
-      if(3 == sscanf(protocol, "%d.%d.%d", &major, &minor, &patch))
-      {
-        _protocol = OPENEVSE_ENCODE_VERSION(major, minor, patch);
-        DBUGVAR(_protocol);
-        _connected = true;
-      }
+      connected(firmware, protocol);
     }
 
     callback(_connected, firmware, protocol);
   });
 }
 
+void OpenEVSEClass::connected(const char *firmware, const char *protocol)
+{
+  int major, minor, patch;
+  if(3 == sscanf(protocol, "%d.%d.%d", &major, &minor, &patch))
+  {
+    _protocol = OPENEVSE_ENCODE_VERSION(major, minor, patch);
+    DBUGVAR(_protocol);
+    if(!inProfile(_protocol)) {
+      DBUGF("Protocol %s is not the built profile", protocol);
+      return;
+    }
+    snprintf(_firmware, sizeof(_firmware), "%s", firmware);
+    _connected = true;
+  }
+}
+
+void OpenEVSEClass::attach(RapiSender &sender)
+{
+  _sender = &sender;
+#if OPENEVSE_ENABLE_ASYNC_EVENTS
+  _sender->setOnEvent([this]() { onEvent(); });
+#endif
+}
+
+static uint32_t snapshotChecksum(const OpenEVSESnapshot &snapshot)
+{
+  // FNV-1a
+  const uint8_t *data = (const uint8_t *)&snapshot;
+  uint32_t hash = 2166136261UL;
+  for(size_t i = 0; i < offsetof(OpenEVSESnapshot, checksum); i++) {
+    hash = (hash ^ data[i]) * 16777619UL;
+  }
+  return hash;
+}
+
+size_t OpenEVSEClass::saveSnapshot(void *buffer, size_t size)
+{
+  if(size < sizeof(OpenEVSESnapshot)) {
+    return 0;
+  }
+
+  OpenEVSESnapshot snapshot;
+  memset(&snapshot, 0, sizeof(snapshot));
+
+  time_t now = time(NULL);
+  snapshot.magic = OPENEVSE_SNAPSHOT_MAGIC;
+  snapshot.version = OPENEVSE_SNAPSHOT_VERSION;
+  snapshot.size = sizeof(OpenEVSESnapshot);
+  snapshot.saved = now >= OPENEVSE_SNAPSHOT_MIN_TIME ? (uint32_t)now : 0;
+  snapshot.protocol = _protocol;
+  snapshot.connected = _connected ? 1 : 0;
+  if(_sender) {
+    snapshot.sequence_id = _sender->getSequenceId();
+    snapshot.sequence_id_enabled = _sender->isSequenceIdEnabled() ? 1 : 0;
+  }
+  memcpy(snapshot.firmware, _firmware, sizeof(snapshot.firmware));
+  snapshot.status = _status;
+  snapshot.known = (_vflagsKnown ? OPENEVSE_SNAPSHOT_KNOWN_VFLAGS : 0) |
+                   (_capacityKnown ? OPENEVSE_SNAPSHOT_KNOWN_CAPACITY : 0);
+  snapshot.checksum = snapshotChecksum(snapshot);
+
+  memcpy(buffer, &snapshot, sizeof(snapshot));
+  return sizeof(snapshot);
+}
+
+bool OpenEVSEClass::restoreSnapshot(RapiSender &sender, const void *buffer, size_t size, uint32_t max_age)
+{
+  if(size < sizeof(OpenEVSESnapshot)) {
+    return false;
+  }
+
+  OpenEVSESnapshot snapshot;
+  memcpy(&snapshot, buffer, sizeof(snapshot));
+
+  if(OPENEVSE_SNAPSHOT_MAGIC != snapshot.magic ||
+     OPENEVSE_SNAPSHOT_VERSION != snapshot.version ||
+     sizeof(OpenEVSESnapshot) != snapshot.size ||
+     snapshotChecksum(snapshot) != snapshot.checksum ||
+     !snapshot.connected)
+  {
+    DBUGLN("Snapshot invalid");
+    return false;
+  }
+
+  // e.g. saved by a build for another profile
+  if(!inProfile(snapshot.protocol)) {
+    DBUGLN("Snapshot protocol is not the built profile");
+    return false;
+  }
+
+  if(max_age > 0)
+  {
+    time_t now = time(NULL);
+    if(0 == snapshot.saved || now < OPENEVSE_SNAPSHOT_MIN_TIME ||
+       (uint32_t)now < snapshot.saved || (uint32_t)now - snapshot.saved > max_age)
+    {
+      DBUGLN("Snapshot stale");
+      return false;
+    }
+  }
+
+  attach(sender);
+  _sender->enableSequenceId(snapshot.sequence_id_enabled);
+  _sender->setSequenceId(snapshot.sequence_id);
+
+  _protocol = snapshot.protocol;
+  memcpy(_firmware, snapshot.firmware, sizeof(_firmware));
+  _firmware[sizeof(_firmware) - 1] = '\0';
+  // updated is from before the sleep, the next event or poll refreshes it
+  _status = snapshot.status;
+  _statusValid = false;
+  _vflagsKnown = 0 != (snapshot.known & OPENEVSE_SNAPSHOT_KNOWN_VFLAGS);
+  _capacityKnown = 0 != (snapshot.known & OPENEVSE_SNAPSHOT_KNOWN_CAPACITY);
+  cacheInvalidate(OPENEVSE_CACHE_ALL);
+  _connected = true;
+
+  return true;
+}
+
+#if OPENEVSE_ENABLE_CACHE
+// OPENEVSE_CACHE_* bit to its index
+static uint8_t cacheIndex(uint8_t item)
+{
+  uint8_t index = 0;
+  while(item >>= 1) {
+    index++;
+  }
+  return index;
+}
+
+void OpenEVSEClass::setCacheTtl(uint8_t items, uint32_t ttl)
+{
+  for(uint8_t index = 0; index < OPENEVSE_CACHE_ITEMS; index++)
+  {
+    if(items & (1 << index)) {
+      _cacheTtl[index] = ttl;
+    }
+  }
+  cacheInvalidate(items);
+}
+
+bool OpenEVSEClass::cached(uint8_t item)
+{
+  uint8_t index = cacheIndex(item);
+  return (_cacheValid & item) && millis() - _cacheUpdated[index] < _cacheTtl[index];
+}
+
+void OpenEVSEClass::cacheStore(uint8_t item)
+{
+  uint8_t index = cacheIndex(item);
+  if(_cacheTtl[index] > 0) {
+    _cacheUpdated[index] = millis();
+    _cacheValid |= item;
+  }
+}
+#endif
+
 void OpenEVSEClass::getVersion(std::function<void(int ret, const char *firmware, const char *protocol)> callback)
 {
   if (!_sender) {
     return;
   }
 
+#if OPENEVSE_ENABLE_CACHE
+  if(cached(OPENEVSE_CACHE_VERSION)) {
+    callback(RAPI_RESPONSE_OK, _cacheVersion.firmware, _cacheVersion.protocol);
+    return;
+  }
+#endif
+
   // Check OpenEVSE version is in.
   _sender->sendCmd("$GV", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 3)
-      {
-        const char *firmware = _sender->getToken(1);
-        const char *protocol = _sender->getToken(2);
-
-        callback(RAPI_RESPONSE_OK, firmware, protocol);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, NULL, NULL);
-      }
+    OpenEVSEVersionResult result;
+    parseVersion(ret, result);
+    if(RAPI_RESPONSE_OK == result.ret) {
+#if OPENEVSE_ENABLE_CACHE
+      _cacheVersion = result;
+      cacheStore(OPENEVSE_CACHE_VERSION);
+#endif
+      callback(RAPI_RESPONSE_OK, result.firmware, result.protocol);
     } else {
-      callback(ret, NULL, NULL);
+      callback(result.ret, NULL, NULL);
     }
   });
 }
 
+void OpenEVSEClass::parseConnect(int ret, OpenEVSEVersionResult &result)
+{
+  parseVersion(ret, result);
+  if(RAPI_RESPONSE_OK == result.ret) {
+    connected(result.firmware, result.protocol);
+  }
+  if(!_connected && RAPI_RESPONSE_OK == result.ret) {
+    result.ret = RAPI_RESPONSE_INVALID_RESPONSE;
+  }
+}
+
+// $OK firmware protocol
+static constexpr RapiField versionFields[] = {
+  RAPI_FIELD(OpenEVSEVersionResult, firmware, 1, 10),
+  RAPI_FIELD(OpenEVSEVersionResult, protocol, 2, 10)
+};
+
+void OpenEVSEClass::parseVersion(int ret, OpenEVSEVersionResult &result)
+{
+  result = {};
+  rapiParse(*_sender, ret, protocol(), versionFields, result);
+}
+
 void OpenEVSEClass::getStatus(std::function<void(int ret, uint8_t evse_state, uint32_t session_time, uint8_t pilot_state, uint32_t vflags)> callback)
 {
   if (!_sender) {
@@ -89,40 +313,113 @@ void OpenEVSEClass::getStatus(std::function<void(int ret, uint8_t evse_state, ui
   // Check state the OpenEVSE is in.
   _sender->sendCmd("$GS", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      int tokens_required = (_protocol < OPENEVSE_OCPP_SUPPORT_PROTOCOL_VERSION) ? 3 : 5;
-      int state_base = (_protocol < OPENEVSE_OCPP_SUPPORT_PROTOCOL_VERSION) ? 10 : 16;
-      if(_sender->getTokenCnt() >= tokens_required)
-      {
-        const char *val = _sender->getToken(1);
-        uint8_t evse_state = strtol(val, NULL, state_base);
-
-        val = _sender->getToken(2);
-        uint32_t elapsed = strtol(val, NULL, 10);
+    OpenEVSEStatusResult result;
+    parseStatus(ret, result);
+    callback(result.ret, result.evse_state, result.session_time, result.pilot_state, result.vflags);
+  });
+}
 
-        uint8_t pilot_state = OPENEVSE_STATE_INVALID;
-        uint32_t vflags = 0;
+// $OK evse_state elapsed, decimal, then from the OCPP protocol version
+// $OK evse_state elapsed pilot_state vflags with all but elapsed in hex
+static constexpr RapiField statusFields[] = {
+  RAPI_FIELD_BEFORE(OpenEVSEStatusResult, evse_state, 1, 10, OPENEVSE_OCPP_SUPPORT_PROTOCOL_VERSION),
+  RAPI_FIELD_SINCE(OpenEVSEStatusResult, evse_state, 1, 16, OPENEVSE_OCPP_SUPPORT_PROTOCOL_VERSION),
+  RAPI_FIELD(OpenEVSEStatusResult, session_time, 2, 10),
+  RAPI_FIELD_SINCE(OpenEVSEStatusResult, pilot_state, 3, 16, OPENEVSE_OCPP_SUPPORT_PROTOCOL_VERSION),
+  RAPI_FIELD_SINCE(OpenEVSEStatusResult, vflags, 4, 16, OPENEVSE_OCPP_SUPPORT_PROTOCOL_VERSION)
+};
+
+void OpenEVSEClass::parseStatus(int ret, OpenEVSEStatusResult &result)
+{
+  result = { ret, (uint8_t)OPENEVSE_STATE_INVALID, 0, (uint8_t)OPENEVSE_STATE_INVALID, 0 };
+  if (RAPI_RESPONSE_OK == rapiParse(*_sender, ret, protocol(), statusFields, result))
+  {
+    DBUGF("evse_state = %02x, elapsed = %d, pilot_state = %02x, vflags = %08x", result.evse_state, result.session_time, result.pilot_state, result.vflags);
+    _status.evse_state = result.evse_state;
+    _status.pilot_state = result.pilot_state;
+    statusUpdated();
+    // No vflags before the OCPP protocol, leave them unknown
+    if(protocol() >= OPENEVSE_OCPP_SUPPORT_PROTOCOL_VERSION) {
+      flagsUpdated(result.vflags);
+    }
+    RAPI_TRACE(RAPI_TRACE_EVSE_STATE, rapiTraceCode("GS"), ret, 0, (result.evse_state << 8) | result.pilot_state, _sender->getTraceLink());
+  }
+}
 
-        if(_protocol >= OPENEVSE_OCPP_SUPPORT_PROTOCOL_VERSION) {
-          val = _sender->getToken(3);
-          pilot_state = strtol(val, NULL, state_base);
+void OpenEVSEClass::statusUpdated()
+{
+  _status.updated = millis();
+  _statusValid = true;
+}
 
-          val = _sender->getToken(4);
-          vflags = strtol(val, NULL, 16);
-        }
+void OpenEVSEClass::flagsUpdated(uint32_t vflags)
+{
+#if OPENEVSE_ENABLE_ASYNC_EVENTS
+  // Only edges from a value we actually read, not the zeroed start
+  uint32_t changed = _vflagsKnown ? _status.vflags ^ vflags : 0;
+#endif
+  _status.vflags = vflags;
+  _vflagsKnown = true;
 
-        DBUGF("evse_state = %02x, elapsed = %d, pilot_state = %02x, vflags = %08x", evse_state, elapsed, pilot_state, vflags);
-        callback(RAPI_RESPONSE_OK, evse_state, elapsed, pilot_state, vflags);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, OPENEVSE_STATE_INVALID, 0, OPENEVSE_STATE_INVALID, 0);
-      }
-    } else {
-      callback(ret, OPENEVSE_STATE_INVALID, 0, OPENEVSE_STATE_INVALID, 0);
+#if OPENEVSE_ENABLE_ASYNC_EVENTS
+  if(changed)
+  {
+    if(_flags) {
+      _flags(vflags, changed);
     }
+
+    OpenEVSEEvent event = stateEvent(OPENEVSE_EVENT_FLAGS);
+    event.changed = changed;
+    publish(event);
+  }
+#endif
+}
+
+uint32_t OpenEVSEClass::getStatusAge()
+{
+  return _statusValid ? millis() - _status.updated : OPENEVSE_STATUS_AGE_UNKNOWN;
+}
+
+void OpenEVSEClass::refreshStatus(uint32_t max_age, OpenEVSEStatusCallback callback)
+{
+  if (_statusValid && getStatusAge() <= max_age) {
+    callback(RAPI_RESPONSE_OK, _status);
+    return;
+  }
+
+  if (!_sender) {
+    return;
+  }
+
+  _sender->sendCmd("$GS", [this, callback](int ret)
+  {
+    OpenEVSEStatusResult result;
+    parseStatus(ret, result);
+    callback(result.ret, _status);
   });
 }
 
+#if OPENEVSE_ENABLE_TIME
+// $OK yr mo day hr min sec, yr is 2 digits
+struct OpenEVSEClockResult {
+  int ret;
+  long year;
+  long month;
+  long day;
+  long hour;
+  long minute;
+  long second;
+};
+
+static constexpr RapiField clockFields[] = {
+  RAPI_FIELD(OpenEVSEClockResult, year, 1, 10),
+  RAPI_FIELD(OpenEVSEClockResult, month, 2, 10),
+  RAPI_FIELD(OpenEVSEClockResult, day, 3, 10),
+  RAPI_FIELD(OpenEVSEClockResult, hour, 4, 10),
+  RAPI_FIELD(OpenEVSEClockResult, minute, 5, 10),
+  RAPI_FIELD(OpenEVSEClockResult, second, 6, 10)
+};
+
 void OpenEVSEClass::getTime(std::function<void(int ret, time_t time)> callback)
 {
   if (!_sender) {
@@ -135,42 +432,34 @@ void OpenEVSEClass::getTime(std::function<void(int ret, time_t time)> callback)
 
   _sender->sendCmd("$GT", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
+    OpenEVSEClockResult result = {};
+    if (RAPI_RESPONSE_OK != rapiParse(*_sender, ret, protocol(), clockFields, result)) {
+      callback(result.ret, 0);
+      return;
+    }
+
+    DBUGF("Got time %ld %ld %ld %ld %ld %ld", result.year, result.month, result.day, result.hour, result.minute, result.second);
+
+    // No RTC fitted
+    if(165 == result.year || 165 == result.month || 165 == result.day ||
+       165 == result.hour || 165 == result.minute || 85 == result.second)
     {
-      if(_sender->getTokenCnt() >= 7)
-      {
-        long year = strtol(_sender->getToken(1), NULL, 10);
-        long month = strtol(_sender->getToken(2), NULL, 10);
-        long day = strtol(_sender->getToken(3), NULL, 10);
-        long hour = strtol(_sender->getToken(4), NULL, 10);
-        long minute = strtol(_sender->getToken(5), NULL, 10);
-        long second = strtol(_sender->getToken(6), NULL, 10);
-
-        DBUGF("Got time %ld %ld %ld %ld %ld %ld", year, month, day, hour, minute, second);
-
-        if(165 != year && 165 != month && 165 != day && 165 != hour && 165 != minute && 85 != second)
-        {
-          struct tm tm;
-          memset(&tm, 0, sizeof(tm));
-
-          tm.tm_year = 100+year;
-          tm.tm_mon = month - 1;
-          tm.tm_mday = day;
-          tm.tm_hour = hour;
-          tm.tm_min = minute;
-          tm.tm_sec = second;
-
-          time_t time = mktime(&tm);
-          callback(RAPI_RESPONSE_OK, time);
-        } else {
-          callback(RAPI_RESPONSE_FEATURE_NOT_SUPPORTED, 0);
-        }
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, 0);
-      }
-    } else {
-      callback(ret, 0);
+      callback(RAPI_RESPONSE_FEATURE_NOT_SUPPORTED, 0);
+      return;
     }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+
+    tm.tm_year = 100+result.year;
+    tm.tm_mon = result.month - 1;
+    tm.tm_mday = result.day;
+    tm.tm_hour = result.hour;
+    tm.tm_min = result.minute;
+    tm.tm_sec = result.second;
+
+    time_t time = mktime(&tm);
+    callback(RAPI_RESPONSE_OK, time);
   });
 }
 
@@ -215,6 +504,7 @@ void OpenEVSEClass::setTime(tm &time, std::function<void(int ret)> callback)
   });
 
 }
+#endif // OPENEVSE_ENABLE_TIME
 
 void OpenEVSEClass::getChargeCurrentAndVoltage(std::function<void(int ret, double amps, double volts)> callback)
 {
@@ -229,23 +519,24 @@ void OpenEVSEClass::getChargeCurrentAndVoltage(std::function<void(int ret, doubl
 
   _sender->sendCmd("$GG", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 3)
-      {
-        long milliAmps = strtol(_sender->getToken(1), NULL, 10);
-        long milliVolts = strtol(_sender->getToken(2), NULL, 10);
-
-        callback(ret, (double)milliAmps / 1000.0, (double)milliVolts / 1000.0);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, 0, 0);
-      }
-    } else {
-      callback(ret, 0, 0);
-    }
+    OpenEVSEChargeResult result;
+    parseChargeCurrentAndVoltage(ret, result);
+    callback(result.ret, result.amps, result.volts);
   });
 }
 
+// $OK milliamps millivolts
+static constexpr RapiField chargeFields[] = {
+  RAPI_FIELD_SCALED(OpenEVSEChargeResult, amps, 1, 1000),
+  RAPI_FIELD_SCALED(OpenEVSEChargeResult, volts, 2, 1000)
+};
+
+void OpenEVSEClass::parseChargeCurrentAndVoltage(int ret, OpenEVSEChargeResult &result)
+{
+  result = { ret, 0, 0 };
+  rapiParse(*_sender, ret, protocol(), chargeFields, result);
+}
+
 void OpenEVSEClass::getTemperature(std::function<void(int ret, double temp1, bool temp1_valid, double temp2, bool temp2_valid, double temp3, bool temp3_valid)> callback)
 {
   if (!_sender) {
@@ -263,22 +554,29 @@ void OpenEVSEClass::getTemperature(std::function<void(int ret, double temp1, boo
 
   _sender->sendCmd("$GP", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 4)
-      {
-        long temp1 = strtol(_sender->getToken(1), NULL, 10);
-        long temp2 = strtol(_sender->getToken(2), NULL, 10);
-        long temp3 = strtol(_sender->getToken(3), NULL, 10);
+    OpenEVSETemperatureResult result;
+    parseTemperature(ret, result);
+    callback(result.ret, result.temp[0], result.valid[0], result.temp[1], result.valid[1], result.temp[2], result.valid[2]);
+  });
+}
 
-        callback(ret, (double)temp1 / 10.0, -2560 != temp1, (double)temp2 / 10.0, -2560 != temp2, (double)temp3 / 10.0, -2560 != temp3);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, 0, false, 0, false, 0, false);
-      }
-    } else {
-      callback(ret, 0, false, 0, false, 0, false);
+// $OK ds3231temp mcp9808temp tmp007temp in 10ths of a degree
+static constexpr RapiField temperatureFields[] = {
+  RAPI_FIELD_SCALED(OpenEVSETemperatureResult, temp[0], 1, 10),
+  RAPI_FIELD_SCALED(OpenEVSETemperatureResult, temp[1], 2, 10),
+  RAPI_FIELD_SCALED(OpenEVSETemperatureResult, temp[2], 3, 10)
+};
+
+void OpenEVSEClass::parseTemperature(int ret, OpenEVSETemperatureResult &result)
+{
+  result = {};
+  if (RAPI_RESPONSE_OK == rapiParse(*_sender, ret, protocol(), temperatureFields, result))
+  {
+    // Sensors that are not fitted read -2560
+    for(int i = 0; i < 3; i++) {
+      result.valid[i] = -256.0 != result.temp[i];
     }
-  });
+  }
 }
 
 void OpenEVSEClass::getEnergy(std::function<void(int ret, double session_wh, double total_kwh)> callback)
@@ -297,23 +595,128 @@ void OpenEVSEClass::getEnergy(std::function<void(int ret, double session_wh, dou
 
   _sender->sendCmd("$GU", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 3)
-      {
-        long wattseconds = strtol(_sender->getToken(1), NULL, 10);
-        long whacc = strtol(_sender->getToken(2), NULL, 10);
-
-        callback(ret, (double)wattseconds / 3600.0, (double)whacc / 1000.0);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, 0, 0);
-      }
-    } else {
-      callback(ret, 0, 0);
-    }
+    OpenEVSEEnergyResult result;
+    parseEnergy(ret, result);
+    callback(result.ret, result.session_wh, result.total_kwh);
   });
 }
 
+// $OK wattseconds whacc
+static constexpr RapiField energyFields[] = {
+  RAPI_FIELD_SCALED(OpenEVSEEnergyResult, session_wh, 1, 3600),
+  RAPI_FIELD_SCALED(OpenEVSEEnergyResult, total_kwh, 2, 1000)
+};
+
+void OpenEVSEClass::parseEnergy(int ret, OpenEVSEEnergyResult &result)
+{
+  result = { ret, 0, 0 };
+  rapiParse(*_sender, ret, protocol(), energyFields, result);
+}
+
+#if OPENEVSE_ENABLE_TELEMETRY
+void OpenEVSEClass::getTelemetry(uint8_t items, OpenEVSETelemetryCallback callback)
+{
+  if (!_sender) {
+    return;
+  }
+
+  if (_telemetryPending > 0)
+  {
+    OpenEVSETelemetry busy = {};
+    busy.requested = items;
+    busy.failed = items;
+    callback(RAPI_RESPONSE_QUEUE_FULL, busy);
+    return;
+  }
+
+  _telemetry = {};
+  _telemetry.requested = items & OPENEVSE_TELEMETRY_ALL;
+  _telemetry.status.ret = RAPI_RESPONSE_TIMEOUT;
+  _telemetry.charge.ret = RAPI_RESPONSE_TIMEOUT;
+  _telemetry.temperature.ret = RAPI_RESPONSE_TIMEOUT;
+  _telemetry.energy.ret = RAPI_RESPONSE_TIMEOUT;
+  _telemetryCallback = callback;
+  _telemetryStart = millis();
+
+  // One extra so a command completing straight away, e.g. a full queue,
+  // can not finish the batch before the rest are queued. The handlers only
+  // capture this, so std::function does not allocate for them.
+  _telemetryPending = 1;
+  if (_telemetry.requested & OPENEVSE_TELEMETRY_STATUS) {
+    _telemetryPending++;
+    _sender->sendCmd("$GS", [this](int ret) { telemetryItem(OPENEVSE_TELEMETRY_STATUS, ret); });
+  }
+  if (_telemetry.requested & OPENEVSE_TELEMETRY_CHARGE) {
+    _telemetryPending++;
+    _sender->sendCmd("$GG", [this](int ret) { telemetryItem(OPENEVSE_TELEMETRY_CHARGE, ret); });
+  }
+  if (_telemetry.requested & OPENEVSE_TELEMETRY_TEMPERATURE) {
+    _telemetryPending++;
+    _sender->sendCmd("$GP", [this](int ret) { telemetryItem(OPENEVSE_TELEMETRY_TEMPERATURE, ret); });
+  }
+  if (_telemetry.requested & OPENEVSE_TELEMETRY_ENERGY) {
+    _telemetryPending++;
+    _sender->sendCmd("$GU", [this](int ret) { telemetryItem(OPENEVSE_TELEMETRY_ENERGY, ret); });
+  }
+  telemetryItem(0, RAPI_RESPONSE_OK);
+}
+
+void OpenEVSEClass::telemetryItem(uint8_t item, int ret)
+{
+  switch(item)
+  {
+    case OPENEVSE_TELEMETRY_STATUS:
+      parseStatus(ret, _telemetry.status);
+      ret = _telemetry.status.ret;
+      break;
+    case OPENEVSE_TELEMETRY_CHARGE:
+      parseChargeCurrentAndVoltage(ret, _telemetry.charge);
+      ret = _telemetry.charge.ret;
+      break;
+    case OPENEVSE_TELEMETRY_TEMPERATURE:
+      parseTemperature(ret, _telemetry.temperature);
+      ret = _telemetry.temperature.ret;
+      break;
+    case OPENEVSE_TELEMETRY_ENERGY:
+      parseEnergy(ret, _telemetry.energy);
+      ret = _telemetry.energy.ret;
+      break;
+  }
+  if (RAPI_RESPONSE_OK != ret) {
+    _telemetry.failed |= item;
+  }
+
+  if (0 == _telemetryPending || 0 != --_telemetryPending) {
+    return;
+  }
+  _telemetry.took = millis() - _telemetryStart;
+
+  // First failure in the order the commands were sent
+  int result = RAPI_RESPONSE_OK;
+  if (_telemetry.failed & OPENEVSE_TELEMETRY_STATUS) {
+    result = _telemetry.status.ret;
+  } else if (_telemetry.failed & OPENEVSE_TELEMETRY_CHARGE) {
+    result = _telemetry.charge.ret;
+  } else if (_telemetry.failed & OPENEVSE_TELEMETRY_TEMPERATURE) {
+    result = _telemetry.temperature.ret;
+  } else if (_telemetry.failed & OPENEVSE_TELEMETRY_ENERGY) {
+    result = _telemetry.energy.ret;
+  }
+
+  // The callback may start the next batch
+  OpenEVSETelemetryCallback callback = std::move(_telemetryCallback);
+  _telemetryCallback = NULL;
+  callback(result, _telemetry);
+}
+#endif // OPENEVSE_ENABLE_TELEMETRY
+
+// $OK gfitripcnt nogndtripcnt stuckrelaytripcnt
+static constexpr RapiField faultCounterFields[] = {
+  RAPI_FIELD(OpenEVSEFaultCountersResult, gfci_count, 1, 16),
+  RAPI_FIELD(OpenEVSEFaultCountersResult, nognd_count, 2, 16),
+  RAPI_FIELD(OpenEVSEFaultCountersResult, stuck_count, 3, 16)
+};
+
 void OpenEVSEClass::getFaultCounters(std::function<void(int ret, long gfci_count, long nognd_count, long stuck_count)> callback)
 {
   if (!_sender) {
@@ -327,28 +730,18 @@ void OpenEVSEClass::getFaultCounters(std::function<void(int ret, long gfci_count
 
   _sender->sendCmd("$GF", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 4)
-      {
-        const char *val;
-        val = _sender->getToken(1);
-        long gfci_count = strtol(val, NULL, 16);
-        val = _sender->getToken(2);
-        long nognd_count = strtol(val, NULL, 16);
-        val = _sender->getToken(3);
-        long stuck_count = strtol(val, NULL, 16);
-
-        callback(ret, gfci_count, nognd_count, stuck_count);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, 0, 0, 0);
-      }
-    } else {
-      callback(ret, 0, 0, 0);
-    }
+    OpenEVSEFaultCountersResult result = {};
+    rapiParse(*_sender, ret, protocol(), faultCounterFields, result);
+    callback(result.ret, result.gfci_count, result.nognd_count, result.stuck_count);
   });
 }
 
+// $OK amps flags
+static constexpr RapiField settingsFields[] = {
+  RAPI_FIELD(OpenEVSESettingsResult, pilot, 1, 10),
+  RAPI_FIELD(OpenEVSESettingsResult, flags, 2, 16)
+};
+
 void OpenEVSEClass::getSettings(std::function<void(int ret, long pilot, uint32_t flags)> callback)
 {
   if (!_sender) {
@@ -359,28 +752,32 @@ void OpenEVSEClass::getSettings(std::function<void(int ret, long pilot, uint32_t
   //  response: $OK amps(decimal) flags(hex)
   //  $GE^26
 
+#if OPENEVSE_ENABLE_CACHE
+  if(cached(OPENEVSE_CACHE_SETTINGS)) {
+    callback(RAPI_RESPONSE_OK, _cacheSettings.pilot, _cacheSettings.flags);
+    return;
+  }
+#endif
+
   _sender->sendCmd("$GE", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 3)
-      {
-        const char *val;
-        val = _sender->getToken(1);
-        long pilot = strtol(val, NULL, 10);
-        val = _sender->getToken(2);
-        long flags = strtol(val, NULL, 16);
-
-        callback(ret, pilot, (uint32_t)flags);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, 0, 0);
-      }
-    } else {
-      callback(ret, 0, 0);
+    OpenEVSESettingsResult result = {};
+    rapiParse(*_sender, ret, protocol(), settingsFields, result);
+#if OPENEVSE_ENABLE_CACHE
+    if(RAPI_RESPONSE_OK == result.ret) {
+      _cacheSettings = result;
+      cacheStore(OPENEVSE_CACHE_SETTINGS);
     }
+#endif
+    callback(result.ret, result.pilot, result.flags);
   });
 }
 
+// $OK mcuid
+static constexpr RapiField serialFields[] = {
+  RAPI_FIELD(OpenEVSESerialResult, serial, 1, 10)
+};
+
 void OpenEVSEClass::getSerial(std::function<void(int ret, const char *serial)> callback)
 {
   if (!_sender) {
@@ -396,28 +793,33 @@ void OpenEVSEClass::getSerial(std::function<void(int ret, const char *serial)> c
   //         unknown in 328P. The first 6 characters are ASCII, and the rest are
   //         hexadecimal.
 
+#if OPENEVSE_ENABLE_CACHE
+  if(cached(OPENEVSE_CACHE_SERIAL)) {
+    callback(RAPI_RESPONSE_OK, _cacheSerial);
+    return;
+  }
+#endif
+
   _sender->sendCmd("$GI", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 2)
-      {
-        const char *val;
-        val = _sender->getToken(1);
-        while(' ' == *val) {
-          val++;
-        }
-
-        callback(ret, val);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, NULL);
-      }
-    } else {
-      callback(ret, NULL);
+    OpenEVSESerialResult result = {};
+    rapiParse(*_sender, ret, protocol(), serialFields, result);
+#if OPENEVSE_ENABLE_CACHE
+    if(RAPI_RESPONSE_OK == result.ret) {
+      snprintf(_cacheSerial, sizeof(_cacheSerial), "%s", result.serial);
+      cacheStore(OPENEVSE_CACHE_SERIAL);
     }
+#endif
+    callback(result.ret, result.serial);
   });
 }
 
+#if OPENEVSE_ENABLE_D9
+// $OK frequency
+static constexpr RapiField frequencyFields[] = {
+  RAPI_FIELD(OpenEVSEFrequencyResult, frequency, 1, 10)
+};
+
 void OpenEVSEClass::getFrequency(std::function<void(int ret, uint32_t frequency)> callback)
 {
   if (!_sender) {
@@ -436,22 +838,19 @@ void OpenEVSEClass::getFrequency(std::function<void(int ret, uint32_t frequency)
 
   _sender->sendCmd("$GZ", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 2)
-      {
-        uint32_t frequency = strtoul(_sender->getToken(1), NULL, 10);
-
-        callback(ret, frequency);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, 0);
-      }
-    } else {
-      callback(ret, 0);
-    }
+    OpenEVSEFrequencyResult result = {};
+    rapiParse(*_sender, ret, protocol(), frequencyFields, result);
+    callback(result.ret, result.frequency);
   });
 }
 
+// $OK dc1 dc2 ac
+static constexpr RapiField relayFields[] = {
+  RAPI_FIELD(OpenEVSERelayResult, dc1, 1, 10),
+  RAPI_FIELD(OpenEVSERelayResult, dc2, 2, 10),
+  RAPI_FIELD(OpenEVSERelayResult, ac, 3, 10)
+};
+
 void OpenEVSEClass::getRelayStatus(std::function<void(int ret, bool dc1, bool dc2, bool ac)> callback)
 {
   if (!_sender) {
@@ -471,21 +870,9 @@ void OpenEVSEClass::getRelayStatus(std::function<void(int ret, bool dc1, bool dc
 
   _sender->sendCmd("$GR", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 4)
-      {
-        bool dc1 = strtol(_sender->getToken(1), NULL, 10) != 0;
-        bool dc2 = strtol(_sender->getToken(2), NULL, 10) != 0;
-        bool ac  = strtol(_sender->getToken(3), NULL, 10) != 0;
-
-        callback(ret, dc1, dc2, ac);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, false, false, false);
-      }
-    } else {
-      callback(ret, false, false, false);
-    }
+    OpenEVSERelayResult result = {};
+    rapiParse(*_sender, ret, protocol(), relayFields, result);
+    callback(result.ret, result.dc1, result.dc2, result.ac);
   });
 }
 
@@ -553,6 +940,7 @@ void OpenEVSEClass::setPanicTemperature(uint32_t tempC, std::function<void(int r
     callback(ret);
   });
 }
+#endif // OPENEVSE_ENABLE_D9
 
 void OpenEVSEClass::setServiceLevel(uint8_t level, std::function<void(int ret)> callback)
 {
@@ -569,6 +957,8 @@ void OpenEVSEClass::setServiceLevel(uint8_t level, std::function<void(int ret)>
   snprintf(command, sizeof(command), "$SL %c", level);
 
   _sender->sendCmd(command, [this, callback](int ret) {
+    // The current limits and flags depend on the service level
+    cacheInvalidate(OPENEVSE_CACHE_CURRENT_CAPACITY | OPENEVSE_CACHE_SETTINGS);
     callback(ret);
   });
 }
@@ -589,32 +979,45 @@ void OpenEVSEClass::getCurrentCapacity(std::function<void(int ret, long min_curr
   //  n.b. maxamps,emaxamps values are dependent on the active service level (L1/L2)
   //  $GC^20
 
+#if OPENEVSE_ENABLE_CACHE
+  if(cached(OPENEVSE_CACHE_CURRENT_CAPACITY)) {
+    const OpenEVSECurrentCapacityResult &result = _cacheCurrentCapacity;
+    callback(RAPI_RESPONSE_OK, result.min_current, result.max_hardware_current, result.pilot, result.max_configured_current);
+    return;
+  }
+#endif
+
   _sender->sendCmd("$GC", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 5)
-      {
-        const char *val;
-        val = _sender->getToken(1);
-        long min_current = strtol(val, NULL, 10);
-        val = _sender->getToken(2);
-        long max_hardware_current = strtol(val, NULL, 10);
-        val = _sender->getToken(3);
-        long pilot = strtol(val, NULL, 10);
-        val = _sender->getToken(4);
-        long max_configured_current = strtol(val, NULL, 10);
-
-        callback(ret, min_current, max_hardware_current, pilot, max_configured_current);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, 0, 0, 0, 0);
-      }
-    } else {
-      callback(ret, 0, 0, 0, 0);
+    OpenEVSECurrentCapacityResult result;
+    parseCurrentCapacity(ret, result);
+#if OPENEVSE_ENABLE_CACHE
+    if(RAPI_RESPONSE_OK == result.ret) {
+      _cacheCurrentCapacity = result;
+      cacheStore(OPENEVSE_CACHE_CURRENT_CAPACITY);
     }
+#endif
+    // Historically in response order rather than the order of the names
+    callback(result.ret, result.min_current, result.max_hardware_current, result.pilot, result.max_configured_current);
   });
 }
 
+// $OK minamps hmaxamps pilotamps cmaxamps
+static constexpr RapiField currentCapacityFields[] = {
+  RAPI_FIELD(OpenEVSECurrentCapacityResult, min_current, 1, 10),
+  RAPI_FIELD(OpenEVSECurrentCapacityResult, max_hardware_current, 2, 10),
+  RAPI_FIELD(OpenEVSECurrentCapacityResult, pilot, 3, 10),
+  RAPI_FIELD(OpenEVSECurrentCapacityResult, max_configured_current, 4, 10)
+};
+
+void OpenEVSEClass::parseCurrentCapacity(int ret, OpenEVSECurrentCapacityResult &result)
+{
+  result = { ret, 0, 0, 0, 0 };
+  if(RAPI_RESPONSE_OK == rapiParse(*_sender, ret, protocol(), currentCapacityFields, result)) {
+    capacityUpdated(result.pilot);
+  }
+}
+
 void OpenEVSEClass::setCurrentCapacity(long amps, bool save, std::function<void(int ret, long pilot)> callback)
 {
   setCurrentCapacity(amps, save ? "": " V", callback);
@@ -657,23 +1060,44 @@ void OpenEVSEClass::setCurrentCapacity(long amps, const char *mode, std::functio
 
   _sender->sendCmd(command, [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret || RAPI_RESPONSE_NK == ret)
-    {
-      if(_sender->getTokenCnt() >= 2)
-      {
-        const char *val = _sender->getToken(1);
-        long pilot = strtol(val, NULL, 10);
-
-        callback(ret, pilot);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, 0);
-      }
-    } else {
-      callback(ret, 0);
-    }
+    OpenEVSEPilotResult result;
+    parsePilot(ret, result);
+    callback(result.ret, result.pilot);
   });
 }
 
+// $OK ampsset, or $NK ampsset if it was clamped
+static constexpr RapiField pilotFields[] = {
+  RAPI_FIELD(OpenEVSEPilotResult, pilot, 1, 10)
+};
+
+void OpenEVSEClass::parsePilot(int ret, OpenEVSEPilotResult &result)
+{
+  // Even a $NK may have clamped the pilot to a new value
+  cacheInvalidate(OPENEVSE_CACHE_CURRENT_CAPACITY | OPENEVSE_CACHE_SETTINGS);
+  result = { ret, 0 };
+  int parsed = rapiParse(*_sender, ret, protocol(), pilotFields, result, RAPI_SCHEMA_NK_HAS_DATA);
+  if(RAPI_RESPONSE_OK == parsed || RAPI_RESPONSE_NK == parsed) {
+    capacityUpdated(result.pilot);
+  }
+}
+
+void OpenEVSEClass::capacityUpdated(uint32_t current_capacity)
+{
+  // The pilot changed some other way, e.g. the LCD menu or a missed heartbeat
+  if(_capacityKnown && current_capacity != _status.current_capacity) {
+    cacheInvalidate(OPENEVSE_CACHE_CURRENT_CAPACITY | OPENEVSE_CACHE_SETTINGS);
+  }
+  _status.current_capacity = current_capacity;
+  _capacityKnown = true;
+}
+
+
+// $OK currentscalefactor currentoffset
+static constexpr RapiField ammeterFields[] = {
+  RAPI_FIELD(OpenEVSEAmmeterResult, scale, 1, 10),
+  RAPI_FIELD(OpenEVSEAmmeterResult, offset, 2, 10)
+};
 
 void OpenEVSEClass::getAmmeterSettings(std::function<void(int ret, long scale, long offset)> callback)
 {
@@ -685,25 +1109,24 @@ void OpenEVSEClass::getAmmeterSettings(std::function<void(int ret, long scale, l
   //  response: $OK currentscalefactor currentoffset
   //  $GA^22
 
+#if OPENEVSE_ENABLE_CACHE
+  if(cached(OPENEVSE_CACHE_AMMETER)) {
+    callback(RAPI_RESPONSE_OK, _cacheAmmeter.scale, _cacheAmmeter.offset);
+    return;
+  }
+#endif
+
   _sender->sendCmd("$GA", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 3)
-      {
-        const char *val;
-        val = _sender->getToken(1);
-        long scale = strtol(val, NULL, 10);
-        val = _sender->getToken(2);
-        long offset = strtol(val, NULL, 10);
-
-        callback(ret, scale, offset);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, 0, 0);
-      }
-    } else {
-      callback(ret, 0, 0);
+    OpenEVSEAmmeterResult result = {};
+    rapiParse(*_sender, ret, protocol(), ammeterFields, result);
+#if OPENEVSE_ENABLE_CACHE
+    if(RAPI_RESPONSE_OK == result.ret) {
+      _cacheAmmeter = result;
+      cacheStore(OPENEVSE_CACHE_AMMETER);
     }
+#endif
+    callback(result.ret, result.scale, result.offset);
   });
 }
 
@@ -720,6 +1143,7 @@ void OpenEVSEClass::setAmmeterSettings(long scale, long offset, std::function<vo
 
   _sender->sendCmd(command, [this, callback](int ret)
   {
+    cacheInvalidate(OPENEVSE_CACHE_AMMETER);
     if (RAPI_RESPONSE_OK == ret)
     {
       if(_sender->getTokenCnt() >= 2)
@@ -770,6 +1194,14 @@ void OpenEVSEClass::setVoltage(double volts, std::function<void(int ret)> callba
   setVoltage((uint32_t)round(volts * 1000), callback);
 }
 
+// $OK starthr startmin endhr endmin
+static constexpr RapiField timerFields[] = {
+  RAPI_FIELD(OpenEVSETimerResult, start_hour, 1, 10),
+  RAPI_FIELD(OpenEVSETimerResult, start_minute, 2, 10),
+  RAPI_FIELD(OpenEVSETimerResult, end_hour, 3, 10),
+  RAPI_FIELD(OpenEVSETimerResult, end_minute, 4, 10)
+};
+
 void OpenEVSEClass::getTimer(std::function<void(int ret, int start_hour, int start_minute, int end_hour, int end_minute)> callback)
 {
   if (!_sender) {
@@ -781,24 +1213,24 @@ void OpenEVSEClass::getTimer(std::function<void(int ret, int start_hour, int sta
   //    all values decimal
   //    if timer disabled, starthr=startmin=endhr=endmin=0
 
+#if OPENEVSE_ENABLE_CACHE
+  if(cached(OPENEVSE_CACHE_TIMER)) {
+    callback(RAPI_RESPONSE_OK, _cacheTimer.start_hour, _cacheTimer.start_minute, _cacheTimer.end_hour, _cacheTimer.end_minute);
+    return;
+  }
+#endif
+
   _sender->sendCmd("$GD", [this, callback](int ret)
   {
-    if (RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 5)
-      {
-        int starthr = strtol(_sender->getToken(1), NULL, 10);
-        int startmin = strtol(_sender->getToken(2), NULL, 10);
-        int endhr = strtol(_sender->getToken(3), NULL, 10);
-        int endmin = strtol(_sender->getToken(4), NULL, 10);
-
-        callback(ret, starthr, startmin, endhr, endmin);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, 0, 0, 0, 0);
-      }
-    } else {
-      callback(ret, 0, 0, 0, 0);
+    OpenEVSETimerResult result = {};
+    rapiParse(*_sender, ret, protocol(), timerFields, result);
+#if OPENEVSE_ENABLE_CACHE
+    if(RAPI_RESPONSE_OK == result.ret) {
+      _cacheTimer = result;
+      cacheStore(OPENEVSE_CACHE_TIMER);
     }
+#endif
+    callback(result.ret, result.start_hour, result.start_minute, result.end_hour, result.end_minute);
   });
 }
 
@@ -816,6 +1248,7 @@ void OpenEVSEClass::setTimer(int start_hour, int start_minute, int end_hour, int
 
   _sender->sendCmd(command, [this, callback](int ret)
   {
+    cacheInvalidate(OPENEVSE_CACHE_TIMER);
     if (RAPI_RESPONSE_OK == ret)
     {
       if(_sender->getTokenCnt() >= 1)
@@ -882,6 +1315,7 @@ void OpenEVSEClass::restart(std::function<void(int ret)> callback)
   //  $FD*AE
 
   _sender->sendCmd("$FR", [this, callback](int ret) {
+    cacheInvalidate(OPENEVSE_CACHE_ALL);
     callback(ret);
   });
 }
@@ -927,10 +1361,12 @@ void OpenEVSEClass::feature(uint8_t feature, bool enable, std::function<void(int
   snprintf(command, sizeof(command), "$FF %c %d", feature, enable ? 1 : 0);
 
   _sender->sendCmd(command, [this, callback](int ret) {
+    cacheInvalidate(OPENEVSE_CACHE_SETTINGS);
     callback(ret);
   });
 }
 
+#if OPENEVSE_ENABLE_LCD
 void OpenEVSEClass::lcdEnable(bool enable, std::function<void(int ret)> callback)
 {
   if (!_sender) {
@@ -990,7 +1426,7 @@ void OpenEVSEClass::lcdDisplayText(int x, int y, const char *text, std::function
 
   // replace spaces in the message with the magic char
   int expected_spaces = 3;
-  for(int i = 0; i < strlen(command); i++)
+  for(size_t i = 0; i < strlen(command); i++)
   {
     if(command[i] == ' ' && --expected_spaces < 0) {
       command[i] = OPENEVSE_LCD_SPACE_MAGIC_CHAR;
@@ -1001,6 +1437,15 @@ void OpenEVSEClass::lcdDisplayText(int x, int y, const char *text, std::function
     callback(ret);
   });
 }
+#endif // OPENEVSE_ENABLE_LCD
+
+#if OPENEVSE_ENABLE_HEARTBEAT
+// $OK heartbeatinterval hearbeatcurrentlimit hearbeattrigger
+static constexpr RapiField heartbeatFields[] = {
+  RAPI_FIELD(OpenEVSEHeartbeatResult, interval, 1, 10),
+  RAPI_FIELD(OpenEVSEHeartbeatResult, current, 2, 10),
+  RAPI_FIELD(OpenEVSEHeartbeatResult, triggered, 3, 10)
+};
 
 void OpenEVSEClass::heartbeatEnable(int interval, int current, std::function<void(int ret, int interval, int current, int triggered)> callback)
 {
@@ -1023,21 +1468,11 @@ void OpenEVSEClass::heartbeatEnable(int interval, int current, std::function<voi
 
   _sender->sendCmd(command, [this, callback](int ret)
   {
-    if(RAPI_RESPONSE_OK == ret)
-    {
-      if(_sender->getTokenCnt() >= 4)
-      {
-        int interval = strtol(_sender->getToken(1), NULL, 10);
-        int current = strtol(_sender->getToken(2), NULL, 10);
-        int triggered = strtol(_sender->getToken(3), NULL, 10);
-
-        callback(ret, interval, current, triggered);
-      } else {
-        callback(RAPI_RESPONSE_INVALID_RESPONSE, 0, 0, 0);
-      }
-    } else {
-      callback(ret, 0, 0, 0);
-    }
+    OpenEVSEHeartbeatResult result = {};
+    rapiParse(*_sender, ret, protocol(), heartbeatFields, result);
+    // A missed pulse limits the pilot
+    cacheInvalidate(OPENEVSE_CACHE_CURRENT_CAPACITY | OPENEVSE_CACHE_SETTINGS);
+    callback(result.ret, result.interval, result.current, result.triggered);
   });
 }
 
@@ -1064,12 +1499,17 @@ void OpenEVSEClass::heartbeatPulse(bool ack_missed, std::function<void(int ret)>
   {
     if(RAPI_RESPONSE_OK == ret) {
       callback(RAPI_RESPONSE_OK);
+      return;
     }
-    else if(RAPI_RESPONSE_NK == ret && ack_missed)
+
+    // A missed pulse limited the pilot, the ack restores it
+    cacheInvalidate(OPENEVSE_CACHE_CURRENT_CAPACITY | OPENEVSE_CACHE_SETTINGS);
+    if(RAPI_RESPONSE_NK == ret && ack_missed)
     {
       char command[64];
       snprintf(command, sizeof(command), "$SY 165");
       _sender->sendCmd(command, [this, callback](int ret) {
+        cacheInvalidate(OPENEVSE_CACHE_CURRENT_CAPACITY | OPENEVSE_CACHE_SETTINGS);
         callback(ret);
       });
     } else {
@@ -1077,7 +1517,9 @@ void OpenEVSEClass::heartbeatPulse(bool ack_missed, std::function<void(int ret)>
     }
   });
 }
+#endif // OPENEVSE_ENABLE_HEARTBEAT
 
+#if OPENEVSE_ENABLE_ASYNC_EVENTS
 void OpenEVSEClass::onEvent()
 {
   if (!_sender) {
@@ -1092,10 +1534,15 @@ void OpenEVSEClass::onEvent()
     DBUGVAR(val);
     uint8_t state = strtol(val, NULL, 16);
     DBUGVAR(state);
+    RAPI_TRACE(RAPI_TRACE_EVSE_STATE, rapiTraceCode("ST"), 0, 0, (state << 8) | (uint8_t)OPENEVSE_STATE_INVALID, _sender->getTraceLink());
+
+    _status.evse_state = state;
+    statusUpdated();
 
     if(_state) {
       _state(state, OPENEVSE_STATE_INVALID, 0, 0);
     }
+    publish(stateEvent(OPENEVSE_EVENT_STATE));
   }
   else if(!strcmp(_sender->getToken(0), "$WF"))
   {
@@ -1108,6 +1555,11 @@ void OpenEVSEClass::onEvent()
     if(_wifi) {
       _wifi(wifiMode);
     }
+
+    OpenEVSEEvent event = {};
+    event.type = OPENEVSE_EVENT_WIFI;
+    event.wifi = wifiMode;
+    publish(event);
   }
   else if(!strcmp(_sender->getToken(0), "$AT"))
   {
@@ -1124,19 +1576,44 @@ void OpenEVSEClass::onEvent()
     uint32_t vflags = strtol(val, NULL, 16);
 
     DBUGF("evse_state = %02x, pilot_state = %02x, current_capacity = %d, vflags = %08x", evse_state, pilot_state, current_capacity, vflags);
+    RAPI_TRACE(RAPI_TRACE_EVSE_STATE, rapiTraceCode("AT"), 0, 0, (evse_state << 8) | pilot_state, _sender->getTraceLink());
+
+    _status.evse_state = evse_state;
+    _status.pilot_state = pilot_state;
+    capacityUpdated(current_capacity);
+    statusUpdated();
+    flagsUpdated(vflags);
 
     if(_state) {
       _state(evse_state, pilot_state, current_capacity, vflags);
     }
+    publish(stateEvent(OPENEVSE_EVENT_STATE));
   }
   else if(!strcmp(_sender->getToken(0), "$AB"))
   {
     const char *val = _sender->getToken(1);
     uint8_t post_code = strtol(val, NULL, 16);
+    RAPI_TRACE(RAPI_TRACE_EVSE_BOOT, rapiTraceCode("AB"), 0, 0, post_code, _sender->getTraceLink());
 
     if(_boot) {
       _boot(post_code, _sender->getToken(2));
     }
+
+    OpenEVSEEvent event = {};
+    event.type = OPENEVSE_EVENT_BOOT;
+    event.post_code = post_code;
+    event.firmware = _sender->getToken(2);
+    publish(event);
+
+    // The controller restarted, what we had is stale until it is read again
+    _statusValid = false;
+    cacheInvalidate(OPENEVSE_CACHE_ALL);
+    if(_connected) {
+      _sender->sendCmd("$GS", [this](int ret) {
+        OpenEVSEStatusResult result;
+        parseStatus(ret, result);
+      });
+    }
   }
   else if(!strcmp(_sender->getToken(0), "$AN"))
   {
@@ -1146,7 +1623,97 @@ void OpenEVSEClass::onEvent()
     if(_button) {
       _button(log_press);
     }
+
+    OpenEVSEEvent event = {};
+    event.type = OPENEVSE_EVENT_BUTTON;
+    event.long_press = log_press;
+    publish(event);
+  }
+}
+
+OpenEVSEEvent OpenEVSEClass::stateEvent(uint8_t type)
+{
+  OpenEVSEEvent event = {};
+  event.type = type;
+  event.evse_state = _status.evse_state;
+  event.pilot_state = _status.pilot_state;
+  event.current_capacity = _status.current_capacity;
+  event.vflags = _status.vflags;
+  return event;
+}
+
+void OpenEVSEClass::publish(const OpenEVSEEvent &event)
+{
+  bool filtered = OPENEVSE_EVENT_STATE == event.type || OPENEVSE_EVENT_FLAGS == event.type;
+  uint32_t state = OPENEVSE_STATE_BIT(event.evse_state);
+
+  // frame.next is moved on if a callback unsubscribes the next subscriber
+  OpenEVSEDispatch frame = { _subscribers[event.type], _dispatch };
+  _dispatch = &frame;
+  while(frame.next)
+  {
+    OpenEVSESubscriber *subscriber = frame.next;
+    frame.next = subscriber->_next;
+    if((!filtered || (subscriber->_states & state)) && subscriber->_callback) {
+      subscriber->_callback(event);
+    }
+  }
+  _dispatch = frame.outer;
+}
+
+void OpenEVSEClass::subscribe(OpenEVSESubscriber &subscriber, uint8_t type, uint32_t states)
+{
+  if(type >= OPENEVSE_EVENT_TYPES) {
+    return;
+  }
+
+  subscriber.unsubscribe();
+
+  OpenEVSESubscriber **link = &_subscribers[type];
+  while(*link) {
+    link = &(*link)->_next;
+  }
+  subscriber._next = NULL;
+  subscriber._pprev = link;
+  subscriber._owner = this;
+  subscriber._states = states;
+  *link = &subscriber;
+}
+
+OpenEVSESubscriber::OpenEVSESubscriber(OpenEVSEEventCallback callback) :
+  _next(NULL),
+  _pprev(NULL),
+  _owner(NULL),
+  _states(OPENEVSE_STATE_ALL),
+  _callback(callback)
+{
+}
+
+OpenEVSESubscriber::~OpenEVSESubscriber()
+{
+  unsubscribe();
+}
+
+void OpenEVSESubscriber::unsubscribe()
+{
+  if(!_pprev) {
+    return;
+  }
+
+  for(OpenEVSEDispatch *dispatch = _owner->_dispatch; dispatch; dispatch = dispatch->outer)
+  {
+    if(dispatch->next == this) {
+      dispatch->next = _next;
+    }
+  }
+  *_pprev = _next;
+  if(_next) {
+    _next->_pprev = _pprev;
   }
+  _next = NULL;
+  _pprev = NULL;
+  _owner = NULL;
 }
+#endif // OPENEVSE_ENABLE_ASYNC_EVENTS
 
 OpenEVSEClass OpenEVSE;
@@ -122,29 +122,448 @@
 #define OPENEVSE_SERVICE_LEVEL_L1           '1'
 #define OPENEVSE_SERVICE_LEVEL_L2           '2'
 
+#define OPENEVSE_FIRMWARE_LEN 24
+#define OPENEVSE_PROTOCOL_LEN 12
+
+// Controller firmware profile. AUTO parses responses for the protocol
+// version the controller reports. A fleet on one known firmware can fix
+// it at build time, e.g. -DOPENEVSE_PROFILE=OPENEVSE_PROFILE_OCPP: the
+// version checks become constants, the D9 commands are left out unless
+// the profile is D9, and begin() fails on a controller from another
+// profile.
+#define OPENEVSE_PROFILE_AUTO     0
+#define OPENEVSE_PROFILE_LEGACY   1 // protocol before 5.0.0
+#define OPENEVSE_PROFILE_OCPP     2 // protocol 5.x
+#define OPENEVSE_PROFILE_D9       3 // linco-work D9, protocol 6.0.0 on
+
+#ifndef OPENEVSE_PROFILE
+#define OPENEVSE_PROFILE OPENEVSE_PROFILE_AUTO
+#endif
+
+#if OPENEVSE_PROFILE == OPENEVSE_PROFILE_LEGACY
+#define OPENEVSE_PROFILE_PROTOCOL      OPENEVSE_ENCODE_VERSION(1,0,0)
+#define OPENEVSE_PROFILE_PROTOCOL_END  OPENEVSE_OCPP_SUPPORT_PROTOCOL_VERSION
+#elif OPENEVSE_PROFILE == OPENEVSE_PROFILE_OCPP
+#define OPENEVSE_PROFILE_PROTOCOL      OPENEVSE_OCPP_SUPPORT_PROTOCOL_VERSION
+#define OPENEVSE_PROFILE_PROTOCOL_END  OPENEVSE_D9_SUPPORT_PROTOCOL_VERSION
+#elif OPENEVSE_PROFILE == OPENEVSE_PROFILE_D9
+#define OPENEVSE_PROFILE_PROTOCOL      OPENEVSE_D9_SUPPORT_PROTOCOL_VERSION
+#define OPENEVSE_PROFILE_PROTOCOL_END  0xffffffffUL
+#elif OPENEVSE_PROFILE != OPENEVSE_PROFILE_AUTO
+#error "Unknown OPENEVSE_PROFILE"
+#endif
+
+// Feature groups, all built by default. Define one as 0 to leave its calls
+// out of the library, e.g. -DOPENEVSE_ENABLE_LCD=0. examples/footprint
+// reports what each one costs.
+#ifndef OPENEVSE_ENABLE_D9
+#if OPENEVSE_PROFILE == OPENEVSE_PROFILE_AUTO || OPENEVSE_PROFILE == OPENEVSE_PROFILE_D9
+#define OPENEVSE_ENABLE_D9            1 // linco-work D9 extensions
+#else
+#define OPENEVSE_ENABLE_D9            0
+#endif
+#endif
+#ifndef OPENEVSE_ENABLE_LCD
+#define OPENEVSE_ENABLE_LCD           1
+#endif
+#ifndef OPENEVSE_ENABLE_HEARTBEAT
+#define OPENEVSE_ENABLE_HEARTBEAT     1
+#endif
+#ifndef OPENEVSE_ENABLE_TIME
+#define OPENEVSE_ENABLE_TIME          1 // controller RTC, $GT and $S1
+#endif
+#ifndef OPENEVSE_ENABLE_ASYNC_EVENTS
+#define OPENEVSE_ENABLE_ASYNC_EVENTS  1 // onBoot(), onState(), onWiFi(), onButton(), onFlags() and subscribe()
+#endif
+#ifndef OPENEVSE_ENABLE_TELEMETRY
+#define OPENEVSE_ENABLE_TELEMETRY     1 // getTelemetry() batches
+#endif
+#ifndef OPENEVSE_ENABLE_CACHE
+#define OPENEVSE_ENABLE_CACHE         1 // setCacheTtl() getter cache
+#endif
+// co_await versions of the calls, on by default with C++20 coroutines
+#ifndef OPENEVSE_ENABLE_COROUTINES
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+#define OPENEVSE_ENABLE_COROUTINES    1
+#else
+#define OPENEVSE_ENABLE_COROUTINES    0
+#endif
+#endif
+
+#define OPENEVSE_SNAPSHOT_MAGIC   0x45564553 // "SEVE"
+#define OPENEVSE_SNAPSHOT_VERSION 2
+
+// OpenEVSESnapshot::known, status fields read from the controller
+#define OPENEVSE_SNAPSHOT_KNOWN_VFLAGS   0x01
+#define OPENEVSE_SNAPSHOT_KNOWN_CAPACITY 0x02
+
+// Default maximum age of a snapshot in seconds before it is considered
+// stale, 0 disables the check
+#ifndef OPENEVSE_SNAPSHOT_MAX_AGE
+#define OPENEVSE_SNAPSHOT_MAX_AGE 3600
+#endif
+
+// getStatusAge() before the status is known
+#define OPENEVSE_STATUS_AGE_UNKNOWN 0xffffffffUL
+
+// Last charger status seen, from $GS or the async state events,
+// current_capacity also from $GC and $SC
+struct OpenEVSEStatus {
+  uint8_t evse_state;
+  uint8_t pilot_state;
+  uint32_t current_capacity;
+  uint32_t vflags;
+  uint32_t updated;           // millis() of the last update
+};
+
+// Connection state saved by OpenEVSEClass::saveSnapshot(), sized for
+// RTC memory. Treat as opaque, the layout changes with the version.
+struct OpenEVSESnapshot {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+  uint32_t saved;             // time() when saved, 0 if the clock was not set
+  uint32_t protocol;
+  uint8_t connected;
+  uint8_t sequence_id;
+  uint8_t sequence_id_enabled;
+  uint8_t known;              // OPENEVSE_SNAPSHOT_KNOWN_* status fields seen
+  char firmware[OPENEVSE_FIRMWARE_LEN];
+  OpenEVSEStatus status;
+  uint32_t checksum;
+};
+
+// Typed results, what the callbacks are given and what the awaitable calls
+// return. ret is a RAPI_RESPONSE_* code, the rest is only valid if it is
+// RAPI_RESPONSE_OK.
+struct OpenEVSEResult {
+  int ret;
+};
+
+struct OpenEVSEVersionResult {
+  int ret;
+  char firmware[OPENEVSE_FIRMWARE_LEN];
+  char protocol[OPENEVSE_PROTOCOL_LEN];
+};
+
+struct OpenEVSEStatusResult {
+  int ret;
+  uint8_t evse_state;
+  uint32_t session_time;
+  uint8_t pilot_state;
+  uint32_t vflags;
+};
+
+struct OpenEVSEChargeResult {
+  int ret;
+  double amps;
+  double volts;
+};
+
+struct OpenEVSETemperatureResult {
+  int ret;
+  double temp[3];
+  bool valid[3];
+};
+
+struct OpenEVSEEnergyResult {
+  int ret;
+  double session_wh;
+  double total_kwh;
+};
+
+struct OpenEVSECurrentCapacityResult {
+  int ret;
+  long min_current;
+  long max_hardware_current;
+  long pilot;
+  long max_configured_current;
+};
+
+// $SC answers with the pilot set, with $NK too if it had to be clamped
+struct OpenEVSEPilotResult {
+  int ret;
+  long pilot;
+};
+
+struct OpenEVSEFaultCountersResult {
+  int ret;
+  long gfci_count;
+  long nognd_count;
+  long stuck_count;
+};
+
+struct OpenEVSESettingsResult {
+  int ret;
+  long pilot;
+  uint32_t flags;
+};
+
+// serial points in to the response, only valid in the callback
+struct OpenEVSESerialResult {
+  int ret;
+  const char *serial;
+};
+
+struct OpenEVSEFrequencyResult {
+  int ret;
+  uint32_t frequency;
+};
+
+struct OpenEVSERelayResult {
+  int ret;
+  bool dc1;
+  bool dc2;
+  bool ac;
+};
+
+struct OpenEVSEAmmeterResult {
+  int ret;
+  long scale;
+  long offset;
+};
+
+struct OpenEVSETimerResult {
+  int ret;
+  int start_hour;
+  int start_minute;
+  int end_hour;
+  int end_minute;
+};
+
+struct OpenEVSEHeartbeatResult {
+  int ret;
+  int interval;
+  int current;
+  int triggered;
+};
+
+#if OPENEVSE_ENABLE_TELEMETRY
+// Items for getTelemetry()
+#define OPENEVSE_TELEMETRY_STATUS       0x01 // $GS
+#define OPENEVSE_TELEMETRY_CHARGE       0x02 // $GG
+#define OPENEVSE_TELEMETRY_TEMPERATURE  0x04 // $GP
+#define OPENEVSE_TELEMETRY_ENERGY       0x08 // $GU
+#define OPENEVSE_TELEMETRY_ALL          0x0f
+
+// One telemetry tick, each item has its own ret. Items not requested are
+// left with RAPI_RESPONSE_TIMEOUT.
+struct OpenEVSETelemetry {
+  uint8_t requested;  // OPENEVSE_TELEMETRY_* items asked for
+  uint8_t failed;     // items that did not get RAPI_RESPONSE_OK
+  uint32_t took;      // ms from queuing the first command to the last reply
+  OpenEVSEStatusResult status;
+  OpenEVSEChargeResult charge;
+  OpenEVSETemperatureResult temperature;
+  OpenEVSEEnergyResult energy;
+};
+
+typedef std::function<void(int ret, const OpenEVSETelemetry &telemetry)> OpenEVSETelemetryCallback;
+#endif
+
+// Getters OpenEVSEClass::setCacheTtl() can cache
+#define OPENEVSE_CACHE_VERSION           0x01 // $GV
+#define OPENEVSE_CACHE_SERIAL            0x02 // $GI
+#define OPENEVSE_CACHE_SETTINGS          0x04 // $GE
+#define OPENEVSE_CACHE_CURRENT_CAPACITY  0x08 // $GC
+#define OPENEVSE_CACHE_AMMETER           0x10 // $GA
+#define OPENEVSE_CACHE_TIMER             0x20 // $GD
+#define OPENEVSE_CACHE_ALL               0x3f
+#define OPENEVSE_CACHE_ITEMS             6
+
+// 6 ASCII characters and 4 hex digits
+#define OPENEVSE_SERIAL_LEN 16
+
+template<typename T> class OpenEVSEAwaitable;
+class OpenEVSEHeartbeatAwaitable;
+class OpenEVSEWaitAwaitable;
+class OpenEVSEClass;
+
 typedef std::function<void(uint8_t post_code, const char *firmware)> OpenEVSEBootCallback;
 typedef std::function<void(uint8_t evse_state, uint8_t pilot_state, uint32_t current_capacity, uint32_t vflags)> OpenEVSEStateCallback;
 typedef std::function<void(uint8_t event)> OpenEVSEWiFiCallback;
 typedef std::function<void(uint8_t long_press)> OpenEVSEButtonCallback;
+typedef std::function<void(uint32_t vflags, uint32_t changed)> OpenEVSEFlagsCallback;
+typedef std::function<void(int ret, const OpenEVSEStatus &status)> OpenEVSEStatusCallback;
+
+#if OPENEVSE_ENABLE_ASYNC_EVENTS
+// Event types for OpenEVSEClass::subscribe()
+#define OPENEVSE_EVENT_BOOT    0 // $AB
+#define OPENEVSE_EVENT_STATE   1 // $ST or $AT
+#define OPENEVSE_EVENT_WIFI    2 // $WF
+#define OPENEVSE_EVENT_BUTTON  3 // $AN
+#define OPENEVSE_EVENT_FLAGS   4 // vflags changed, see onFlags()
+#define OPENEVSE_EVENT_TYPES   5
+
+// Bit for an evse_state in a subscriber's state mask, sleeping and disabled
+// are bits 30 and 31
+#define OPENEVSE_STATE_BIT(state) \
+  (1UL << ((state) >= OPENEVSE_STATE_SLEEPING ? (state) - OPENEVSE_STATE_SLEEPING + 30 : (state) & 0x1f))
+#define OPENEVSE_STATE_ALL 0xffffffffUL
+
+// One event, only the fields for its type are set. The state fields are
+// the status model after the event, a $ST only changes evse_state.
+struct OpenEVSEEvent {
+  uint8_t type;               // OPENEVSE_EVENT_*
+  uint8_t evse_state;         // STATE and FLAGS
+  uint8_t pilot_state;        // STATE
+  uint32_t current_capacity;  // STATE
+  uint32_t vflags;            // STATE and FLAGS
+  uint32_t changed;           // FLAGS, the vflags bits that flipped
+  uint8_t post_code;          // BOOT
+  const char *firmware;       // BOOT, only valid in the callback
+  uint8_t wifi;               // WIFI mode
+  uint8_t long_press;         // BUTTON
+};
+
+typedef std::function<void(const OpenEVSEEvent &event)> OpenEVSEEventCallback;
+
+class OpenEVSESubscriber;
+
+// Cursor of a publish() in progress, on its stack. A callback can publish
+// again, e.g. by pumping the RapiSender, so they are linked for
+// unsubscribe() to move every one on past a subscriber it removes.
+struct OpenEVSEDispatch {
+  OpenEVSESubscriber *next;
+  OpenEVSEDispatch *outer;
+};
+
+// A subscription to one event type, linked in to the OpenEVSEClass it is
+// subscribed to. Owned by the subscriber, which is the unsubscribe handle,
+// and unsubscribed when destroyed.
+class OpenEVSESubscriber
+{
+  friend class OpenEVSEClass;
+
+  private:
+    OpenEVSESubscriber *_next;
+    OpenEVSESubscriber **_pprev;
+    OpenEVSEClass *_owner;
+    uint32_t _states;
+    OpenEVSEEventCallback _callback;
+
+  public:
+    OpenEVSESubscriber(OpenEVSEEventCallback callback = nullptr);
+    ~OpenEVSESubscriber();
+
+    OpenEVSESubscriber(const OpenEVSESubscriber &) = delete;
+    OpenEVSESubscriber &operator=(const OpenEVSESubscriber &) = delete;
+
+    void setCallback(OpenEVSEEventCallback callback) {
+      _callback = callback;
+    }
+
+    bool isSubscribed() {
+      return nullptr != _pprev;
+    }
+
+    void unsubscribe();
+};
+#endif
 
 class OpenEVSEClass
 {
+  template<typename T> friend class OpenEVSEAwaitable;
+  friend class OpenEVSEHeartbeatAwaitable;
+#if OPENEVSE_ENABLE_ASYNC_EVENTS
+  friend class OpenEVSESubscriber;
+#endif
+
   private:
     RapiSender *_sender;
 
     bool _connected;
     uint32_t _protocol;
+    char _firmware[OPENEVSE_FIRMWARE_LEN];
+    OpenEVSEStatus _status;
+    bool _statusValid;
+    bool _vflagsKnown;          // _status.vflags has been read, not just zeroed
+    bool _capacityKnown;        // likewise _status.current_capacity
 
+#if OPENEVSE_ENABLE_ASYNC_EVENTS
     OpenEVSEBootCallback _boot;
     OpenEVSEStateCallback _state;
     OpenEVSEWiFiCallback _wifi;
     OpenEVSEButtonCallback _button;
+    OpenEVSEFlagsCallback _flags;
+    OpenEVSESubscriber *_subscribers[OPENEVSE_EVENT_TYPES];
+    OpenEVSEDispatch *_dispatch;
 
     void onEvent();
+    void publish(const OpenEVSEEvent &event);
+    OpenEVSEEvent stateEvent(uint8_t type);
+#endif
+    void statusUpdated();
+    void flagsUpdated(uint32_t vflags);
+    void capacityUpdated(uint32_t current_capacity);
+#if OPENEVSE_ENABLE_TELEMETRY
+    OpenEVSETelemetry _telemetry;
+    OpenEVSETelemetryCallback _telemetryCallback;
+    uint32_t _telemetryStart;
+    uint8_t _telemetryPending;
+
+    void telemetryItem(uint8_t item, int ret);
+#endif
+#if OPENEVSE_ENABLE_CACHE
+    uint32_t _cacheTtl[OPENEVSE_CACHE_ITEMS];
+    uint32_t _cacheUpdated[OPENEVSE_CACHE_ITEMS];
+    uint8_t _cacheValid;
+    OpenEVSEVersionResult _cacheVersion;
+    char _cacheSerial[OPENEVSE_SERIAL_LEN];
+    OpenEVSESettingsResult _cacheSettings;
+    OpenEVSECurrentCapacityResult _cacheCurrentCapacity;
+    OpenEVSEAmmeterResult _cacheAmmeter;
+    OpenEVSETimerResult _cacheTimer;
+
+    bool cached(uint8_t item);
+    void cacheStore(uint8_t item);
+#endif
+    // Drop the cached OPENEVSE_CACHE_* items, after a command that changes them
+    void cacheInvalidate(uint8_t items) {
+#if OPENEVSE_ENABLE_CACHE
+      _cacheValid &= ~items;
+#endif
+    }
+    void attach(RapiSender &sender);
+    void connected(const char *firmware, const char *protocol);
+
+    // The protocol version responses are parsed for, a constant unless
+    // the profile is AUTO
+    uint32_t protocol() {
+#if OPENEVSE_PROFILE == OPENEVSE_PROFILE_AUTO
+      return _protocol;
+#else
+      return OPENEVSE_PROFILE_PROTOCOL;
+#endif
+    }
+
+    // Whether responses in protocol version can be parsed by this build,
+    // the responses would be misread outside a fixed profile's range
+    bool inProfile(uint32_t protocol) {
+#if OPENEVSE_PROFILE == OPENEVSE_PROFILE_AUTO
+      return true;
+#else
+      return protocol >= OPENEVSE_PROFILE_PROTOCOL && protocol < OPENEVSE_PROFILE_PROTOCOL_END;
+#endif
+    }
+
+    // Parse the response to the command just completed, shared by the
+    // callback and awaitable calls
+    void parseConnect(int ret, OpenEVSEVersionResult &result);
+    void parseVersion(int ret, OpenEVSEVersionResult &result);
+    void parseStatus(int ret, OpenEVSEStatusResult &result);
+    void parseChargeCurrentAndVoltage(int ret, OpenEVSEChargeResult &result);
+    void parseTemperature(int ret, OpenEVSETemperatureResult &result);
+    void parseEnergy(int ret, OpenEVSEEnergyResult &result);
+    void parseCurrentCapacity(int ret, OpenEVSECurrentCapacityResult &result);
+    void parsePilot(int ret, OpenEVSEPilotResult &result);
+    void parseResult(int ret, OpenEVSEResult &result) {
+      result.ret = ret;
+    }
 
   public:
     OpenEVSEClass();
-    ~OpenEVSEClass() { }
+    ~OpenEVSEClass();
 
     void begin(RapiSender &sender, std::function<void(bool connected)> callback);
     void begin(RapiSender &sender, std::function<void(bool connected, const char *firmware, const char *protocol)> callback);
@@ -153,9 +572,11 @@ class OpenEVSEClass
 
     void getVersion(std::function<void(int ret, const char *firmware, const char *protocol)> callback);
 
+#if OPENEVSE_ENABLE_TIME
     void getTime(std::function<void(int ret, time_t time)> callback);
     void setTime(time_t time, std::function<void(int ret)> callback);
     void setTime(tm &time, std::function<void(int ret)> callback);
+#endif
 
     void getChargeCurrentAndVoltage(std::function<void(int ret, double amps, double volts)> callback);
     void getTemperature(std::function<void(int ret, double temp1, bool temp1_valid, double temp2, bool temp2_valid, double temp3, bool temp3_valid)> callback);
@@ -164,12 +585,26 @@ class OpenEVSEClass
     void getSettings(std::function<void(int ret, long pilot, uint32_t flags)> callback);
     void getSerial(std::function<void(int ret, const char *serial)> callback);
 
+#if OPENEVSE_ENABLE_TELEMETRY
+    // Queue the requested OPENEVSE_TELEMETRY_* reads back to back and call
+    // callback once with them all. ret is RAPI_RESPONSE_OK if every item
+    // was, otherwise the first failure, check each item's ret for the
+    // rest. Only one batch at a time, another while one is in flight gets
+    // RAPI_RESPONSE_QUEUE_FULL straight away.
+    void getTelemetry(uint8_t items, OpenEVSETelemetryCallback callback);
+    void getTelemetry(OpenEVSETelemetryCallback callback) {
+      getTelemetry(OPENEVSE_TELEMETRY_ALL, callback);
+    }
+#endif
+
+#if OPENEVSE_ENABLE_D9
     // linco-work D9 firmware extensions
     void getFrequency(std::function<void(int ret, uint32_t frequency)> callback);
     void getRelayStatus(std::function<void(int ret, bool dc1, bool dc2, bool ac)> callback);
     void setRelayEnable(int relay, bool enable, std::function<void(int ret)> callback);
     void resetFaultCounters(std::function<void(int ret)> callback);
     void setPanicTemperature(uint32_t tempC, std::function<void(int ret)> callback);
+#endif
 
     void setServiceLevel(uint8_t level, std::function<void(int ret)> callback);
 
@@ -197,22 +632,86 @@ class OpenEVSEClass
     void restart(std::function<void(int ret)> callback);
     void clearBootLock(std::function<void(int ret)> callback);
 
+#if OPENEVSE_ENABLE_LCD
     void lcdEnable(bool enable, std::function<void(int ret)> callback);
     void lcdSetColour(int colour, std::function<void(int ret)> callback);
     void lcdDisplayText(int x, int y, const char *text, std::function<void(int ret)> callback);
+#endif
 
     void feature(uint8_t feature, bool enable, std::function<void(int ret)> callback);
 
+#if OPENEVSE_ENABLE_HEARTBEAT
     void heartbeatEnable(int interval, int current, std::function<void(int ret, int interval, int current, int triggered)> callback);
     void heartbeatPulse(bool ack_missed, std::function<void(int ret)> callback);
     void heartbeatPulse(std::function<void(int ret)> callback) {
       heartbeatPulse(true, callback);
     }
+#endif
+
+#if OPENEVSE_ENABLE_COROUTINES
+    // Awaitable calls for coroutines, see OpenEVSECoroutine.h, e.g.
+    //   OpenEVSEStatusResult status = co_await evse.status();
+    // No std::function is allocated per call.
+    OpenEVSEAwaitable<OpenEVSEVersionResult> connect(RapiSender &sender);
+    OpenEVSEAwaitable<OpenEVSEResult> command(const char *command);
+    OpenEVSEAwaitable<OpenEVSEVersionResult> version();
+    OpenEVSEAwaitable<OpenEVSEStatusResult> status();
+    OpenEVSEAwaitable<OpenEVSEChargeResult> chargeCurrentAndVoltage();
+    OpenEVSEAwaitable<OpenEVSETemperatureResult> temperature();
+    OpenEVSEAwaitable<OpenEVSEEnergyResult> energy();
+    OpenEVSEAwaitable<OpenEVSECurrentCapacityResult> currentCapacity();
+    OpenEVSEAwaitable<OpenEVSEPilotResult> setCurrentCapacity(long amps, bool save);
+    OpenEVSEWaitAwaitable wait(uint32_t ms);
+#if OPENEVSE_ENABLE_HEARTBEAT
+    OpenEVSEHeartbeatAwaitable heartbeat(bool ack_missed = true);
+#endif
+#endif
 
     bool isConnected() {
       return _connected;
     }
 
+#if OPENEVSE_ENABLE_CACHE
+    // Answer the OPENEVSE_CACHE_* getters in items from their last response
+    // for up to ttl ms, 0 (the default) always asks the controller. A hit
+    // calls back straight away without queuing a command. The setters that
+    // change a value, a controller restart and begin() drop it, commands
+    // sent some other way do not.
+    void setCacheTtl(uint8_t items, uint32_t ttl);
+    void clearCache() {
+      cacheInvalidate(OPENEVSE_CACHE_ALL);
+    }
+#endif
+
+    // Save the connection state in to buffer, e.g. RTC memory before a deep
+    // sleep. Returns the number of bytes used or 0 if buffer is too small.
+    size_t saveSnapshot(void *buffer, size_t size);
+
+    // Reconnect from a snapshot instead of calling begin(), skipping the $GV
+    // handshake. Fails if the snapshot is corrupt, from a different library
+    // version, for a protocol outside the built OPENEVSE_PROFILE or older
+    // than max_age seconds (needs a valid clock).
+    bool restoreSnapshot(RapiSender &sender, const void *buffer, size_t size, uint32_t max_age = OPENEVSE_SNAPSHOT_MAX_AGE);
+
+    // Firmware version reported by the controller. Valid once connected.
+    const char *getFirmwareVersion() {
+      return _firmware;
+    }
+
+    // Last status received, from getStatus() or async state events
+    const OpenEVSEStatus &getLastStatus() {
+      return _status;
+    }
+    // ms since the status was last updated, OPENEVSE_STATUS_AGE_UNKNOWN if
+    // it has not been since begin(), a restored snapshot or a controller
+    // restart
+    uint32_t getStatusAge();
+
+    // The status no older than max_age ms: straight away from the state
+    // model if it is fresh enough, with $AT events that is most of the
+    // time, otherwise from a $GS
+    void refreshStatus(uint32_t max_age, OpenEVSEStatusCallback callback);
+
     // RAPI protocol version reported by the controller, encoded with
     // OPENEVSE_ENCODE_VERSION (e.g. "6.0.0" -> 6000). Valid once connected.
     uint32_t getProtocolVersion() {
@@ -220,9 +719,10 @@ class OpenEVSEClass
     }
     // True if the controller supports the linco-work D9 command set.
     bool isD9Supported() {
-      return _protocol >= OPENEVSE_D9_SUPPORT_PROTOCOL_VERSION;
+      return protocol() >= OPENEVSE_D9_SUPPORT_PROTOCOL_VERSION;
     }
 
+#if OPENEVSE_ENABLE_ASYNC_EVENTS
     void onBoot(OpenEVSEBootCallback callback) {
       _boot = callback;
     }
@@ -235,8 +735,28 @@ class OpenEVSEClass
     void onButton(OpenEVSEButtonCallback callback) {
       _button = callback;
     }
+    // vflags edges, changed has the bits that flipped, e.g.
+    // OPENEVSE_VFLAG_CHARGING_ON or OPENEVSE_VFLAG_EV_CONNECTED, from $AT
+    // events or a $GS. Called before onState(). Nothing is reported until
+    // there is an earlier value to compare with, so not for the first read
+    // after begin() unless a snapshot was restored.
+    void onFlags(OpenEVSEFlagsCallback callback) {
+      _flags = callback;
+    }
+
+    // Any number of subscribers, unlike the on*() callbacks. subscriber is
+    // called for the events of type, after the on*() callback and in the
+    // order they subscribed. STATE and FLAGS events are only passed on while
+    // evse_state is in states, OPENEVSE_STATE_BIT()s. Subscribing again
+    // moves subscriber to the new type. Nothing is allocated per event.
+    void subscribe(OpenEVSESubscriber &subscriber, uint8_t type, uint32_t states = OPENEVSE_STATE_ALL);
+#endif
 };
 
 extern OpenEVSEClass OpenEVSE;
 
+#if OPENEVSE_ENABLE_COROUTINES
+#include "OpenEVSECoroutine.h"
+#endif
+
 #endif